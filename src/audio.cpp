@@ -20,9 +20,13 @@
 #include "audio.hpp"
 
 #include <iostream>
+#include <cstdio>
+#include <cstring>
 
 namespace navi {
 
+// Declared in misc.cpp
+extern const wxEventType naviPipelineNotifyEvent;
 
 //==============================================================================
 
@@ -44,19 +48,82 @@ const wxString& AudioException::getAsWxString() const throw() {
 
 //==============================================================================
 
-PipelineListener::PipelineListener() {
+void PipelineNotification::setValue(const char* utf8) throw() {
+    size_t len = strlen(utf8);
+    if (len >= VALUE_SIZE) {
+        len = VALUE_SIZE - 1;
+        // don't cut a multibyte character in half.
+        while (len > 0 && (utf8[len] & 0xC0) == 0x80) {
+            len--;
+        }
+    }
+    memcpy(value, utf8, len);
+    value[len] = '\0';
+}
+
+//==============================================================================
+
+NotificationQueue::NotificationQueue() throw() :
+        m_head(0),
+        m_tail(0) {
+}
+
+PipelineNotification* NotificationQueue::reserve() throw() {
+    gint tail = g_atomic_int_get(&m_tail);
+    if ((tail + 1) % CAPACITY == g_atomic_int_get(&m_head)) {
+        return NULL;
+    }
+    return &m_slots[tail];
+}
+
+void NotificationQueue::commit() throw() {
+    // the atomic set is a barrier: the slot is written before it's published.
+    g_atomic_int_set(&m_tail, (g_atomic_int_get(&m_tail) + 1) % CAPACITY);
+}
+
+bool NotificationQueue::pop(PipelineNotification& out) throw() {
+    gint head = g_atomic_int_get(&m_head);
+    if (head == g_atomic_int_get(&m_tail)) {
+        return false;
+    }
+    out = m_slots[head];
+    // only now the producer may reuse the slot.
+    g_atomic_int_set(&m_head, (head + 1) % CAPACITY);
+    return true;
 }
 
 //==============================================================================
 
 Pipeline::Pipeline() throw() :
         m_intervalTag(0),
+        m_busWatchTag(0),
+        m_wakePending(0),
+        m_endPending(0),
+        m_notifyHandler(NULL),
+        m_notifyEpoch(0),
+        m_switchTag(0),
+        m_lastPosition(-1),
+        m_intervalMs(1000),
+        m_reporting(false),
+        m_idleTag(0),
+        m_stalled(false),
+        m_filled(false),
         m_location(wxT("")),
         m_bus(NULL), 
         m_pipeline(NULL) {
 }
 
 Pipeline::~Pipeline() {
+    // by removing the timeout, we remove the callback we initially registered
+    // using the function registerInterval(). Together with the bus watch and
+    // the position request and switch poll, these are the only producers of
+    // notifications, and they run in the same main context as this
+    // destructor. Once removed, `this' is never touched again.
+    unregisterInterval();
+    removeSource(m_busWatchTag);
+    removeSource(m_idleTag);
+    removeSource(m_switchTag);
+
     // Set state of pipeline to GST_STATE_NULL. We also do an explicit checking
     // of m_pipeline NULLage, or else GST_IS_ELEMENT will brabble about assertions
     // failed etc. etc.
@@ -80,74 +147,141 @@ Pipeline::~Pipeline() {
             gst_object_unref(m_pipeline); 
         }
     }
+}
 
-    // by removing the timeout, we remove the callback we initially registered
-    // using the function registerInterval(). Tag must be > 0, or else we'll get
-    // some assertion errors from glib. 
-    if(m_intervalTag > 0) {
-        g_source_remove(m_intervalTag);
-    }
+void Pipeline::setNotifyHandler(wxEvtHandler* handler, long epoch) throw() {
+    m_notifyHandler = handler;
+    m_notifyEpoch = epoch;
 }
 
-void Pipeline::addListener(PipelineListener* const listener) throw() { 
-    m_listeners.push_back(listener);
+void Pipeline::rearmNotify() throw() {
+    g_atomic_int_set(&m_wakePending, 0);
 }
 
-void Pipeline::fireError(const wxString& error) throw() {
-    wxMutexLocker lock(s_pipelineListenerMutex);  
+void Pipeline::setNextLocation(const wxString& location) throw() {
+    wxMutexLocker lock(m_nextMutex);
+    m_nextUri = std::string(location.mb_str());
+}
 
-    std::vector<PipelineListener*>::iterator it = m_listeners.begin();
-    while(it < m_listeners.end()) {
-        (*it)->pipelineError(this, error);
-        it++;
+bool Pipeline::popNotification(PipelineNotification& out) throw() {
+    if (m_notifications.pop(out)) {
+        if (out.kind == PipelineNotification::NOTIFY_TRACK_CHANGED) {
+            // the location is only ever read on this thread.
+            m_location = wxString(out.value, *wxConvCurrent);
+        }
+        return true;
     }
+    // the end of the stream comes after everything else.
+    if (g_atomic_int_compare_and_exchange(&m_endPending, 1, 0)) {
+        out.kind = PipelineNotification::NOTIFY_END;
+        return true;
+    }
+    return false;
 }
 
-void Pipeline::fireTagRead(const char* type, const wxString& value) throw() {
-     wxMutexLocker lock(s_pipelineListenerMutex);  
+void Pipeline::wakeNotifyHandler() throw() {
+    if (m_notifyHandler == NULL) {
+        return;
+    }
+    // one wake up covers everything queued until the handler rearms.
+    if (g_atomic_int_compare_and_exchange(&m_wakePending, 0, 1)) {
+        wxCommandEvent event(naviPipelineNotifyEvent);
+        event.SetExtraLong(m_notifyEpoch);
+        m_notifyHandler->AddPendingEvent(event);
+    }
+}
 
-    std::vector<PipelineListener*>::iterator it = m_listeners.begin();
-    while(it < m_listeners.end()) {
-        (*it)->pipelineTagRead(this, type, value);
-        it++;
-    }   
+void Pipeline::fireError(const char* error) throw() {
+    PipelineNotification* n = m_notifications.reserve();
+    if (n == NULL) {
+        std::cerr << "Pipeline: notification queue full, dropped error: " << error << std::endl;
+        return;
+    }
+    n->kind = PipelineNotification::NOTIFY_ERROR;
+    n->setValue(error);
+    m_notifications.commit();
+    wakeNotifyHandler();
 }
 
-void Pipeline::firePositionChanged(gint64 pos, gint64 len) throw() {
-    wxMutexLocker lock(s_pipelineListenerMutex);  
+void Pipeline::fireTagRead(const char* type, const char* value) throw() {
+    PipelineNotification* n = m_notifications.reserve();
+    if (n == NULL) {
+        return;
+    }
+    n->kind = PipelineNotification::NOTIFY_TAG;
+    n->tagType = type;
+    n->setValue(value);
+    m_notifications.commit();
+    wakeNotifyHandler();
+}
 
-    std::vector<PipelineListener*>::iterator it = m_listeners.begin();
-    while(it < m_listeners.end()) {
-        // convert nanoseconds to seconds here plx.
-        (*it)->pipelinePosChanged(this, pos / GST_SECOND, len / GST_SECOND);
-        it++;
+void Pipeline::firePositionChanged(gint64 pos, gint64 len) throw() {
+    PipelineNotification* n = m_notifications.reserve();
+    if (n == NULL) {
+        return;
     }
+    n->kind = PipelineNotification::NOTIFY_POSITION;
+    // convert nanoseconds to seconds here plx.
+    n->position = pos / GST_SECOND;
+    n->length = len / GST_SECOND;
+    m_notifications.commit();
+    wakeNotifyHandler();
 }
 
 void Pipeline::fireStreamEnd() throw() {
-    // lolmutex
-    wxMutexLocker lock(s_pipelineListenerMutex);  
+    g_atomic_int_set(&m_endPending, 1);
+    wakeNotifyHandler();
+}
 
-    std::vector<PipelineListener*>::iterator it = m_listeners.begin();
-    while(it < m_listeners.end()) {
-        // FIXME: this may horribly segfault when skipping to a next song
-        (*it)->pipelineStreamEnd(this);
-        it++;
-    }   
+void Pipeline::fireBuffering(int percent) throw() {
+    PipelineNotification* n = m_notifications.reserve();
+    if (n == NULL) {
+        return;
+    }
+    n->kind = PipelineNotification::NOTIFY_BUFFERING;
+    n->position = percent;
+    n->length = m_stalled && m_filled ? 1 : 0;
+    m_notifications.commit();
+    wakeNotifyHandler();
 }
 
-bool Pipeline::onInterval(Pipeline* pipeline) {
-    GstFormat fmt = GST_FORMAT_TIME;
-    // nanoseconds:
-    gint64 pos, len;
+bool Pipeline::fireTrackChanged() throw() {
+    PipelineNotification* n = m_notifications.reserve();
+    if (n == NULL) {
+        return false;
+    }
+    n->kind = PipelineNotification::NOTIFY_TRACK_CHANGED;
+    {
+        wxMutexLocker lock(m_nextMutex);
+        n->setValue(m_switchUri.c_str());
+    }
+    m_notifications.commit();
+    wakeNotifyHandler();
+    return true;
+}
 
-    // remember, m_pipeline (member of Pipeline) is protected.
-    // therefore we can access it easily.
+void Pipeline::onAboutToFinish(GstElement* playbin, gpointer userdata) {
+    // NOTE: this function is called from a gst streaming thread.
+    Pipeline* pipeline = static_cast<Pipeline*>(userdata);
 
-    if (gst_element_query_position (pipeline->m_pipeline, &fmt, &pos)
-            && gst_element_query_duration (pipeline->m_pipeline, &fmt, &len)) {
-        pipeline->firePositionChanged(pos, len);
-    }    
+    wxMutexLocker lock(pipeline->m_nextMutex);
+    if (pipeline->m_nextUri.empty()) {
+        // nothing queued: the stream just ends.
+        return;
+    }
+
+    g_object_set(G_OBJECT(playbin), "uri", pipeline->m_nextUri.c_str(), NULL);
+    pipeline->m_switchUri = pipeline->m_nextUri;
+    pipeline->m_nextUri.clear();
+
+    // Notifications are only queued from the main context, so let the bus
+    // watch know. The playbin still has to play the end of the current track.
+    GstStructure* s = gst_structure_new("navi-about-to-finish", NULL);
+    gst_element_post_message(playbin, gst_message_new_application(GST_OBJECT(playbin), s));
+}
+
+bool Pipeline::onInterval(Pipeline* pipeline) {
+    pipeline->reportPosition();
 
     // by returning true, we ensure this interval function gets called
     // periodically. If we return false, the timeout will be discarded.
@@ -156,16 +290,127 @@ bool Pipeline::onInterval(Pipeline* pipeline) {
     return true;
 }
 
+gboolean Pipeline::onPositionRequest(gpointer userdata) {
+    Pipeline* pipeline = static_cast<Pipeline*>(userdata);
+    pipeline->m_idleTag = 0;
+    pipeline->reportPosition();
+    return FALSE; // once.
+}
+
+gboolean Pipeline::onSwitchPoll(gpointer userdata) {
+    Pipeline* pipeline = static_cast<Pipeline*>(userdata);
+    GstFormat fmt = GST_FORMAT_TIME;
+    gint64 pos;
+    if (!gst_element_query_position(pipeline->m_pipeline, &fmt, &pos)) {
+        return TRUE;
+    }
+
+    // If the notification doesn't fit, try again next time.
+    if (pipeline->m_lastPosition >= 0 && pos < pipeline->m_lastPosition
+            && pipeline->fireTrackChanged()) {
+        pipeline->m_switchTag = 0;
+        pipeline->m_lastPosition = -1;
+        // the slider shouldn't wait for the next interval.
+        pipeline->reportPosition();
+        return FALSE;
+    }
+
+    pipeline->m_lastPosition = pos;
+    return TRUE;
+}
+
+void Pipeline::reportPosition() throw() {
+    GstFormat fmt = GST_FORMAT_TIME;
+    // nanoseconds:
+    gint64 pos, len;
+
+    if (gst_element_query_position (m_pipeline, &fmt, &pos)
+            && gst_element_query_duration (m_pipeline, &fmt, &len)) {
+        firePositionChanged(pos, len);
+    }    
+}
+
+void Pipeline::removeSource(guint& tag) {
+    // Tag must be > 0, or else we'll get some assertion errors from glib.
+    if (tag > 0) {
+        g_source_remove(tag);
+        tag = 0;
+    }
+}
+
+void Pipeline::setPositionInterval(unsigned int ms) throw() {
+    if (ms == m_intervalMs) {
+        return;
+    }
+    m_intervalMs = ms;
+
+    // restart it with the new interval, if it's running (or should be).
+    if (m_reporting) {
+        unregisterInterval();
+        registerInterval();
+    }
+}
+
+unsigned int Pipeline::getPositionInterval() const throw() {
+    return m_intervalMs;
+}
+
+void Pipeline::requestPosition() throw() {
+    if (m_idleTag == 0) {
+        m_idleTag = g_idle_add(onPositionRequest, this);
+    }
+}
+
 void Pipeline::registerInterval() {
     // ensure that a pipeline is set by the subclass:
     wxASSERT(m_pipeline != NULL);
 
+    // already registered (play() without a pause() in between), or nobody
+    // is interested.
+    if (m_intervalTag > 0 || m_intervalMs == 0) {
+        return;
+    }
+
     // This comes from GObject. We add a timeout to query the current position
-    // every second. Use m_pipeline from the class Pipeline as the callback
-    // data. The timeout tag can be used later on to disable/destroy the
-    // callback.
-    m_intervalTag = g_timeout_add(1000, (GSourceFunc) onInterval, this);
+    // every m_intervalMs. Use m_pipeline from the class Pipeline as the
+    // callback data. The timeout tag can be used later on to disable/destroy
+    // the callback.
+    m_intervalTag = g_timeout_add(m_intervalMs, (GSourceFunc) onInterval, this);
+
+}
+
+void Pipeline::unregisterInterval() {
+    removeSource(m_intervalTag);
+}
 
+void Pipeline::discardNotifications() throw() {
+    // messages of the previous location which weren't dispatched yet.
+    gst_bus_set_flushing(m_bus, TRUE);
+    gst_bus_set_flushing(m_bus, FALSE);
+
+    // we're the consumer, so popping is fine.
+    PipelineNotification n;
+    while (m_notifications.pop(n)) {
+    }
+    g_atomic_int_set(&m_endPending, 0);
+
+    {
+        wxMutexLocker lock(m_nextMutex);
+        m_nextUri.clear();
+        m_switchUri.clear();
+    }
+    removeSource(m_switchTag);
+    removeSource(m_idleTag);
+    m_lastPosition = -1;
+    m_stalled = false;
+    m_filled = false;
+
+    // a wake up may be pending, which the handler is going to ignore.
+    rearmNotify();
+}
+
+void Pipeline::addBusWatch() {
+    m_busWatchTag = gst_bus_add_watch(m_bus, Pipeline::busWatcher, this);
 }
 
 gboolean Pipeline::busWatcher(GstBus* bus, GstMessage* message, gpointer userdata) {
@@ -184,8 +429,7 @@ gboolean Pipeline::busWatcher(GstBus* bus, GstMessage* message, gpointer userdat
         gst_message_parse_error (message, &error, &debug);
         g_free (debug);
 
-        wxString err = wxString::FromAscii(error->message);
-        pipeline->fireError(err);
+        pipeline->fireError(error->message);
 
         g_error_free (error);
     } else if (type == GST_MESSAGE_TAG) {
@@ -193,13 +437,44 @@ gboolean Pipeline::busWatcher(GstBus* bus, GstMessage* message, gpointer userdat
         gst_message_parse_tag (message, &tags);
         gst_tag_list_foreach(tags, handleTags, userdata);
         gst_tag_list_free (tags);
+    } else if (type == GST_MESSAGE_APPLICATION) {
+        const GstStructure* s = gst_message_get_structure(message);
+        if (gst_structure_has_name(s, "navi-about-to-finish") && pipeline->m_switchTag == 0) {
+            // the old track still has to play its last bit; watch closely
+            // for the position to start over, then stop watching.
+            pipeline->m_lastPosition = -1;
+            pipeline->m_switchTag = g_timeout_add(SWITCH_POLL_INTERVAL, onSwitchPoll, pipeline);
+        }
     } else if (type == GST_MESSAGE_BUFFERING) {
-        //std::cout << "Everybody's bufferin'" << std::endl;
+        gint percent = 100;
+        gst_message_parse_buffering(message, &percent);
+        pipeline->handleBuffering(percent);
     }
   
     return true;
 }
 
+void Pipeline::handleBuffering(int percent) throw() {
+    if (!m_stalled && m_reporting && percent < LOW_WATERMARK) {
+        // ran dry while playing (or hasn't been filled yet): stop the clock
+        // instead of stuttering along.
+        m_stalled = true;
+        gst_element_set_state(m_pipeline, GST_STATE_PAUSED);
+    } else if (m_stalled && percent >= HIGH_WATERMARK) {
+        m_stalled = false;
+        // unless it was paused (or stopped) in the meantime.
+        if (m_reporting) {
+            gst_element_set_state(m_pipeline, GST_STATE_PLAYING);
+        }
+    }
+    if (percent >= HIGH_WATERMARK) {
+        // also when it was filled while prerolling, before play().
+        m_filled = true;
+    }
+
+    fireBuffering(percent);
+}
+
 void Pipeline::handleTags(const GstTagList* list, const gchar* tag, gpointer userdata) {
     Pipeline* pipeline = static_cast<Pipeline*>(userdata);
 
@@ -213,6 +488,8 @@ void Pipeline::handleTags(const GstTagList* list, const gchar* tag, gpointer use
     guint trackNum;
     guint discNum;
     GDate* date;
+    // numbers are formatted in here, so no strings are allocated.
+    char number[16];
 
 #ifdef DEBUG
     gchar* misc;
@@ -225,64 +502,71 @@ void Pipeline::handleTags(const GstTagList* list, const gchar* tag, gpointer use
     // to string, then fire event. If it's a date, convert to string, then fire event...
 
     if (gst_tag_list_get_string(list, TrackInfo::TITLE, &title)) {
-        pipeline->fireTagRead(TrackInfo::TITLE, wxString(title, wxConvUTF8));
+        pipeline->fireTagRead(TrackInfo::TITLE, title);
         g_free(title);
     }
     if (gst_tag_list_get_string(list, TrackInfo::ARTIST, &artist)) {
-        pipeline->fireTagRead(TrackInfo::ARTIST, wxString(artist, wxConvUTF8));
+        pipeline->fireTagRead(TrackInfo::ARTIST, artist);
         g_free(artist);
     }
     if (gst_tag_list_get_string(list, TrackInfo::ALBUM, &album)) {
-        pipeline->fireTagRead(TrackInfo::ALBUM, wxString(album, wxConvUTF8));
+        pipeline->fireTagRead(TrackInfo::ALBUM, album);
         g_free(album);
     }
     if (gst_tag_list_get_string(list, TrackInfo::GENRE, &genre)) {
-        pipeline->fireTagRead(TrackInfo::GENRE, wxString(genre, wxConvUTF8));
+        pipeline->fireTagRead(TrackInfo::GENRE, genre);
         g_free(genre);
     }
     if (gst_tag_list_get_string(list, TrackInfo::COMMENT, &comment)) {
-        pipeline->fireTagRead(TrackInfo::COMMENT, wxString(comment, wxConvUTF8));
+        pipeline->fireTagRead(TrackInfo::COMMENT, comment);
         g_free(comment);
     }
     if (gst_tag_list_get_string(list, TrackInfo::COMPOSER, &composer)) {
-        pipeline->fireTagRead(TrackInfo::COMPOSER, wxString(composer, wxConvUTF8));
+        pipeline->fireTagRead(TrackInfo::COMPOSER, composer);
         g_free(composer);
     }
     if (gst_tag_list_get_uint(list, TrackInfo::TRACK_NUMBER, &trackNum)) {
-        pipeline->fireTagRead(TrackInfo::TRACK_NUMBER, wxString::Format(wxT("%i"), trackNum));
+        snprintf(number, sizeof(number), "%u", trackNum);
+        pipeline->fireTagRead(TrackInfo::TRACK_NUMBER, number);
     }
     if (gst_tag_list_get_uint(list, TrackInfo::DISC_NUMBER, &discNum)) {
-        pipeline->fireTagRead(TrackInfo::DISC_NUMBER, wxString::Format(wxT("%i"), discNum));
+        snprintf(number, sizeof(number), "%u", discNum);
+        pipeline->fireTagRead(TrackInfo::DISC_NUMBER, number);
     }
     if (gst_tag_list_get_date(list, TrackInfo::DATE, &date)) {
         // XXX: date also contains month and day.. Include  this, or just year?
         unsigned int ddate = g_date_get_year(date);
-        pipeline->fireTagRead(TrackInfo::DISC_NUMBER, wxString::Format(wxT("%i"), ddate));
+        snprintf(number, sizeof(number), "%u", ddate);
+        pipeline->fireTagRead(TrackInfo::DISC_NUMBER, number);
         g_date_free(date);
     }
 }
 
 void Pipeline::play() throw() {
-    gst_element_set_state(m_pipeline, GST_STATE_PLAYING);
+    // when refilling, handleBuffering() starts playing.
+    if (!m_stalled) {
+        gst_element_set_state(m_pipeline, GST_STATE_PLAYING);
+    }
 
+    m_reporting = true;
     registerInterval();
 }
 
 void Pipeline::pause() throw() {
     gst_element_set_state(m_pipeline, GST_STATE_PAUSED);
 
-    // we dont need to get notified of the pipeline's progress every .5 seconds
+    // we dont need to get notified of the pipeline's progress every second
     // if we are paused.
-    if(m_intervalTag > 0) {
-        g_source_remove(m_intervalTag);
-    }
-
+    m_reporting = false;
+    unregisterInterval();
 }
 
 void Pipeline::stop() throw() {
     // pause first (i.e. stop playback), which will implicitly also stop the
     // interval callback.
     pause();
+    m_stalled = false;
+    m_filled = false;
     // then 'seek' to the start of the file.
     gboolean seekSuccess = gst_element_seek (m_pipeline, 1.0, 
         GST_FORMAT_TIME, GST_SEEK_FLAG_FLUSH,
@@ -346,12 +630,25 @@ int Pipeline::getDurationSeconds() throw(AudioException) {
     return len / GST_SECOND;
 }
 
+int Pipeline::queryDurationSeconds() throw() {
+    GstFormat fmt = GST_FORMAT_TIME;
+    gint64 len;
+    if (!gst_element_query_duration(m_pipeline, &fmt, &len) || len < 0) {
+        return -1;
+    }
+
+    return len / GST_SECOND;
+}
+
 void Pipeline::setVolume(unsigned short percentage) throw() {
 }
 
 //==============================================================================
 
-GenericPipeline::GenericPipeline(const wxString& location) throw (AudioException) {
+GenericPipeline::GenericPipeline(const wxString& location, unsigned int bufferKilobytes,
+        unsigned int bufferSeconds) throw (AudioException) :
+        m_bufferKilobytes(bufferKilobytes),
+        m_bufferSeconds(bufferSeconds) {
     m_location = location;
 
     try {
@@ -376,10 +673,13 @@ void GenericPipeline::init() throw (AudioException) {
     // Add a watch to this bus (get notified of events using callbacks).
     // See http://www.parashift.com/c++-faq-lite/pointers-to-members.html, section
     // 33.2 for more details why it's done like this.
-    gst_bus_add_watch (m_bus, Pipeline::busWatcher, this);
+    addBusWatch();
 
     gst_bin_add(GST_BIN(m_pipeline), m_playbin);
 
+    // continue with the next location without a gap, see setNextLocation().
+    g_signal_connect(m_playbin, "about-to-finish", G_CALLBACK(Pipeline::onAboutToFinish), this);
+
     // set the "location" property on the filesrc element.
     std::string s = std::string(m_location.mb_str());
     g_object_set(G_OBJECT(m_playbin), "uri", s.c_str(), NULL);
@@ -406,6 +706,9 @@ void GenericPipeline::init() throw (AudioException) {
     unsigned short render = audio | softvol;
     g_object_set(G_OBJECT(m_playbin), "flags", render, NULL);
 
+    // before prerolling, which creates the buffer of a network stream.
+    setBuffering(m_bufferKilobytes, m_bufferSeconds);
+
     // We set the state of the element as paused, so we can succesfully query
     // duration and other stuff. If the state is still not PAUSED or PLAYING, 
     // fetching the duration has no (real and useful) effect. It may return random
@@ -418,6 +721,40 @@ void GenericPipeline::setVolume(unsigned short percentage) throw() {
     g_object_set(G_OBJECT(m_playbin), "volume", (percentage / 100.0), NULL);
 }
 
+void GenericPipeline::setLocation(const wxString& location) throw (AudioException) {
+    unregisterInterval();
+
+    // Unlike NULL, READY keeps the sink (and the audio device) open.
+    if (gst_element_set_state(m_pipeline, GST_STATE_READY) == GST_STATE_CHANGE_FAILURE) {
+        throw AudioException(wxT("Failed to stop the pipeline"));
+    }
+    discardNotifications();
+
+    m_location = location;
+    std::string s = std::string(m_location.mb_str());
+    g_object_set(G_OBJECT(m_playbin), "uri", s.c_str(), NULL);
+
+    // preroll, like init() does.
+    pause();
+}
+
+void GenericPipeline::setBuffering(unsigned int kilobytes, unsigned int seconds) throw() {
+    m_bufferKilobytes = kilobytes;
+    m_bufferSeconds = seconds;
+
+    // -1 is the default of the playbin for both.
+    gint size = kilobytes > 0 ? static_cast<gint>(kilobytes * 1024) : -1;
+    gint64 duration = seconds > 0 ? static_cast<gint64>(seconds) * GST_SECOND : -1;
+    g_object_set(G_OBJECT(m_playbin), "buffer-size", size, "buffer-duration", duration, NULL);
+}
+
+void GenericPipeline::setAudioSink(GstElement* sink) throw() {
+    // the sink can only be swapped while the playbin is not running.
+    gst_element_set_state(m_pipeline, GST_STATE_NULL);
+    g_object_set(G_OBJECT(m_playbin), "audio-sink", sink, NULL);
+    pause();
+}
+
 //================================================================================
 
 
@@ -433,11 +770,69 @@ const char* TrackInfo::DISC_NUMBER = GST_TAG_ALBUM_VOLUME_NUMBER;
 const char* TrackInfo::DATE = GST_TAG_DATE;
 
 TrackInfo::TrackInfo() :
-    m_durationSeconds(-1) {
+    m_durationSeconds(-1),
+    m_durationExact(false) {
+}
+
+int TrackInfo::slotOf(const char* key) throw() {
+    static const char** keys[TAG_COUNT] = {
+        &TITLE, &ARTIST, &ALBUM, &GENRE, &COMMENT, &COMPOSER,
+        &TRACK_NUMBER, &DISC_NUMBER, &DATE
+    };
+
+    // Everybody uses the static consts, so comparing pointers almost always
+    // does the trick. Fall back to comparing the strings themselves.
+    for (int i = 0; i < TAG_COUNT; i++) {
+        if (*keys[i] == key) {
+            return i;
+        }
+    }
+    for (int i = 0; i < TAG_COUNT; i++) {
+        if (strcmp(*keys[i], key) == 0) {
+            return i;
+        }
+    }
+
+    return TAG_COUNT;
 }
 
 wxString& TrackInfo::operator[](const char* key) {
-    return m_tags[key];
+    int slot = slotOf(key);
+    if (slot != TAG_COUNT) {
+        return m_slots[slot];
+    }
+
+    for (size_t i = 0; i < m_extraTags.size(); i++) {
+        if (strcmp(m_extraTags[i].first, key) == 0) {
+            return m_extraTags[i].second;
+        }
+    }
+    m_extraTags.push_back(std::make_pair(key, wxString()));
+    return m_extraTags.back().second;
+}
+
+const wxString& TrackInfo::get(const char* key) const throw() {
+    int slot = slotOf(key);
+    if (slot != TAG_COUNT) {
+        return m_slots[slot];
+    }
+
+    for (size_t i = 0; i < m_extraTags.size(); i++) {
+        if (strcmp(m_extraTags[i].first, key) == 0) {
+            return m_extraTags[i].second;
+        }
+    }
+
+    static const wxString empty;
+    return empty;
+}
+
+const wxString& TrackInfo::get(Tag tag) const throw() {
+    return m_slots[tag];
+}
+
+void TrackInfo::set(Tag tag, const wxString& value) {
+    m_slots[tag] = value;
 }
 
 
@@ -453,15 +848,20 @@ int TrackInfo::getDurationSeconds() const throw() {
     return m_durationSeconds;
 }
 
-void TrackInfo::setDurationSeconds(int durrrr) throw() {
+void TrackInfo::setDurationSeconds(int durrrr, bool exact) throw() {
     m_durationSeconds = durrrr;
+    m_durationExact = exact;
+}
+
+bool TrackInfo::isDurationExact() const throw() {
+    return m_durationExact;
 }
 
 bool TrackInfo::isValid() const {
     return !m_location.IsEmpty();
 }
 
-const wxString TrackInfo::getSimpleName() throw() {
+const wxString TrackInfo::getSimpleName() const throw() {
     wxURI theuri(m_location);
     const wxString path = theuri.Unescape(theuri.GetPath());
     int lastindexofslash = path.Find('/', true);
@@ -479,13 +879,19 @@ const wxString TrackInfo::getSimpleName() throw() {
 //==============================================================================
 
 
-TagReader::TagReader(const wxString& location) throw(AudioException) {
-    m_location = location;
-    try {
-        init();
-    } catch (const AudioException& ex) {
-        throw;
-    }
+TagReader::TagReader() throw(AudioException) :
+        m_uridecodebin(NULL),
+        m_fakesink(NULL),
+        m_readCount(0) {
+    init();
+}
+
+TagReader::TagReader(const wxString& location) throw(AudioException) :
+        m_uridecodebin(NULL),
+        m_fakesink(NULL),
+        m_readCount(0) {
+    init();
+    read(location);
 }
 
 TagReader::~TagReader() {
@@ -586,12 +992,6 @@ void TagReader::initTags() throw(AudioException) {
     // called quite a lot of times. We need to only set the location once, and
     // not 18 times in a row. Saves a few nanoseconds :p
     m_trackInfo.setLocation(getLocation());
-    try {
-        // try to fetch the duration by querying the pipeline.
-        m_trackInfo.setDurationSeconds(getDurationSeconds());
-    } catch(const AudioException& ex) {
-        std::cerr << "Failed to get the track duration!" << std::endl;
-    }
 
     GstMessage* msg = NULL;
     // XXX: making using of while(true) sounds dangerous...?
@@ -607,9 +1007,15 @@ void TagReader::initTags() throw(AudioException) {
 
         msg = gst_bus_timed_pop_filtered (
             GST_ELEMENT_BUS (m_pipeline),
-            GST_CLOCK_TIME_NONE,
+            READ_TIMEOUT * GST_SECOND,
             fuEnumForBitFields);
 
+        if (msg == NULL) {
+            // The pipeline is stuck somewhere. Whoever owns this reader must
+            // not reuse it (see TagReaderPool::discard()).
+            throw AudioException(wxT("Timed out reading tags of ") + m_location);
+        }
+
         // error or async_done...
         if (GST_MESSAGE_TYPE (msg) != GST_MESSAGE_TAG) {
             break;
@@ -643,6 +1049,16 @@ void TagReader::initTags() throw(AudioException) {
 
     // if message type wasn't error, also unref the msg pointar lulz.
     gst_message_unref(msg);
+
+    // ASYNC_DONE means the pipeline has prerolled, so the duration can be
+    // queried without waiting for the state change. For some formats (VBR
+    // MP3 without a Xing header) it's an estimate, so it's marked as such.
+    int duration = queryDurationSeconds();
+    if (duration >= 0) {
+        m_trackInfo.setDurationSeconds(duration, false);
+    } else {
+        std::cerr << "Failed to get the track duration!" << std::endl;
+    }
 }
 
 void TagReader::init() throw (AudioException) {
@@ -664,6 +1080,23 @@ void TagReader::init() throw (AudioException) {
     gst_bin_add_many(GST_BIN(m_pipeline), m_uridecodebin, m_fakesink, NULL);
 
     g_signal_connect (m_uridecodebin, "pad-added", G_CALLBACK (onPadAdded), m_fakesink);
+}
+
+void TagReader::read(const wxString& location) throw (AudioException) {
+    // Back to NULL, which makes the uridecodebin drop the decoders (and the
+    // pads) of the previous file. Throw away whatever the previous file left
+    // on the bus, so it isn't mistaken for a message about this one.
+    gst_element_set_state(m_pipeline, GST_STATE_NULL);
+    GstBus* bus = gst_element_get_bus(m_pipeline);
+    GstMessage* msg;
+    while ((msg = gst_bus_pop(bus)) != NULL) {
+        gst_message_unref(msg);
+    }
+    gst_object_unref(bus);
+
+    m_location = location;
+    m_trackInfo = TrackInfo();
+    m_readCount++;
 
     // set the uri on the uridecodebin element:
     std::string s = std::string(m_location.mb_str());
@@ -674,6 +1107,10 @@ void TagReader::init() throw (AudioException) {
     initTags();
 }
 
+unsigned int TagReader::getReadCount() const throw() {
+    return m_readCount;
+}
+
 void TagReader::setTrackInfo(const TrackInfo& trackinfo) {
     m_trackInfo = trackinfo;
 }
@@ -682,4 +1119,53 @@ TrackInfo& TagReader::getTrackInfo() {
     return m_trackInfo;
 }
 
+//==============================================================================
+
+TagReaderPool* TagReaderPool::s_instance = NULL;
+
+wxMutex TagReaderPool::s_instanceMutex;
+
+TagReaderPool::TagReaderPool() {
+}
+
+TagReaderPool& TagReaderPool::get() {
+    // NaviMainFrame::initDeferred() makes the first call on the main thread,
+    // but only once the window is on screen.
+    wxMutexLocker lock(s_instanceMutex);
+    if (s_instance == NULL) {
+        s_instance = new TagReaderPool;
+    }
+    return *s_instance;
+}
+
+TagReader* TagReaderPool::acquire() throw(AudioException) {
+    {
+        wxMutexLocker lock(m_mutex);
+        if (!m_idle.empty()) {
+            TagReader* reader = m_idle.back();
+            m_idle.pop_back();
+            return reader;
+        }
+    }
+
+    // creating the pipeline is the slow part, don't hold the lock for it.
+    return new TagReader;
+}
+
+void TagReaderPool::release(TagReader* reader) throw() {
+    if (reader->getReadCount() < MAX_READS) {
+        wxMutexLocker lock(m_mutex);
+        if (m_idle.size() < MAX_IDLE) {
+            m_idle.push_back(reader);
+            return;
+        }
+    }
+
+    delete reader;
+}
+
+void TagReaderPool::discard(TagReader* reader) throw() {
+    delete reader;
+}
+
 } // namespace pl
@@ -20,8 +20,9 @@
 #ifndef AUDIO_HPP 
 #define AUDIO_HPP 
 
-#include <map>
+#include <utility> // for pair
 #include <vector>
+#include <string>
 #include <sstream>
 
 #include <wx/wx.h>
@@ -33,24 +34,6 @@
 namespace navi {
 
 
-// Forward declarations:
-class Pipeline; // for PipelineListener.
-
-//================================================================================
-
-/**
- * I ran into problems with the callback functions from the PipelineListeners.
- * As soon as the stream automatically stopped (due to a gst bus watcher), I would
- * iterate through all the stream listeners. However, I also deleted the Pipeline
- * which (triggered the events in the first place) in another thread. Thus, while
- * iterating through the vector's contents, `this' was already destroyed! Leading
- * to segfaults galore. I checked upon mutexes in wxWidgets, and this lock object
- * seems to work alright. Before delete-ing the Pipeline*, lock it, then unlock it.
- */
-static wxMutex s_pipelineListenerMutex;
-
-//================================================================================
-
 /**
  * Base exception for audio failures, errors, exceptions. These include things
  * like failing to create a GstElement*, failure at playback, etc.
@@ -94,22 +77,55 @@ public:
 /**
  * TrackInfo is a simple class for holding data of a track. It does not provide
  * pipeline capabilities like the TagReader. This class encapsulates a location
- * (file) and an std::map containing the information of a track. This data used
+ * (file) and the tags of a track. The known tags (see the Tag enum) each have a
+ * fixed slot, any other tag goes into a small overflow list. This data used
  * to be residing inside TagReader, but like this it's more lightweight and can
  * be used in user interfaces as well. For instance, when lots of files have to
  * be tag-parsed, and displayed. I will not 'risk' adding lots of GST elements 
  * to user interface widgets.
  */
 class TrackInfo : public wxClientData {
+public:
+    /// Slots of the known tags. The order is used by the TagCache file format
+    /// too, so only append to it.
+    enum Tag {
+        TAG_TITLE,
+        TAG_ARTIST,
+        TAG_ALBUM,
+        TAG_GENRE,
+        TAG_COMMENT,
+        TAG_COMPOSER,
+        TAG_TRACK_NUMBER,
+        TAG_DISC_NUMBER,
+        TAG_DATE,
+        /// The amount of known tags, not a tag itself.
+        TAG_COUNT
+    };
+
 private:
-    /// Map with tag and value mapping.
-    std::map<const char*, wxString> m_tags;
+    /// The values of the known tags, indexed by Tag.
+    wxString m_slots[TAG_COUNT];
+
+    /// Any other tag. Rarely used, so a plain vector will do.
+    std::vector<std::pair<const char*, wxString> > m_extraTags;
 
     /// Location of the track on HD
     wxString m_location;
 
     int m_durationSeconds;
 
+    /// Whether m_durationSeconds was computed exactly (e.g. from a sample
+    /// count), or estimated (e.g. from the bitrate of the first MP3 frame).
+    bool m_durationExact;
+
+    /**
+     * Finds the slot of a tag key.
+     *
+     * @param key One of the static consts below (or an equal string).
+     * @return The Tag, or TAG_COUNT when the key has no slot.
+     */
+    static int slotOf(const char* key) throw();
+
 public:
     /// Title of the stream (GST_TAG_TITLE)
     static const char* TITLE;
@@ -146,11 +162,36 @@ public:
 
     /**
      * Allows us to get and set tags using tag[TAG_XYZ] and tag[TAG_XYZ] = "lol".
+     * An unknown key is added to the overflow list, so prefer get() for reading.
      *
      * @param key The key get or set.
      */
     wxString& operator[](const char* key);
 
+    /**
+     * Gets the value of a tag without modifying anything. Unknown or unset tags
+     * return an empty string.
+     *
+     * @param key The key to get.
+     */
+    const wxString& get(const char* key) const throw();
+
+    /**
+     * Gets the value of a known tag. This is just an array lookup, so use this
+     * one in hot paths like sorting and rendering.
+     *
+     * @param tag The tag to get.
+     */
+    const wxString& get(Tag tag) const throw();
+
+    /**
+     * Sets the value of a known tag.
+     *
+     * @param tag The tag to set.
+     * @param value The new value.
+     */
+    void set(Tag tag, const wxString& value);
+
     /**
      * Sets location of this track.
      */
@@ -172,8 +213,16 @@ public:
      * Sets the duration of the track in seconds.
      *
      * @param durationSeconds the num of seconds.
+     * @param exact true when the duration was computed from the headers (like
+     *  a sample or frame count), false when it's an estimate.
+     */
+    void setDurationSeconds(int durationSeconds, bool exact = false) throw();
+
+    /**
+     * Whether the duration is exact, or just an estimate (which is displayed
+     * with a `~' in front of it).
      */
-    void setDurationSeconds(int durationSeconds) throw();
+    bool isDurationExact() const throw();
 
     /**
      * Returns true if the TrackInfo is `valid'. This means it can be played
@@ -197,7 +246,7 @@ public:
      *
      * @return The 'simple' filename of the URI.
      */
-    const wxString getSimpleName() throw();
+    const wxString getSimpleName() const throw();
 
 
 };
@@ -206,51 +255,101 @@ public:
 
 //================================================================================
 
-class PipelineListener {
-public:
-    PipelineListener();
-/*
-    void onPlay(Pipeline* pipeline);
-    void onPause(Pipeline* pipeline);
-    void onStop(Pipeline* pipeline);
-*/
+/**
+ * A notification from a Pipeline for the user interface: a tag which was read,
+ * the playback position, an error or the end of the stream. It has a fixed
+ * size, so queuing one never allocates memory.
+ */
+struct PipelineNotification {
+    enum Kind {
+        /// A tag was read. tagType and value are set.
+        NOTIFY_TAG,
+
+        /// The position changed. position and length are set, in seconds.
+        NOTIFY_POSITION,
+
+        /// An error occured. value holds the message.
+        NOTIFY_ERROR,
+
+        /// The end of the stream was reached.
+        NOTIFY_END,
+
+        /// The location queued with Pipeline::setNextLocation() started
+        /// playing, without a gap. value holds its URI.
+        NOTIFY_TRACK_CHANGED,
+
+        /// The fill of the network buffer changed. position holds the
+        /// percentage, length is 1 while playback is paused because the
+        /// buffer ran dry after it had been filled (a stall), 0 otherwise,
+        /// also while it's filled for the first time.
+        NOTIFY_BUFFERING
+    };
+
+    /// Size of the value buffer. Longer values are truncated.
+    static const size_t VALUE_SIZE = 256;
+
+    Kind kind;
+
+    /// One of the TrackInfo static consts.
+    const char* tagType;
+
+    /// Tag value or error message, UTF-8 and NUL terminated.
+    char value[VALUE_SIZE];
+
+    unsigned int position;
+    unsigned int length;
 
     /**
-     * When a pipeline has read a tag, this function will be invoked. This function
-     * is ideal for polling tags from a livestream.
-     *
-     * @param pipeline The pipeline object pointer
-     * @param type The type, one of the static members of TrackInfo.
-     * @param value The value of the given type.
+     * Copies a UTF-8 string to value, truncating it at a character boundary
+     * when it doesn't fit.
      */
-    virtual void pipelineTagRead(Pipeline* const pipeline, const char* type, const wxString& value) throw() = 0;
+    void setValue(const char* utf8) throw();
+};
+
+//================================================================================
+
+/**
+ * A preallocated ring of PipelineNotifications, with exactly one producer (the
+ * GLib main context running the bus watch and position interval of a Pipeline)
+ * and one consumer (the TrackStatusHandler, on the wx main thread). The indices
+ * are only ever written by one side each, so no lock is needed.
+ */
+class NotificationQueue {
+private:
+    /// Amount of slots. One is kept free to tell a full ring from an empty one.
+    static const gint CAPACITY = 64;
+
+    PipelineNotification m_slots[CAPACITY];
+
+    /// Next slot to read. Written by the consumer only.
+    volatile gint m_head;
+
+    /// Next slot to write. Written by the producer only.
+    volatile gint m_tail;
+
+public:
+    NotificationQueue() throw();
 
     /**
-     * Invoked as a callback function when the pipeline encountered an 
-     * error, during playback, initialization or whatever.
+     * Producer side. Returns the slot to fill in, which is published by
+     * commit().
      *
-     * @param pipeline The pipeline which got errored. 
-     * @param message The error message as a wxString.
+     * @return The free slot, or NULL when the ring is full.
      */
-    virtual void pipelineError(Pipeline* const pipeline, const wxString& message) throw() = 0;
+    PipelineNotification* reserve() throw();
 
     /**
-     * Callback function invoked when the pipeline has reached its EOS, end of
-     * stream.
-     *
-     * @param pipeline The pipeline point0r.
+     * Producer side. Publishes the slot returned by reserve().
      */
-    virtual void pipelineStreamEnd(Pipeline* const pipeline) throw() = 0;
+    void commit() throw();
 
     /**
-     * Callback to inform a position change. The position and length are
-     * measured in SECONDS!
+     * Consumer side. Takes the oldest notification off the ring.
      *
-     * @param pipeline The pipeline in which the position changed.
-     * @param position The current position of the pipeline.
-     * @param length The length of the stream/pipeline.
+     * @param out Receives the notification.
+     * @return false when the ring is empty.
      */
-    virtual void pipelinePosChanged(Pipeline* const pipeline, unsigned int position, unsigned int length) throw() = 0;
+    bool pop(PipelineNotification& out) throw();
 };
 
 //================================================================================
@@ -261,14 +360,100 @@ public:
  */
 class Pipeline {
 private:
-    gint m_intervalTag;
+    guint m_intervalTag;
+
+    /// Source id of the bus watch, 0 if there is none.
+    guint m_busWatchTag;
+
+    /// Notifications for the user interface.
+    NotificationQueue m_notifications;
+
+    /// 1 while a wake up event is on its way to the notify handler.
+    volatile gint m_wakePending;
+
+    /// 1 when the end of stream has been reached, but not yet popped. It's
+    /// kept out of the ring, so it can't be lost when the ring is full.
+    volatile gint m_endPending;
+
+    /// Handler to post the wake up events to, or NULL.
+    wxEvtHandler* m_notifyHandler;
+
+    /// Set on the wake up events, see setNotifyHandler().
+    long m_notifyEpoch;
+
+    /// Guards m_nextUri and m_switchUri, which are used by the streaming
+    /// thread emitting about-to-finish.
+    wxMutex m_nextMutex;
+
+    /// URI to continue with when the current one is about to finish, empty
+    /// to stop at the end of the stream.
+    std::string m_nextUri;
+
+    /// URI which was handed to the playbin at the last about-to-finish.
+    std::string m_switchUri;
+
+    /// Source id of the poll which runs from about-to-finish until the
+    /// position shows the next track has actually started, 0 if none.
+    guint m_switchTag;
+
+    /// Position at the previous switch poll in nanoseconds, -1 if unknown.
+    gint64 m_lastPosition;
+
+    /// Milliseconds between position notifications, 0 for none.
+    unsigned int m_intervalMs;
+
+    /// true between play() and pause(), when the interval should run.
+    bool m_reporting;
+
+    /// Source id of the pending requestPosition(), 0 if none.
+    guint m_idleTag;
+
+    /// true while playback is paused because the buffer ran low. It's
+    /// resumed when the buffer is filled to HIGH_WATERMARK again.
+    bool m_stalled;
+
+    /// true once the buffer of the current location was filled up to
+    /// HIGH_WATERMARK. Waiting before that is the initial fill, not a stall.
+    bool m_filled;
 
     static bool onInterval(Pipeline* pipeline);
 
-    std::vector<PipelineListener*> m_listeners;
+    /// The idle callback of requestPosition().
+    static gboolean onPositionRequest(gpointer userdata);
+
+    /**
+     * Polls the position after about-to-finish. Once it starts over, the
+     * next track is audible, and a track change is queued.
+     */
+    static gboolean onSwitchPoll(gpointer userdata);
+
+    /**
+     * Queries the position and duration, and queues them as a notification.
+     */
+    void reportPosition() throw();
+
+    /**
+     * Removes a GLib source, if the id isn't 0, and resets the id.
+     */
+    static void removeSource(guint& tag);
+
+    /**
+     * Posts a wake up event to the notify handler, unless one is pending
+     * already. Called by the producer after queuing a notification.
+     */
+    void wakeNotifyHandler() throw();
 
     static void handleTags(const GstTagList* list, const gchar* tag, gpointer userdata);
 
+    /**
+     * Handles a buffering message: pauses playback when the buffer drops
+     * below LOW_WATERMARK, and resumes it at HIGH_WATERMARK. Only streams
+     * from the network buffer, local files never do.
+     *
+     * @param percent How full the buffer is.
+     */
+    void handleBuffering(int percent) throw();
+
 protected:
     /// The location of the file or stream to play.
     wxString m_location;
@@ -293,35 +478,79 @@ protected:
      */
     static gboolean busWatcher(GstBus* bus, GstMessage* message, gpointer userdata);
 
+    /**
+     * Adds busWatcher() as the watch of m_bus. It's removed again by the
+     * destructor.
+     */
+    void addBusWatch();
+
     /**
      * Makes a pipeline register an interval to do periodic checks. This is
-     * used to initate callbacks.
+     * used to initate callbacks. Nothing happens if it's registered already,
+     * or the interval is 0 (see setPositionInterval()).
      */
     void registerInterval();
 
     /**
-     * Fires a pipelineTagRead callback to all registered listeners.
+     * Removes the interval registered by registerInterval(), if any.
+     */
+    void unregisterInterval();
+
+    /**
+     * Throws away everything queued for the notify handler, and the messages
+     * still on the bus, before the pipeline continues with another location.
+     * Must be called from the main thread, with the pipeline in READY or NULL.
+     */
+    void discardNotifications() throw();
+
+    /**
+     * Queues a tag notification.
      * @param type One of the TrackInfo static consts.
-     * @param value The value of the type.
+     * @param value The UTF-8 value of the type.
      */
-    void fireTagRead(const char* type, const wxString& value) throw();
+    void fireTagRead(const char* type, const char* value) throw();
 
     /**
-     * Fires a pipelineError callback to all registered listeners.
-     * @param error The error string.
+     * Queues an error notification.
+     * @param error The UTF-8 error string.
      */
-    void fireError(const wxString& error) throw();
+    void fireError(const char* error) throw();
 
     /**
-     * Fires a positionChanged callback to every listener available.
+     * Queues a position notification. Dropped when the ring is full, the
+     * next one will be along in a second.
      */
     void firePositionChanged(gint64 pos, gint64 len) throw();
 
     /**
-     * Fires a streamEnd callback to every listener available.
+     * Flags the end of the stream.
      */
     void fireStreamEnd() throw();
 
+    /**
+     * Queues a buffering notification. Dropped when the ring is full, like
+     * the position.
+     */
+    void fireBuffering(int percent) throw();
+
+    /**
+     * Queues a track change notification with m_switchUri.
+     *
+     * @return false when the ring is full, so it should be tried again.
+     */
+    bool fireTrackChanged() throw();
+
+    /**
+     * Callback for the about-to-finish signal of playbin2, emitted from a
+     * streaming thread when the current URI has been read completely. Setting
+     * the next URI right here makes the playbin continue with it without a
+     * gap. Subclasses with a playbin2 connect it in init().
+     *
+     * @param playbin The playbin2 element.
+     * @param userdata The Pipeline.
+     */
+    static void onAboutToFinish(GstElement* playbin, gpointer userdata);
+
     /**
      * Initialization for a pipeline. Pure virtual. Subclasses must override this
      * function.
@@ -346,6 +575,16 @@ public:
     /// Pipeline state playing (gst: the element is PLAYING, the GstClock is running and the data is flowing)
     static const short STATE_PLAYING = GST_STATE_PLAYING;
 
+    /// Milliseconds between position checks while a gapless switch to the
+    /// next location is pending. That only lasts for a second or two.
+    static const unsigned int SWITCH_POLL_INTERVAL = 100;
+
+    /// Playback pauses when the buffer drops below this percentage...
+    static const int LOW_WATERMARK = 10;
+
+    /// ... and continues when it's filled up to this one again.
+    static const int HIGH_WATERMARK = 100;
+
     /**
      * Constructs a pipeline.
      */
@@ -356,20 +595,71 @@ public:
      * pointer m_pipeline to NULL, and will 'unreference' the GstBus. After
      * that, the m_pipeline will be unreffed, which automatically unrefs the
      * pipeline members. Therefore, derived classes of Pipeline do not have to
-     * manually unref their own pipeline elements.
+     * manually unref their own pipeline elements. The bus watch and position
+     * interval are removed first, so nothing gets queued while tearing down.
      */
     virtual ~Pipeline();
 
     /**
-     * Adds a pipeline listener to this pipeline.
+     * Sets the handler which is woken up with a naviPipelineNotifyEvent when
+     * there are notifications to pop. At most one wake up is pending at a
+     * time, and it carries the epoch in its extra long. The handler must
+     * compare it with the epoch of the pipeline it currently owns, since the
+     * event may arrive after the pipeline which posted it has been deleted.
+     *
+     * @param handler The handler, living on the main thread.
+     * @param epoch Identifies this pipeline to the handler.
+     */
+    void setNotifyHandler(wxEvtHandler* handler, long epoch) throw();
+
+    /**
+     * Must be called by the notify handler when it's woken up, before popping
+     * the notifications. Notifications queued after this wake it up again.
+     */
+    void rearmNotify() throw();
+
+    /**
+     * Sets how often the position is queued as a notification while playing.
+     * The default is every second. There's no use in waking up for it while
+     * nobody's looking, so the main window turns it off when it's hidden.
      *
-     * @param listener The listener to add.
+     * @param ms Milliseconds between notifications, 0 for none at all.
      */
-    void addListener(PipelineListener* const listener) throw();
+    void setPositionInterval(unsigned int ms) throw();
+
+    /**
+     * Returns the milliseconds between position notifications, 0 for none.
+     */
+    unsigned int getPositionInterval() const throw();
+
+    /**
+     * Queues a position notification as soon as possible, for instance after
+     * seeking or when the main window is shown again. Requests made before the
+     * previous one was handled are merged.
+     */
+    void requestPosition() throw();
+
+    /**
+     * Sets the location to continue with once the current one ends, without
+     * a gap. A NOTIFY_TRACK_CHANGED notification tells when it has started.
+     * Only pipelines based on playbin2 support this; others just end.
+     *
+     * @param location The URI of the next track, or empty for none.
+     */
+    void setNextLocation(const wxString& location) throw();
+
+    /**
+     * Takes the oldest notification. Only to be called from the main thread.
+     *
+     * @param out Receives the notification.
+     * @return false when there are no more notifications.
+     */
+    bool popNotification(PipelineNotification& out) throw();
 
     /**
      * Plays the pipeline (GST_STATE_PLAYING). Declared virtual, so derived
-     * classes can implement their own way of playing the audio streams.
+     * classes can implement their own way of playing the audio streams. When
+     * the buffer is being refilled, playing starts once it's full enough.
      */
     virtual void play() throw();
 
@@ -421,6 +711,14 @@ public:
      */
     virtual int getDurationSeconds() throw(AudioException);
 
+    /**
+     * Queries the duration without waiting for the pipeline to change state
+     * first, so it should only be used on a prerolled pipeline.
+     *
+     * @return The duration in seconds, or -1 when it's not known.
+     */
+    int queryDurationSeconds() throw();
+
     /**
      * Sets the volume of this pipeline 
      *
@@ -448,6 +746,10 @@ private:
     /// Only one element needed: the playbin/playbin2 (0.10.30...) element.
     GstElement* m_playbin;
 
+    /// The buffer size and duration, see setBuffering().
+    unsigned int m_bufferKilobytes;
+    unsigned int m_bufferSeconds;
+
 protected:
     /**
      * Initializes the pipeline using the playbin Gst element.
@@ -457,13 +759,50 @@ protected:
 public:
     /**
      * Constructs a new pipeline using a URI.
+     *
+     * @param location The URI to play.
+     * @param bufferKilobytes The buffer size for network streams, see
+     *  setBuffering().
+     * @param bufferSeconds The buffer duration for network streams.
      */
-    GenericPipeline(const wxString& location) throw (AudioException);
+    GenericPipeline(const wxString& location, unsigned int bufferKilobytes = 0,
+        unsigned int bufferSeconds = 0) throw (AudioException);
     
     /**
      * Sets pipeline volume. Override from Pipeline.
      */
     void setVolume(unsigned short percentage) throw();
+
+    /**
+     * Sets how much of a network stream is buffered before playing it. The
+     * buffer is full when either limit is reached. Takes effect for the next
+     * location, see setLocation().
+     *
+     * @param kilobytes The size of the buffer, 0 for the default.
+     * @param seconds The duration of the buffer, 0 for the default.
+     */
+    void setBuffering(unsigned int kilobytes, unsigned int seconds) throw();
+
+    /**
+     * Replaces the audio output of the playbin (an autoaudiosink by default),
+     * for instance by a fakesink to measure what would be heard. The pipeline
+     * is prerolled again afterwards.
+     *
+     * @param sink The new sink. The playbin takes ownership.
+     */
+    void setAudioSink(GstElement* sink) throw();
+
+    /**
+     * Switches to another location, keeping the playbin, its bus watch and
+     * its (opened) audio sink, which is quite a bit faster than creating a
+     * new pipeline. Like the constructor, it leaves the pipeline paused.
+     * Everything queued for the notify handler is discarded; the handler
+     * should give it a new epoch too, see setNotifyHandler().
+     *
+     * @param location The URI to play.
+     * @throws AudioException when the playbin can't be stopped.
+     */
+    void setLocation(const wxString& location) throw (AudioException);
 };
 
 //================================================================================
@@ -486,6 +825,9 @@ private:
 
     /// The fake sink. We do not need output to read tags.
     GstElement* m_fakesink;
+
+    /// Amount of files read with this reader, see read().
+    unsigned int m_readCount;
     
     /**
      * This is necessary for tag reading, apparently. See the gstreamer documentation
@@ -518,20 +860,50 @@ private:
 
 protected:
     /**
-     * Initializes a default pipeline (filesrc and fakesink). Also declared virtual.
+     * Builds the pipeline (uridecodebin and fakesink), without a location.
+     * Also declared virtual.
      */
     virtual void init() throw (AudioException);
 
 public:
+    /// Maximum amount of seconds to wait for the pipeline to post a message,
+    /// so a broken file or a stalled network mount can't hang a scan.
+    static const int READ_TIMEOUT = 10;
+
+    /**
+     * Constructs a TagReader instance without reading anything yet. Use read()
+     * to read the tags of a location. This is what the TagReaderPool does.
+     *
+     * @throw AudioException when the pipeline could not be created.
+     */
+    TagReader() throw(AudioException);
+
     /**
-     * Constructs a TagReader instance. The location parameter should be
-     * a URI, in the form of file:///home/user/file.mp3 or the like.
+     * Constructs a TagReader instance, and reads the tags of the location
+     * right away. The location parameter should be a URI, in the form of
+     * file:///home/user/file.mp3 or the like.
      *
      * @param location The location URI to use
      * @throw AudioException when initializing failed (like the pipeline).
      */
     TagReader(const wxString& location) throw(AudioException);
 
+    /**
+     * Reads the tags of a location. The pipeline is set back to NULL and is
+     * pointed at the new URI, so the elements (and the plugin lookups) are
+     * reused. The results are available with getTrackInfo() afterwards.
+     *
+     * @param location The location URI to read.
+     * @throw AudioException when the pipeline posted an error. The reader
+     *  should not be reused in that case.
+     */
+    void read(const wxString& location) throw(AudioException);
+
+    /**
+     * Returns the amount of locations read with this reader.
+     */
+    unsigned int getReadCount() const throw();
+
     /**
      * Krush, Kill 'n Destroy.
      */
@@ -563,6 +935,75 @@ public:
 };
 
 
+//================================================================================
+
+/**
+ * Creating a TagReader pipeline means creating elements and looking up plugins,
+ * which takes longer than reading the tags of a small file. The TagReaderPool
+ * keeps readers around so they can be reused for the next file.
+ *
+ * A reader is taken with acquire(), and handed back with release() when it's
+ * done. Readers which failed are handed back with discard(), which deletes
+ * them: a pipeline which posted an error may be in any state. Readers are also
+ * replaced after MAX_READS reads, and at most MAX_IDLE readers are kept.
+ *
+ * There's one pool, retrieve it with TagReaderPool::get(). All functions can be
+ * called from any thread.
+ */
+class TagReaderPool {
+private:
+    /// The single instance.
+    static TagReaderPool* s_instance;
+
+    /// Guards the creation of s_instance.
+    static wxMutex s_instanceMutex;
+
+    /// Readers which are not in use.
+    std::vector<TagReader*> m_idle;
+
+    /// Guards m_idle.
+    wxMutex m_mutex;
+
+    /// Private constructor, use get().
+    TagReaderPool();
+
+public:
+    /// Maximum amount of idle readers kept in the pool.
+    static const size_t MAX_IDLE = 8;
+
+    /// Amount of reads after which a reader is replaced by a fresh one.
+    static const unsigned int MAX_READS = 500;
+
+    /**
+     * Returns the single TagReaderPool instance. It's created on the first
+     * call, which NaviMainFrame::initDeferred() makes, but any thread may be
+     * the first.
+     */
+    static TagReaderPool& get();
+
+    /**
+     * Takes an idle reader from the pool, or creates a new one.
+     *
+     * @return The reader, which must be handed back with release() or discard().
+     * @throw AudioException when a new reader could not be created.
+     */
+    TagReader* acquire() throw(AudioException);
+
+    /**
+     * Hands a reader back after a successful read, so it can be reused.
+     *
+     * @param reader The reader from acquire().
+     */
+    void release(TagReader* reader) throw();
+
+    /**
+     * Deletes a reader which failed.
+     *
+     * @param reader The reader from acquire().
+     */
+    void discard(TagReader* reader) throw();
+};
+
 } // namespace navi 
 
 #endif // AUDIO_HPP
@@ -0,0 +1,717 @@
+//      bench.cpp
+//
+//      Copyright 2012 Kevin Pors <krpors@users.sf.net>
+//
+//      This program is free software; you can redistribute it and/or modify
+//      it under the terms of the GNU General Public License as published by
+//      the Free Software Foundation; either version 2 of the License, or
+//      (at your option) any later version.
+//
+//      This program is distributed in the hope that it will be useful,
+//      but WITHOUT ANY WARRANTY; without even the implied warranty of
+//      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//      GNU General Public License for more details.
+//
+//      You should have received a copy of the GNU General Public License
+//      along with this program; if not, write to the Free Software
+//      Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+//      MA 02110-1301, USA.
+
+// Headless benchmark of the scanning code, built by `make bench'. It reads a
+// directory the same way the DirTraversalThread does (a TrackScanner, with the
+// TagCache, NativeTagReader and TagReader behind it), and prints the results as
+// a single line of JSON on stdout, so it can be collected and compared across
+// releases. Everything meant for humans goes to stderr.
+//
+// Usage: navi-bench [options] <directory>
+//        navi-bench --sort N
+//        navi-bench --search N
+//        navi-bench --library N
+//        navi-bench --gapless [--rebuild] <file> <file>...
+//        navi-bench --switch [--rebuild] <file> <file>...
+//
+//   --threads N   maximum amount of scanner threads (0 = one per processor)
+//   --recursive   read all subdirectories too, like the library mode
+//   --cache       use the tag cache (default is to bypass it, so the actual
+//                 readers are measured)
+//   --reader R    `scan' (default) uses the TrackScanner. `native' and `gst'
+//                 read every file serially with only that reader. `gst'
+//                 creates a pipeline per file, `gstpool' reuses one through
+//                 the TagReaderPool, which shows what the pool saves.
+//   --sort N      instead of scanning, sort N generated tracks like the
+//                 TrackTable does, and report the time and memory it takes.
+//   --search N    instead of scanning, put N generated tracks in a SearchIndex
+//                 (like the TrackTable does while a directory is read), and
+//                 report the time a few typical queries take.
+//   --library N   instead of scanning, write N generated tracks to a LibraryDb
+//                 (in the temp directory), and report how long writing,
+//                 opening and reading all tracks back (with their sort keys
+//                 and searchable texts) takes.
+//   --gapless     instead of scanning, play the files one after another
+//                 through a GenericPipeline, and report the silence between
+//                 them. The output goes to a fakesink synced to the clock, so
+//                 this takes as long as the files last. Use short ones.
+//   --switch      instead of scanning, start playing the files one after
+//                 another (on the default audio output), and report how long
+//                 each switch takes until the pipeline is PLAYING. The
+//                 pipeline is reused, like the TrackStatusHandler does.
+//   --rebuild     with --gapless, create a new pipeline for every file (like
+//                 pressing `next' used to) instead of queuing the next
+//                 location. With --switch, create a new pipeline for every
+//                 file instead of reusing it.
+
+#include "audio.hpp"
+#include "librarydb.hpp"
+#include "misc.hpp"
+#include "scanner.hpp"
+#include "search.hpp"
+#include "tagcache.hpp"
+#include "tagparser.hpp"
+
+#include <vector>
+#include <algorithm>
+#include <iostream>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include <sys/time.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+
+#include <wx/init.h>
+#include <wx/dir.h>
+#include <wx/filename.h>
+
+#include <gst/gst.h>
+
+using namespace navi;
+
+namespace {
+
+/// Returns a timestamp in microseconds.
+long long nowMicros() {
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec * 1000000LL + tv.tv_usec;
+}
+
+/// Returns the peak resident set size of the process, in kilobytes.
+long peakRssKb() {
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss;
+}
+
+/// Returns the current resident set size of the process, in kilobytes.
+long currentRssKb() {
+    long pages = 0;
+    FILE* f = fopen("/proc/self/statm", "r");
+    if (f != NULL) {
+        long size;
+        if (fscanf(f, "%ld %ld", &size, &pages) != 2) {
+            pages = 0;
+        }
+        fclose(f);
+    }
+    return pages * (sysconf(_SC_PAGESIZE) / 1024);
+}
+
+/// Returns the q-quantile (0..1) of the sorted times, in milliseconds.
+double percentileMs(const std::vector<long>& sorted, double q) {
+    if (sorted.empty()) {
+        return 0.0;
+    }
+    // nearest rank.
+    size_t rank = static_cast<size_t>(q * sorted.size() + 0.999999);
+    if (rank < 1) {
+        rank = 1;
+    }
+    if (rank > sorted.size()) {
+        rank = sorted.size();
+    }
+    return sorted[rank - 1] / 1000.0;
+}
+
+/**
+ * Finds the playable files the same way the DirTraversalThread does.
+ */
+class FileCollector : public wxDirTraverser {
+private:
+    wxArrayString& m_files;
+    bool m_recursive;
+public:
+    FileCollector(wxArrayString& files, bool recursive) :
+            m_files(files),
+            m_recursive(recursive) {
+    }
+
+    virtual wxDirTraverseResult OnFile(const wxString& filename) {
+        if (isPlayableFile(filename)) {
+            m_files.Add(filename);
+        }
+        return wxDIR_CONTINUE;
+    }
+
+    virtual wxDirTraverseResult OnDir(const wxString& dirname) {
+        return m_recursive ? wxDIR_CONTINUE : wxDIR_STOP;
+    }
+};
+
+/**
+ * Counts the delivered tracks, and throws them away.
+ */
+class CountingListener : public ScanListener {
+public:
+    size_t tracks;
+
+    CountingListener() : tracks(0) {}
+
+    virtual void trackScanned(size_t index, TrackInfo* info) throw() {
+        tracks++;
+        delete info;
+    }
+
+    virtual void scanStalled() throw() {
+    }
+};
+
+/**
+ * The comparison of TrackTable::compareTracks() for the artist column, on the
+ * precomputed sort keys (artist, then album, disc and track number).
+ */
+class ArtistComparator {
+private:
+    const std::vector<TrackSortKey>& m_keys;
+public:
+    ArtistComparator(const std::vector<TrackSortKey>& keys) : m_keys(keys) {}
+
+    bool operator()(long one, long two) const {
+        return TrackSortKey::compare(m_keys[one], m_keys[two], TrackSortKey::COLUMN_ARTIST) < 0;
+    }
+};
+
+/**
+ * Generates tracks: a few thousand artists with albums of twelve tracks, in a
+ * scrambled order so sorting has some work to do.
+ */
+void generateTracks(long count, std::vector<TrackInfo>& tracks) {
+    tracks.resize(count);
+    for (long i = 0; i < count; i++) {
+        long n = (i * 7919) % count;
+        TrackInfo& info = tracks[i];
+        info.setLocation(wxString::Format(wxT("file:///music/artist%ld/album%ld/%02ld.ogg"), n / 120, n / 12, n % 12 + 1));
+        info.set(TrackInfo::TAG_ARTIST, wxString::Format(wxT("Artist %ld"), n / 120));
+        info.set(TrackInfo::TAG_ALBUM, wxString::Format(wxT("Album %ld"), n / 12));
+        info.set(TrackInfo::TAG_TITLE, wxString::Format(wxT("Some title of track %ld"), n));
+        info.set(TrackInfo::TAG_TRACK_NUMBER, wxString::Format(wxT("%ld"), n % 12 + 1));
+        info.setDurationSeconds(180 + n % 120);
+    }
+}
+
+int benchSort(long count) {
+    long rssBefore = currentRssKb();
+    long long start = nowMicros();
+
+    std::vector<TrackInfo> tracks;
+    generateTracks(count, tracks);
+    long long built = nowMicros();
+    long rssTracks = currentRssKb();
+
+    // done once per track by the TrackTable, when the track is added.
+    std::vector<TrackSortKey> keys;
+    keys.reserve(count);
+    for (long i = 0; i < count; i++) {
+        keys.push_back(TrackSortKey(tracks[i]));
+    }
+    long long keyed = nowMicros();
+
+    std::vector<long> rows(count);
+    for (long i = 0; i < count; i++) {
+        rows[i] = i;
+    }
+    std::stable_sort(rows.begin(), rows.end(), ArtistComparator(keys));
+    long long sorted = nowMicros();
+
+    std::cerr << "Sorted " << count << " tracks in " << (sorted - keyed) / 1000 << " ms." << std::endl;
+
+    printf("{\"bench\":\"sort\",\"tracks\":%ld,\"build_ms\":%.1f,\"keys_ms\":%.1f,\"sort_ms\":%.1f,"
+           "\"bytes_per_track\":%.0f,\"peak_rss_kb\":%ld}\n",
+        count,
+        (built - start) / 1000.0,
+        (keyed - built) / 1000.0,
+        (sorted - keyed) / 1000.0,
+        count > 0 ? (rssTracks - rssBefore) * 1024.0 / count : 0.0,
+        peakRssKb());
+    return 0;
+}
+
+int benchSearch(long count) {
+    std::vector<TrackInfo> tracks;
+    generateTracks(count, tracks);
+
+    long rssBefore = currentRssKb();
+    long long start = nowMicros();
+    SearchIndex index;
+    for (long i = 0; i < count; i++) {
+        index.add(i, tracks[i]);
+    }
+    long long built = nowMicros();
+    long rssIndex = currentRssKb();
+
+    // What someone types, one key at a time: short prefixes check every
+    // track, longer ones go through the trigrams.
+    static const char* QUERIES[] = {
+        "a", "ar", "art", "arti", "artist 1", "artist 12", "artist 123",
+        "so", "some", "title of track", "track 4711", "album 99 track",
+        "07.ogg", "nothing like this"
+    };
+    static const size_t QUERY_COUNT = sizeof(QUERIES) / sizeof(QUERIES[0]);
+    static const int ROUNDS = 5;
+
+    std::vector<long> times;
+    std::vector<long> ids;
+    size_t matches = 0;
+    for (int round = 0; round < ROUNDS; round++) {
+        for (size_t q = 0; q < QUERY_COUNT; q++) {
+            wxString query(QUERIES[q], wxConvUTF8);
+            long long before = nowMicros();
+            index.find(query, ids);
+            times.push_back(nowMicros() - before);
+            if (round == 0) {
+                std::cerr << "  \"" << QUERIES[q] << "\": " << ids.size() << " tracks in "
+                          << times.back() / 1000.0 << " ms" << std::endl;
+                matches += ids.size();
+            }
+        }
+    }
+    std::sort(times.begin(), times.end());
+
+    std::cerr << "Indexed " << count << " tracks in " << (built - start) / 1000 << " ms." << std::endl;
+
+    printf("{\"bench\":\"search\",\"tracks\":%ld,\"build_ms\":%.1f,\"queries\":%lu,"
+           "\"matches\":%lu,\"query_p50_ms\":%.2f,\"query_p99_ms\":%.2f,\"query_max_ms\":%.2f,"
+           "\"bytes_per_track\":%.0f,\"peak_rss_kb\":%ld}\n",
+        count,
+        (built - start) / 1000.0,
+        (unsigned long) times.size(),
+        (unsigned long) matches,
+        percentileMs(times, 0.5),
+        percentileMs(times, 0.99),
+        times.empty() ? 0.0 : times.back() / 1000.0,
+        count > 0 ? (rssIndex - rssBefore) * 1024.0 / count : 0.0,
+        peakRssKb());
+    return 0;
+}
+
+int benchLibrary(long count) {
+    std::vector<TrackInfo> tracks;
+    generateTracks(count, tracks);
+    wxString file = wxFileName::CreateTempFileName(wxT("navi-library"));
+
+    long long start = nowMicros();
+    if (!LibraryDb::write(file, wxT("/music"), tracks)) {
+        wxRemoveFile(file);
+        return 1;
+    }
+    long long written = nowMicros();
+
+    LibraryDb db;
+    if (!db.open(file)) {
+        std::cerr << "Failed to open " << file.mb_str() << std::endl;
+        wxRemoveFile(file);
+        return 1;
+    }
+    long long opened = nowMicros();
+
+    // what the LibraryLoadThread does to display the library (see
+    // TrackInfoBatch::prepare(), which is not linked in here).
+    std::vector<TrackInfo> loaded(db.size());
+    std::vector<TrackSortKey> keys;
+    std::vector<std::string> texts;
+    keys.reserve(db.size());
+    texts.reserve(db.size());
+    for (size_t i = 0; i < db.size(); i++) {
+        db.getTrackInfo(i, loaded[i]);
+        keys.push_back(TrackSortKey(loaded[i]));
+        texts.push_back(SearchIndex::makeText(loaded[i]));
+    }
+    long long read = nowMicros();
+
+    struct stat st;
+    double fileSize = stat(file.fn_str(), &st) == 0 ? st.st_size : 0.0;
+    db.close();
+    wxRemoveFile(file);
+
+    std::cerr << "Read " << loaded.size() << " tracks from the library database in "
+              << (read - written) / 1000 << " ms." << std::endl;
+
+    printf("{\"bench\":\"library\",\"tracks\":%ld,\"write_ms\":%.1f,\"open_ms\":%.2f,"
+           "\"read_ms\":%.1f,\"bytes_per_track\":%.0f,\"peak_rss_kb\":%ld}\n",
+        count,
+        (written - start) / 1000.0,
+        (opened - written) / 1000.0,
+        (read - opened) / 1000.0,
+        count > 0 ? fileSize / count : 0.0,
+        peakRssKb());
+    return 0;
+}
+
+int benchScan(const wxString& dir, const wxString& reader, unsigned int threads, bool recursive, bool cache) {
+    TagCache::get().setEnabled(cache);
+
+    wxArrayString files;
+    FileCollector collector(files, recursive);
+    wxDir d(dir);
+    if (!d.IsOpened()) {
+        std::cerr << "Can't open directory " << dir.mb_str() << std::endl;
+        return 1;
+    }
+    long long start = nowMicros();
+    d.Traverse(collector);
+    long long listed = nowMicros();
+
+    std::cerr << "Found " << files.GetCount() << " files, reading them with `"
+              << reader.mb_str() << "'..." << std::endl;
+
+    std::vector<long> times;
+    size_t tracks = 0;
+    if (reader == wxT("scan")) {
+        CountingListener listener;
+        TrackScanner scanner(&listener, threads);
+        scanner.setRecordTimes(true);
+        scanner.run(files);
+        times = scanner.getReadTimes();
+        tracks = listener.tracks;
+    } else {
+        // one reader, one file at a time, to compare the readers themselves.
+        threads = 1;
+        for (size_t i = 0; i < files.GetCount(); i++) {
+            long long fileStart = nowMicros();
+            TrackInfo info;
+            if (reader == wxT("native")) {
+                NativeTagReader native(files[i]);
+                if (native.read(info)) {
+                    tracks++;
+                }
+            } else if (reader == wxT("gstpool")) {
+                TagReaderPool& pool = TagReaderPool::get();
+                TagReader* t = NULL;
+                try {
+                    t = pool.acquire();
+                    t->read(wxT("file://") + files[i]);
+                    info = t->getTrackInfo();
+                    pool.release(t);
+                    tracks++;
+                } catch (const AudioException& ex) {
+                    std::cerr << ex.what() << std::endl;
+                    if (t != NULL) {
+                        pool.discard(t);
+                    }
+                }
+            } else {
+                try {
+                    TagReader t(wxT("file://") + files[i]);
+                    info = t.getTrackInfo();
+                    tracks++;
+                } catch (const AudioException& ex) {
+                    std::cerr << ex.what() << std::endl;
+                }
+            }
+            times.push_back(nowMicros() - fileStart);
+        }
+    }
+    long long done = nowMicros();
+
+    double seconds = (done - listed) / 1000000.0;
+    std::sort(times.begin(), times.end());
+
+    printf("{\"bench\":\"scan\",\"reader\":\"%s\",\"threads\":%u,\"recursive\":%s,\"cache\":%s,"
+           "\"files\":%lu,\"tracks\":%lu,\"list_ms\":%.1f,\"seconds\":%.3f,\"files_per_sec\":%.1f,"
+           "\"p50_ms\":%.2f,\"p99_ms\":%.2f,\"peak_rss_kb\":%ld}\n",
+        (const char*) reader.mb_str(),
+        threads,
+        recursive ? "true" : "false",
+        cache ? "true" : "false",
+        (unsigned long) files.GetCount(),
+        (unsigned long) tracks,
+        (listed - start) / 1000.0,
+        seconds,
+        seconds > 0 ? files.GetCount() / seconds : 0.0,
+        percentileMs(times, 0.50),
+        percentileMs(times, 0.99),
+        peakRssKb());
+    return 0;
+}
+
+/// Turns the paths into file:// URIs.
+wxArrayString toUris(const wxArrayString& files) {
+    wxArrayString uris;
+    for (size_t i = 0; i < files.GetCount(); i++) {
+        wxFileName fn(files[i]);
+        fn.MakeAbsolute();
+        uris.Add(wxT("file://") + fn.GetFullPath());
+    }
+    return uris;
+}
+
+/// Gaps shorter than this (microseconds) are scheduling jitter, not silence.
+const long long GAP_THRESHOLD = 5000;
+
+/**
+ * Measures the silence in the output, from the buffers arriving at a fakesink.
+ * The sink syncs to the clock like a real audio output, so a buffer which is
+ * rendered later than the previous one ended means nothing was heard.
+ */
+struct GapMeter {
+    /// Wall clock time at which the previous buffer ended, in microseconds.
+    long long lastEnd;
+
+    /// The longest gap, in microseconds.
+    long long maxGap;
+
+    /// Amount of gaps longer than GAP_THRESHOLD.
+    long gaps;
+
+    long buffers;
+
+    GapMeter() : lastEnd(0), maxGap(0), gaps(0), buffers(0) {}
+};
+
+/// The handoff signal of the fakesink, called from a streaming thread.
+void onHandoff(GstElement* sink, GstBuffer* buffer, GstPad* pad, gpointer userdata) {
+    GapMeter* meter = static_cast<GapMeter*>(userdata);
+    long long now = nowMicros();
+    if (meter->lastEnd > 0 && now - meter->lastEnd > 0) {
+        long long gap = now - meter->lastEnd;
+        if (gap > meter->maxGap) {
+            meter->maxGap = gap;
+        }
+        if (gap > GAP_THRESHOLD) {
+            meter->gaps++;
+        }
+    }
+
+    GstClockTime duration = GST_BUFFER_DURATION(buffer);
+    meter->lastEnd = now + (duration != GST_CLOCK_TIME_NONE ? duration / 1000 : 0);
+    meter->buffers++;
+}
+
+/// Creates a fakesink which feeds the meter.
+GstElement* createMeterSink(GapMeter& meter) {
+    GstElement* sink = gst_element_factory_make("fakesink", NULL);
+    g_object_set(G_OBJECT(sink), "sync", TRUE, "signal-handoffs", TRUE, NULL);
+    g_signal_connect(sink, "handoff", G_CALLBACK(onHandoff), &meter);
+    return sink;
+}
+
+/**
+ * Runs the main context (bus watch and position interval of the pipeline)
+ * until the pipeline reaches its end. When the queued location started, the
+ * one after it is queued.
+ *
+ * @return false when the pipeline failed.
+ */
+bool playToEnd(GenericPipeline& pipeline, const wxArrayString& uris, size_t& current, long& changes) {
+    PipelineNotification n;
+    while (true) {
+        g_main_context_iteration(NULL, TRUE);
+        while (pipeline.popNotification(n)) {
+            if (n.kind == PipelineNotification::NOTIFY_END) {
+                return true;
+            } else if (n.kind == PipelineNotification::NOTIFY_ERROR) {
+                std::cerr << "Pipeline error: " << n.value << std::endl;
+                return false;
+            } else if (n.kind == PipelineNotification::NOTIFY_TRACK_CHANGED) {
+                changes++;
+                current++;
+                pipeline.setNextLocation(current + 1 < uris.GetCount() ? uris[current + 1] : wxString());
+            }
+        }
+    }
+}
+
+int benchGapless(const wxArrayString& files, bool rebuild) {
+    wxArrayString uris = toUris(files);
+
+    GapMeter meter;
+    long changes = 0;
+    size_t current = 0;
+    long long start = nowMicros();
+
+    try {
+        if (rebuild) {
+            // the way tracks were played before: a new pipeline every time.
+            for (current = 0; current < uris.GetCount(); current++) {
+                GenericPipeline pipeline(uris[current]);
+                pipeline.setAudioSink(createMeterSink(meter));
+                pipeline.play();
+                // nothing is queued, so `current' is left alone.
+                if (!playToEnd(pipeline, uris, current, changes)) {
+                    return 1;
+                }
+            }
+        } else {
+            GenericPipeline pipeline(uris[0]);
+            pipeline.setAudioSink(createMeterSink(meter));
+            if (uris.GetCount() > 1) {
+                pipeline.setNextLocation(uris[1]);
+            }
+            pipeline.play();
+            if (!playToEnd(pipeline, uris, current, changes)) {
+                return 1;
+            }
+        }
+    } catch (const AudioException& ex) {
+        std::cerr << ex.what() << std::endl;
+        return 1;
+    }
+    long long done = nowMicros();
+
+    std::cerr << "Played " << uris.GetCount() << " files, the longest silence was "
+              << meter.maxGap / 1000 << " ms." << std::endl;
+
+    printf("{\"bench\":\"gapless\",\"mode\":\"%s\",\"files\":%lu,\"track_changes\":%ld,"
+           "\"buffers\":%ld,\"max_gap_ms\":%.1f,\"gaps_over_%lldms\":%ld,\"seconds\":%.1f}\n",
+        rebuild ? "rebuild" : "gapless",
+        (unsigned long) uris.GetCount(),
+        changes,
+        meter.buffers,
+        meter.maxGap / 1000.0,
+        GAP_THRESHOLD / 1000,
+        meter.gaps,
+        (done - start) / 1000000.0);
+    return 0;
+}
+
+int benchSwitch(const wxArrayString& files, bool rebuild) {
+    wxArrayString uris = toUris(files);
+    std::vector<long> times;
+    GenericPipeline* pipeline = NULL;
+
+    try {
+        for (size_t i = 0; i < uris.GetCount(); i++) {
+            long long start = nowMicros();
+            if (pipeline == NULL || rebuild) {
+                delete pipeline;
+                pipeline = NULL;
+                pipeline = new GenericPipeline(uris[i]);
+            } else {
+                pipeline->setLocation(uris[i]);
+            }
+            pipeline->play();
+            // blocks until the state change is done: the sink got the first
+            // buffer of the new track.
+            pipeline->getState();
+            times.push_back(nowMicros() - start);
+        }
+    } catch (const AudioException& ex) {
+        std::cerr << ex.what() << std::endl;
+        delete pipeline;
+        return 1;
+    }
+    delete pipeline;
+
+    std::sort(times.begin(), times.end());
+
+    printf("{\"bench\":\"switch\",\"mode\":\"%s\",\"switches\":%lu,"
+           "\"p50_ms\":%.2f,\"p99_ms\":%.2f,\"max_ms\":%.2f}\n",
+        rebuild ? "rebuild" : "reuse",
+        (unsigned long) times.size(),
+        percentileMs(times, 0.50),
+        percentileMs(times, 0.99),
+        percentileMs(times, 1.0));
+    return 0;
+}
+
+void usage() {
+    std::cerr << "Usage: navi-bench [--threads N] [--recursive] [--cache] "
+                 "[--reader scan|native|gst|gstpool] <directory>" << std::endl
+              << "       navi-bench --sort N" << std::endl
+              << "       navi-bench --search N" << std::endl
+              << "       navi-bench --library N" << std::endl
+              << "       navi-bench --gapless [--rebuild] <file> <file>..." << std::endl
+              << "       navi-bench --switch [--rebuild] <file> <file>..." << std::endl;
+}
+
+} // anonymous namespace
+
+int main(int argc, char** argv) {
+    wxInitializer initializer;
+    if (!initializer.IsOk()) {
+        std::cerr << "Failed to initialize wxWidgets." << std::endl;
+        return 1;
+    }
+    gst_init(&argc, &argv);
+    TagReaderPool::get();
+
+    unsigned int threads = 0;
+    bool recursive = false;
+    bool cache = false;
+    long sortCount = 0;
+    long searchCount = 0;
+    long libraryCount = 0;
+    bool gapless = false;
+    bool switches = false;
+    bool rebuild = false;
+    wxString reader = wxT("scan");
+    wxArrayString paths;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+            threads = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--recursive") == 0) {
+            recursive = true;
+        } else if (strcmp(argv[i], "--cache") == 0) {
+            cache = true;
+        } else if (strcmp(argv[i], "--reader") == 0 && i + 1 < argc) {
+            reader = wxString(argv[++i], wxConvUTF8);
+        } else if (strcmp(argv[i], "--sort") == 0 && i + 1 < argc) {
+            sortCount = atol(argv[++i]);
+        } else if (strcmp(argv[i], "--search") == 0 && i + 1 < argc) {
+            searchCount = atol(argv[++i]);
+        } else if (strcmp(argv[i], "--library") == 0 && i + 1 < argc) {
+            libraryCount = atol(argv[++i]);
+        } else if (strcmp(argv[i], "--gapless") == 0) {
+            gapless = true;
+        } else if (strcmp(argv[i], "--switch") == 0) {
+            switches = true;
+        } else if (strcmp(argv[i], "--rebuild") == 0) {
+            rebuild = true;
+        } else if (argv[i][0] != '-') {
+            paths.Add(wxString(argv[i], *wxConvFileName));
+        } else {
+            usage();
+            return 1;
+        }
+    }
+
+    if (sortCount > 0) {
+        return benchSort(sortCount);
+    }
+
+    if (searchCount > 0) {
+        return benchSearch(searchCount);
+    }
+
+    if (libraryCount > 0) {
+        return benchLibrary(libraryCount);
+    }
+
+    if (gapless && !paths.IsEmpty()) {
+        return benchGapless(paths, rebuild);
+    }
+
+    if (switches && !paths.IsEmpty()) {
+        return benchSwitch(paths, rebuild);
+    }
+
+    if (gapless || switches || paths.GetCount() != 1 || (reader != wxT("scan") && reader != wxT("native")
+            && reader != wxT("gst") && reader != wxT("gstpool"))) {
+        usage();
+        return 1;
+    }
+
+    return benchScan(paths[0], reader, threads, recursive, cache);
+}
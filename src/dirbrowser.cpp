@@ -20,14 +20,19 @@
 #include "dirbrowser.hpp"
 
 #include <iostream>
+#include <algorithm>
 
 namespace navi {
 
 // Declared in misc.cpp
 extern const wxEventType naviDirTraversedEvent;
+extern const wxEventType naviScanProgressEvent;
+extern const wxEventType naviDirListedEvent;
 
-DirBrowserItemData::DirBrowserItemData(const wxFileName& fileName) :
-        m_fileName(fileName) {
+DirBrowserItemData::DirBrowserItemData(const wxFileName& fileName, Kind kind) :
+        m_fileName(fileName),
+        m_kind(kind),
+        m_sortKey(makeSortKey(fileName.GetFullName())) {
 }
 
 DirBrowserItemData::~DirBrowserItemData() {
@@ -37,6 +42,48 @@ const wxFileName& DirBrowserItemData::getFileName() const {
     return m_fileName;
 }
 
+DirBrowserItemData::Kind DirBrowserItemData::getKind() const {
+    return m_kind;
+}
+
+const wxString& DirBrowserItemData::getSortKey() const {
+    return m_sortKey;
+}
+
+wxString DirBrowserItemData::makeSortKey(const wxString& name) {
+    // The length prefix is a character from '1' on. Up to 16 digits that
+    // stays below the letters, so like in plain ASCII, numbers go before
+    // letters.
+    static const size_t MAX_DIGITS = 16;
+
+    wxString lower = name.Lower();
+    wxString key;
+    key.reserve(lower.Len() + 4);
+
+    size_t i = 0;
+    while (i < lower.Len()) {
+        if (!wxIsdigit(lower[i])) {
+            key << lower[i];
+            i++;
+            continue;
+        }
+
+        // skip leading zeroes, but keep one for a plain zero.
+        while (i + 1 < lower.Len() && lower[i] == wxT('0') && wxIsdigit(lower[i + 1])) {
+            i++;
+        }
+        size_t start = i;
+        while (i < lower.Len() && wxIsdigit(lower[i])) {
+            i++;
+        }
+        size_t digits = i - start;
+        key << wxChar(wxT('0') + (digits < MAX_DIGITS ? digits : MAX_DIGITS));
+        key << lower.Mid(start, digits);
+    }
+
+    return key;
+}
+
 //==============================================================================
 
 DirBrowser::DirBrowser(wxWindow* parent, NaviMainFrame* frame) :
@@ -45,13 +92,37 @@ DirBrowser::DirBrowser(wxWindow* parent, NaviMainFrame* frame) :
         m_filesVisible(true),
         m_currentActiveItem(NULL),
         m_dirTraversalThread(NULL),
-        m_mainFrame(frame) {
+        m_libraryLoader(NULL),
+        m_watcher(NULL),
+        m_reapTimer(this, ID_REAP_TIMER),
+        m_generation(0),
+        m_mainFrame(frame),
+        m_lastListing(0),
+        m_libraryShown(false),
+        m_libraryComplete(false) {
 
     // intialize the used icons in the wxTreeCtrl.
     initIcons();
 }
 
 DirBrowser::~DirBrowser() {
+    // The listings are detached, and may be stuck on a hung mount for good.
+    // Once cancelled they leave us alone, so they're not waited for.
+    cancelListings(wxTreeItemId());
+
+    // The other threads post events to the TrackTable, which may be gone soon.
+    // This time we do have to wait for them. A tag read through GStreamer
+    // gives up after TagReader::READ_TIMEOUT seconds, but a file read by the
+    // NativeTagReader (or a directory read by wxDir) on a hung mount has no
+    // timeout, and may still keep us waiting.
+    abandonThreads();
+    m_reapTimer.Stop();
+    for (size_t i = 0; i < m_abandoned.size(); i++) {
+        m_abandoned[i]->Wait();
+        delete m_abandoned[i];
+    }
+    m_abandoned.clear();
+
     // Imagelist will not get deleted by the wxTreeCtrl destructor, so lets do that
     // ourselves.
     delete m_imageList;
@@ -91,9 +162,11 @@ void DirBrowser::setBase(const wxString& basePath) {
     m_basePath = basePath;
 
     // delete them all before attempting to add a new root and shit.
+    cancelListings(wxTreeItemId());
     DeleteAllItems();
     // make sure the base path is now the root (second arg is the icon)
-    wxTreeItemId root = AddRoot(wxT("Music Library"), 3, -1, new DirBrowserItemData(wxFileName(basePath)));
+    wxTreeItemId root = AddRoot(wxT("Music Library"), 3, -1,
+        new DirBrowserItemData(wxFileName(basePath), DirBrowserItemData::KIND_DIR));
     // denote that our root "has children" (it will force a + on the item)
     SetItemHasChildren(root);
     // by default, expand the root.
@@ -108,44 +181,40 @@ void DirBrowser::setBase(const wxString& basePath) {
 int DirBrowser::OnCompareItems(const wxTreeItemId& one, const wxTreeItemId& two) {
     DirBrowserItemData* dataOne = static_cast<DirBrowserItemData*>(GetItemData(one));
     DirBrowserItemData* dataTwo = static_cast<DirBrowserItemData*>(GetItemData(two));
-    bool isDirOne = wxFileName::DirExists(dataOne->getFileName().GetFullPath());
-    bool isDirTwo = wxFileName::DirExists(dataTwo->getFileName().GetFullPath());
 
-    if (isDirOne) {
-        if (isDirTwo) {
-            // compare the directories lexicographically
-            return dataOne->getFileName().GetFullName() >= dataTwo->getFileName().GetFullName();
-        } else {
-            // pathTwo is just a file, which is `inferior'.
-            return -1;
-        }
-    } else {
-        // pathOne is a file... but pathTwo may be a dir!
-        if (isDirTwo) {
-            return 1;
-        } else {
-            // compare files lexicographically
-            return dataOne->getFileName().GetFullName() >= dataTwo->getFileName().GetFullName();
-        }
+    if (dataOne->getKind() != dataTwo->getKind()) {
+        // a file is `inferior' to a directory, and the `Loading...' item goes
+        // below everything.
+        return dataOne->getKind() < dataTwo->getKind() ? -1 : 1;
     }
 
-    return 1;
+    int result = dataOne->getSortKey().Cmp(dataTwo->getSortKey());
+    if (result == 0) {
+        // "cd 1" and "CD 01" have the same key. Keep their order stable.
+        result = dataOne->getFileName().GetFullName().Cmp(dataTwo->getFileName().GetFullName());
+    }
+    return result;
 }
 
 
 void DirBrowser::onExpandItem(wxTreeEvent& event) {
     wxTreeItemId itemExpanded = event.GetItem();
-    addChildrenToDir(itemExpanded);
-    SortChildren(itemExpanded);
+    startListing(itemExpanded);
 }
 
 void DirBrowser::onCollapseItem(wxTreeEvent& event) {
     wxTreeItemId itemCollapsed = event.GetItem();
+    // the children are deleted, and with them the items still being read.
+    cancelListings(itemCollapsed);
     DeleteChildren(itemCollapsed);
 }
 
 void DirBrowser::onActivateItem(wxTreeEvent& event) {
     wxTreeItemId item = event.GetItem();
+    DirBrowserItemData* data = static_cast<DirBrowserItemData*>(GetItemData(item));
+    if (data->getKind() == DirBrowserItemData::KIND_LOADING) {
+        return;
+    }
 
     // Highlight the current item.
     if (m_currentActiveItem.IsOk()) {
@@ -156,20 +225,95 @@ void DirBrowser::onActivateItem(wxTreeEvent& event) {
     // Refresh the wxWindow (will display teh boldness lulz)
     Refresh();
 
-    const wxFileName& selectedPath = getSelectedPath();
+    startTraversal(getSelectedPath(), false);
 
-    if (m_dirTraversalThread != NULL) {
-        m_dirTraversalThread->setActive(false);
-        // wait for thread to finish doing its work.
-        /*wxThread::ExitCode code = */
-        m_dirTraversalThread->Wait();
+    Preferences* prefs = static_cast<Preferences*>(wxConfigBase::Get());
+    prefs->Write(Preferences::LIBRARY_MODE, false);
+    prefs->save();
+
+    // XXX: okay, we skip the event here, so the tree item is not expanded
+    // automatically (or collapsed). 
+    //event.Skip();
+}
+
+void DirBrowser::activateLibrary() {
+    // no single directory is active now.
+    if (m_currentActiveItem.IsOk()) {
+        SetItemBold(m_currentActiveItem, false);
+        m_currentActiveItem = wxTreeItemId();
+        Refresh();
+    }
+
+    // Activating the displayed library again reads it from disk, which also
+    // picks up what changed while Navi wasn't running.
+    if (m_libraryShown || !loadLibrary()) {
+        startTraversal(wxFileName::DirName(m_basePath), true);
+    }
+
+    Preferences* prefs = static_cast<Preferences*>(wxConfigBase::Get());
+    prefs->Write(Preferences::LIBRARY_MODE, true);
+    prefs->save();
+}
+
+bool DirBrowser::loadLibrary() {
+    // Only the header is checked here, the records are read by the thread.
+    LibraryDb* db = new LibraryDb;
+    if (!db->open(LibraryDb::getDefaultFile().GetFullPath()) || db->getBase() != m_basePath) {
+        delete db;
+        return false;
     }
-    // XXX: deleting all items does not seem to work reliably, i.e. always some
-    // 'residue' seem to be left behind from the previous directory crap.
+
+    abandonThreads();
+    m_generation++;
     TrackTable* tt = m_mainFrame->getTrackTable();
     tt->DeleteAllItems();
+    tt->setGeneration(m_generation);
+
+    m_libraryLoader = new LibraryLoadThread(tt, db, m_generation);
+    if (m_libraryLoader->Create() != wxTHREAD_NO_ERROR || m_libraryLoader->Run() != wxTHREAD_NO_ERROR) {
+        std::cerr << "Couldn't start loading the library." << std::endl;
+        delete m_libraryLoader;
+        m_libraryLoader = NULL;
+        return false;
+    }
+
+    // complete once the thread is done, see libraryRead().
+    m_libraryShown = true;
+    m_libraryComplete = false;
+
+    startWatcher(wxFileName::DirName(m_basePath), true);
+    return true;
+}
+
+void DirBrowser::libraryRead() {
+    m_libraryComplete = m_libraryShown;
+    saveLibrary();
+}
+
+void DirBrowser::saveLibrary() {
+    TrackTable* tt = m_mainFrame->getTrackTable();
+    if (!m_libraryShown || !m_libraryComplete || !tt->isModified()) {
+        return;
+    }
 
-    m_dirTraversalThread = new DirTraversalThread(tt, selectedPath);
+    if (LibraryDb::write(LibraryDb::getDefaultFile().GetFullPath(), m_basePath, tt->getTrackInfos())) {
+        tt->setModified(false);
+    }
+}
+
+void DirBrowser::startTraversal(const wxFileName& path, bool recursive) {
+    // Never wait for the old threads here: one may be stuck on a slow file,
+    // which would freeze the UI.
+    abandonThreads();
+
+    // Events of the old threads which are still queued (or are still to come)
+    // carry the old generation, and are ignored by the TrackTable from now on.
+    m_generation++;
+    TrackTable* tt = m_mainFrame->getTrackTable();
+    tt->DeleteAllItems();
+    tt->setGeneration(m_generation);
+
+    m_dirTraversalThread = new DirTraversalThread(tt, path, m_generation, recursive);
     wxThreadError err = m_dirTraversalThread->Create();
     if (err != wxTHREAD_NO_ERROR) {
         wxMessageBox(wxT("Couldn't create thread!"));
@@ -181,48 +325,166 @@ void DirBrowser::onActivateItem(wxTreeEvent& event) {
         wxMessageBox(wxT("Couldn't run thread!"));
     }
 
+    m_libraryShown = recursive;
+    m_libraryComplete = false;
 
-    // XXX: okay, we skip the event here, so the tree item is not expanded
-    // automatically (or collapsed). 
-    //event.Skip();
+    // Changes on disk are applied to the TrackTable from now on. Watching
+    // starts right away, so nothing is missed while the directory is read.
+    startWatcher(path, recursive);
 }
 
-void DirBrowser::addChildrenToDir(wxTreeItemId& parent) {
-    DirBrowserItemData* data = static_cast<DirBrowserItemData*>(GetItemData(parent));
+void DirBrowser::startWatcher(const wxFileName& path, bool recursive) {
+    TrackTable* tt = m_mainFrame->getTrackTable();
+    m_watcher = new DirWatcher(tt, path.GetFullPath(), m_generation, recursive);
+    if (m_watcher->Create() != wxTHREAD_NO_ERROR || m_watcher->Run() != wxTHREAD_NO_ERROR) {
+        std::cerr << "Couldn't start the directory watcher." << std::endl;
+        delete m_watcher;
+        m_watcher = NULL;
+    }
+}
 
-    // If the `parent' holds an existing directory, get children.
-    if (wxFileName::DirExists(data->getFileName().GetFullPath())) {
-        //std::cout << "Existing dir, attempt to add children to parent " << data->getPath().mb_str() << std::endl;
-
-        wxDir dir(data->getFileName().GetFullPath());
-        wxString filename;
-        // do we want to display files, directories, or both?
-        int mode = m_filesVisible ? (wxDIR_DIRS | wxDIR_FILES) : wxDIR_DIRS;
-        bool gotfiles = dir.GetFirst(&filename, wxEmptyString, mode);
-        while (gotfiles) {
-            wxString path = data->getFileName().GetFullPath();
-            path << wxT("/") << filename;
-
-            wxFileName fileobj(path);
-            DirBrowserItemData* data = new DirBrowserItemData(fileobj);
-
-            wxDir subdir(path);
-            if (wxFileName::DirExists(path)) {
-                wxTreeItemId subItem = AppendItem(parent, fileobj.GetFullName(), 0, -1, data);
-                if (subdir.HasSubDirs()) {
-                    // if this item has subdirs, pretend we have children so we
-                    // can make it clickable.
-                    SetItemHasChildren(subItem);
-                }
-            } else if(wxFileName::FileExists(path)) {
-                // only add files when we want to..
-                if (m_filesVisible) {
-                    AppendItem(parent, fileobj.GetFullName(), 2, -1, data);
-                }
+void DirBrowser::abandonThreads() {
+    if (m_dirTraversalThread != NULL) {
+        m_dirTraversalThread->setActive(false);
+        abandonThread(m_dirTraversalThread);
+        m_dirTraversalThread = NULL;
+    }
+    if (m_libraryLoader != NULL) {
+        m_libraryLoader->setActive(false);
+        abandonThread(m_libraryLoader);
+        m_libraryLoader = NULL;
+    }
+    if (m_watcher != NULL) {
+        m_watcher->setActive(false);
+        abandonThread(m_watcher);
+        m_watcher = NULL;
+    }
+}
+
+void DirBrowser::abandonThread(wxThread* thread) {
+    m_abandoned.push_back(thread);
+    if (!m_reapTimer.IsRunning()) {
+        m_reapTimer.Start(REAP_INTERVAL);
+    }
+}
+
+void DirBrowser::onReapThreads(wxTimerEvent& event) {
+    std::vector<wxThread*>::iterator it = m_abandoned.begin();
+    while (it != m_abandoned.end()) {
+        if (!(*it)->IsAlive()) {
+            // it has left Entry(), so this returns right away.
+            (*it)->Wait();
+            delete *it;
+            it = m_abandoned.erase(it);
+        } else {
+            ++it;
+        }
+    }
+
+    if (m_abandoned.empty()) {
+        m_reapTimer.Stop();
+    }
+}
+
+void DirBrowser::startListing(const wxTreeItemId& item) {
+    DirBrowserItemData* data = static_cast<DirBrowserItemData*>(GetItemData(item));
+    wxString dirPath = data->getFileName().GetFullPath();
+
+    DirListingHandle* handle = new DirListingHandle;
+    DirListingThread* thread = new DirListingThread(this, handle, dirPath, m_filesVisible, ++m_lastListing);
+    if (thread->Create() != wxTHREAD_NO_ERROR || thread->Run() != wxTHREAD_NO_ERROR) {
+        // read it right here then, like in the old days.
+        std::cerr << "Couldn't start the directory listing thread." << std::endl;
+        // it never ran, so it can be deleted.
+        delete thread;
+        handle->release();
+
+        std::vector<DirEntry> entries;
+        if (!listDirectory(dirPath, entries, m_filesVisible) || entries.empty()) {
+            SetItemHasChildren(item, false);
+            return;
+        }
+        addChildrenToDir(item, entries);
+        SortChildren(item);
+        return;
+    }
+
+    PendingListing& listing = m_listings[m_lastListing];
+    listing.handle = handle;
+    listing.item = item;
+    listing.loading = AppendItem(item, wxT("Loading..."), -1, -1,
+        new DirBrowserItemData(data->getFileName(), DirBrowserItemData::KIND_LOADING));
+}
+
+void DirBrowser::cancelListings(const wxTreeItemId& item) {
+    std::map<long, PendingListing>::iterator it = m_listings.begin();
+    while (it != m_listings.end()) {
+        bool below = !item.IsOk();
+        for (wxTreeItemId i = it->second.item; i.IsOk() && !below; i = GetItemParent(i)) {
+            below = i == item;
+        }
+
+        if (below) {
+            // Chunks which are still queued are dropped, since the id is
+            // gone from the map. No more are posted.
+            it->second.handle->cancel();
+            it->second.handle->release();
+            m_listings.erase(it++);
+        } else {
+            ++it;
+        }
+    }
+}
+
+void DirBrowser::onDirListed(wxCommandEvent& event) {
+    DirListingChunk* chunk = static_cast<DirListingChunk*>(event.GetClientObject());
+    std::map<long, PendingListing>::iterator it = m_listings.find(event.GetExtraLong());
+
+    if (chunk != NULL && it != m_listings.end()) {
+        PendingListing& listing = it->second;
+
+        if (!chunk->entries.empty()) {
+            Freeze();
+            addChildrenToDir(listing.item, chunk->entries);
+            SortChildren(listing.item);
+            Thaw();
+        }
+
+        if (chunk->done) {
+            Delete(listing.loading);
+            // there was nothing in it after all (or it couldn't be read).
+            if (GetChildrenCount(listing.item, false) == 0) {
+                SetItemHasChildren(listing.item, false);
             }
+            // it's leaving Entry() now, and deletes itself.
+            listing.handle->release();
+            m_listings.erase(it);
+        }
+    }
+
+    // created on the heap by the DirListingThread.
+    delete chunk;
+}
 
-            // Get the next dir, if available. This is something like an iterator.
-            gotfiles = dir.GetNext(&filename);
+void DirBrowser::addChildrenToDir(const wxTreeItemId& parent, const std::vector<DirEntry>& entries) {
+    DirBrowserItemData* data = static_cast<DirBrowserItemData*>(GetItemData(parent));
+    wxString dirPath = data->getFileName().GetFullPath();
+    if (!dirPath.EndsWith(wxT("/"))) {
+        dirPath << wxT("/");
+    }
+
+    // Whether the subdirectories have children of their own isn't checked
+    // (that would be another read for every one of them): they all get a `+',
+    // which disappears when expanding shows there's nothing in it.
+    for (size_t i = 0; i < entries.size(); i++) {
+        const DirEntry& entry = entries[i];
+        DirBrowserItemData* childData = new DirBrowserItemData(wxFileName(dirPath + entry.name),
+            entry.isDir ? DirBrowserItemData::KIND_DIR : DirBrowserItemData::KIND_FILE);
+        if (entry.isDir) {
+            wxTreeItemId subItem = AppendItem(parent, entry.name, 0, -1, childData);
+            SetItemHasChildren(subItem);
+        } else {
+            AppendItem(parent, entry.name, 2, -1, childData);
         }
     }
 }
@@ -246,6 +508,8 @@ BEGIN_EVENT_TABLE(DirBrowser, wxTreeCtrl)
     EVT_TREE_ITEM_ACTIVATED(DirBrowser::ID_NAVI_DIR_BROWSER, DirBrowser::onActivateItem)
     EVT_TREE_ITEM_EXPANDING(DirBrowser::ID_NAVI_DIR_BROWSER, DirBrowser::onExpandItem)
     EVT_TREE_ITEM_COLLAPSING(DirBrowser::ID_NAVI_DIR_BROWSER, DirBrowser::onCollapseItem)
+    EVT_TIMER(DirBrowser::ID_REAP_TIMER, DirBrowser::onReapThreads)
+    EVT_COMMAND(wxID_ANY, naviDirListedEvent, DirBrowser::onDirListed)
 END_EVENT_TABLE()
 
 //==============================================================================
@@ -266,9 +530,14 @@ DirBrowserContainer::DirBrowserContainer(wxWindow* parent, NaviMainFrame* frame)
     wxBitmapButton* btn2 = new wxBitmapButton(panelBtns, wxID_ANY, imgAdd, wxDefaultPosition, wxDefaultSize, wxBORDER_NONE);
     btn2->SetToolTip(wxT("Add selected directory to favorites"));
 
+    wxBitmap imgLibrary = wxArtProvider::GetBitmap(wxART_HARDDISK);
+    wxBitmapButton* btn3 = new wxBitmapButton(panelBtns, ID_PLAY_LIBRARY, imgLibrary, wxDefaultPosition, wxDefaultSize, wxBORDER_NONE);
+    btn3->SetToolTip(wxT("Play the whole library (all files below the base directory)"));
+
     panelBtns->SetSizer(sizerBtns);
     sizerBtns->Add(btn1);
     sizerBtns->Add(btn2);
+    sizerBtns->Add(btn3);
 
     m_browser = new DirBrowser(this, frame);
 
@@ -293,83 +562,153 @@ void DirBrowserContainer::onBrowseNewDir(wxCommandEvent& event) {
     }
 }
 
+void DirBrowserContainer::onPlayLibrary(wxCommandEvent& event) {
+    m_browser->activateLibrary();
+}
+
 // Event table.
 BEGIN_EVENT_TABLE(DirBrowserContainer, wxPanel)
     EVT_BUTTON(DirBrowserContainer::ID_BROWSE_DIR, DirBrowserContainer::onBrowseNewDir)
+    EVT_BUTTON(DirBrowserContainer::ID_PLAY_LIBRARY, DirBrowserContainer::onPlayLibrary)
 END_EVENT_TABLE()
 
 //================================================================================
 
-DirTraversalThread::DirTraversalThread(TrackTable* parent, const wxFileName& selectedPath) :
+// Defined here as well, since std::min() and std::max() take them by reference.
+const size_t DirTraversalThread::BATCH_SIZE;
+const size_t DirTraversalThread::MAX_BATCH_SIZE;
+
+DirTraversalThread::DirTraversalThread(TrackTable* parent, const wxFileName& selectedPath, long generation, bool recursive) :
         wxThread(wxTHREAD_JOINABLE),
         m_parent(parent),
         m_selectedPath(selectedPath),
-        m_active(true) {
+        m_active(true),
+        m_generation(generation),
+        m_recursive(recursive),
+        m_filesFound(0),
+        m_filesRead(0),
+        m_tracksPosted(0),
+        m_completed(true),
+        m_scanner(this, wxConfigBase::Get()->Read(Preferences::SCAN_THREADS, 0L)),
+        m_batch(NULL) {
+}
+
+DirTraversalThread::~DirTraversalThread() {
+    delete m_batch;
 }
 
 void DirTraversalThread::setActive(bool active) {
     m_active = active;
+    m_scanner.setActive(active);
 }
 
 wxThread::ExitCode DirTraversalThread::Entry() {
     wxDir thedir(m_selectedPath.GetFullPath());
     
+    // In library mode, OnFile() reads the files in chunks while traversing.
     thedir.Traverse(*this);
-    std::cout << "Directory contains " << m_files.GetCount() << " addable files." << std::endl;
-
-    for (unsigned int i = 0; i < m_files.GetCount(); i++) {
-        if (m_active) {
-            wxString filename = m_files[i];
-            wxFileName fullFile;
-            fullFile.Assign(m_selectedPath.GetFullPath(), filename);
-
-            wxString uri = wxT("file://");
-            uri << fullFile.GetFullPath();
-
-            try {
-                TagReader t(uri);
-                // this info pointer must be deleted in the onAddTrackInfo() func
-                // we're currently making a copy of the found TrackInfo object, because
-                // of SetClientObject() and stuff.
-                TrackInfo& info = t.getTrackInfo();
-                // Make a copy on the heap, to use as a ClientObject. Must delete later!
-                TrackInfo* derp = new TrackInfo(info);
-                
-                wxCommandEvent event(naviDirTraversedEvent);
-                event.SetClientObject(derp);
-                m_parent->AddPendingEvent(event);
-            } catch (const AudioException& ex) {
-                // this exception is thrown when for instance a file is trying to
-                // be parsed when it's not a valid audio/video file. I don't want
-                // to hide the exception cause, so I'm just printing it out to 
-                // standard error.
-                std::cerr << "DirTraversalThread() err : " << ex.what() << std::endl;
-            }
+
+    // scanFiles() clears the list, but we need it to prune the cache.
+    wxArrayString present;
+    if (!m_recursive) {
+        present = m_files;
+    }
+    scanFiles();
+    std::cout << "Directory contains " << m_filesFound << " addable files." << std::endl;
+
+    if (!m_active) {
+        return 0;
+    }
+
+    postBatch();
+    postProgress(true);
+
+    if (m_completed) {
+        TagCache& cache = TagCache::get();
+        // Only when a single directory was read completely we know which files
+        // are gone, so only then prune the cache.
+        if (!m_recursive) {
+            cache.prune(m_selectedPath.GetFullPath(), present);
         }
+        cache.save();
+        std::cout << "Tag cache: " << cache.getHits() << " hits, "
+                  << cache.getMisses() << " misses." << std::endl;
     }
 
     return 0;
 }
 
+void DirTraversalThread::scanFiles() {
+    if (m_files.IsEmpty() || !m_active) {
+        return;
+    }
+
+    if (!m_scanner.run(m_files)) {
+        m_completed = false;
+    }
+    m_files.Clear();
+}
+
+void DirTraversalThread::trackScanned(size_t index, TrackInfo* info) throw() {
+    if (m_batch == NULL) {
+        m_batch = new TrackInfoBatch;
+        m_batchTimer.Start();
+    }
+    m_batch->tracks.push_back(*info);
+    delete info;
+    m_filesRead++;
+
+    size_t limit = std::max(BATCH_SIZE, std::min(MAX_BATCH_SIZE, m_tracksPosted / 8));
+    if (m_batch->tracks.size() >= limit || m_batchTimer.Time() >= BATCH_INTERVAL) {
+        postBatch();
+    }
+}
+
+void DirTraversalThread::scanStalled() throw() {
+    postBatch();
+}
+
+void DirTraversalThread::postBatch() {
+    if (m_batch == NULL) {
+        return;
+    }
+
+    m_tracksPosted += m_batch->tracks.size();
+    m_batch->prepare();
+
+    // The batch is used as the ClientObject of the event, and must be
+    // deleted in the onAddTrackInfo() func.
+    wxCommandEvent event(naviDirTraversedEvent);
+    event.SetClientObject(m_batch);
+    event.SetExtraLong(m_generation);
+    m_parent->AddPendingEvent(event);
+    m_batch = NULL;
+
+    postProgress(false);
+}
+
+void DirTraversalThread::postProgress(bool done) {
+    ScanProgress* progress = new ScanProgress;
+    progress->filesFound = m_filesFound;
+    progress->filesRead = m_filesRead;
+    progress->done = done;
+    progress->recursive = m_recursive;
+    progress->stored = false;
+
+    // The TrackTable doesn't handle this event, so it propagates up to the
+    // NaviMainFrame, which must delete the progress.
+    wxCommandEvent event(naviScanProgressEvent);
+    event.SetClientObject(progress);
+    event.SetExtraLong(m_generation);
+    m_parent->AddPendingEvent(event);
+}
+
 wxDirTraverseResult DirTraversalThread::OnFile(const wxString& filename) {
-    // LOL UGLY. But it works. Ideally, I should add the list of allowed
-    // extensions to a static set or vector, but I can't be arsed at this
-    // moment to figure it out. C++ gets weirder, the more I am coding 
-    // with it. ANYWAY: it's not that we need to have a crazy amount of 
-    // performance with this part.
-    wxArrayString allowed;
-    allowed.Add(wxT(".ogg"));
-    allowed.Add(wxT(".oga"));
-    allowed.Add(wxT(".mp3"));
-    allowed.Add(wxT(".aac"));
-    allowed.Add(wxT(".wav"));
-    allowed.Add(wxT(".flac"));
-
-    for (unsigned int i = 0; i < allowed.GetCount(); i++) {
-        if (filename.EndsWith(allowed[i])) {
-            m_files.Add(filename);
-            // no need to check the rest.
-            return m_active ? wxDIR_CONTINUE : wxDIR_STOP;
+    if (isPlayableFile(filename)) {
+        m_files.Add(filename);
+        m_filesFound++;
+        if (m_recursive && m_files.GetCount() >= SCAN_CHUNK) {
+            scanFiles();
         }
     }
 
@@ -380,14 +719,187 @@ wxDirTraverseResult DirTraversalThread::OnFile(const wxString& filename) {
 }
 
 wxDirTraverseResult DirTraversalThread::OnDir(const wxString& filename) {
-    // During traversing, STOP reading into subdirectories for obvious
-    // reasons. We are viewing the contents of the current directory
-    // only, at all times. Cocks!
+    // In library mode, we want everything. Otherwise, STOP reading into
+    // subdirectories for obvious reasons: we are viewing the contents of
+    // the current directory only. Cocks!
+    if (m_recursive) {
+        return m_active ? wxDIR_CONTINUE : wxDIR_STOP;
+    }
     return wxDIR_STOP;
 }
 
+//================================================================================
+
+LibraryLoadThread::LibraryLoadThread(TrackTable* parent, LibraryDb* db, long generation) :
+        wxThread(wxTHREAD_JOINABLE),
+        m_parent(parent),
+        m_db(db),
+        m_generation(generation),
+        m_active(true),
+        m_loaded(0) {
+}
+
+LibraryLoadThread::~LibraryLoadThread() {
+    delete m_db;
+}
+
+void LibraryLoadThread::setActive(bool active) {
+    m_active = active;
+}
+
+wxThread::ExitCode LibraryLoadThread::Entry() {
+    wxStopWatch sw;
+    size_t count = m_db->size();
 
+    while (m_loaded < count && m_active) {
+        size_t end = m_loaded + BATCH_SIZE;
+        if (end > count) {
+            end = count;
+        }
 
+        TrackInfoBatch* batch = new TrackInfoBatch;
+        batch->stored = true;
+        batch->tracks.resize(end - m_loaded);
+        for (size_t i = m_loaded; i < end; i++) {
+            m_db->getTrackInfo(i, batch->tracks[i - m_loaded]);
+        }
+        batch->prepare();
+        m_loaded = end;
+
+        // The TrackTable deletes the batch in onAddTrackInfo().
+        wxCommandEvent event(naviDirTraversedEvent);
+        event.SetClientObject(batch);
+        event.SetExtraLong(m_generation);
+        m_parent->AddPendingEvent(event);
+
+        postProgress(false);
+    }
+
+    if (!m_active) {
+        return 0;
+    }
+
+    postProgress(true);
+    std::cout << "Loaded " << m_loaded << " tracks from the library database in "
+              << sw.Time() << " ms." << std::endl;
+    return 0;
+}
+
+void LibraryLoadThread::postProgress(bool done) {
+    ScanProgress* progress = new ScanProgress;
+    progress->filesFound = m_db->size();
+    progress->filesRead = m_loaded;
+    progress->done = done;
+    progress->recursive = true;
+    progress->stored = true;
+
+    // Deleted by the NaviMainFrame, see DirTraversalThread::postProgress().
+    wxCommandEvent event(naviScanProgressEvent);
+    event.SetClientObject(progress);
+    event.SetExtraLong(m_generation);
+    m_parent->AddPendingEvent(event);
+}
+
+//================================================================================
+
+DirListingHandle::DirListingHandle() :
+        m_active(true),
+        m_refs(1) {
+}
+
+DirListingHandle::~DirListingHandle() {
+}
+
+void DirListingHandle::addRef() {
+    wxMutexLocker lock(m_mutex);
+    m_refs++;
+}
+
+void DirListingHandle::release() {
+    bool last;
+    {
+        wxMutexLocker lock(m_mutex);
+        last = --m_refs == 0;
+    }
+    if (last) {
+        delete this;
+    }
+}
+
+void DirListingHandle::cancel() {
+    wxMutexLocker lock(m_mutex);
+    m_active = false;
+}
+
+bool DirListingHandle::isActive() {
+    wxMutexLocker lock(m_mutex);
+    return m_active;
+}
+
+bool DirListingHandle::post(wxEvtHandler* parent, wxEvent& event) {
+    // The DirBrowser cancels its listings before it's destroyed, which waits
+    // for this lock.
+    wxMutexLocker lock(m_mutex);
+    if (!m_active) {
+        return false;
+    }
+    parent->AddPendingEvent(event);
+    return true;
+}
+
+//================================================================================
+
+DirListingThread::DirListingThread(wxEvtHandler* parent, DirListingHandle* handle, const wxString& path, bool withFiles, long id) :
+        wxThread(wxTHREAD_DETACHED),
+        m_parent(parent),
+        m_handle(handle),
+        m_path(path),
+        m_withFiles(withFiles),
+        m_id(id) {
+    m_handle->addRef();
+}
+
+DirListingThread::~DirListingThread() {
+    m_handle->release();
+}
+
+wxThread::ExitCode DirListingThread::Entry() {
+    DirReader reader(m_path, m_withFiles);
+    DirListingChunk* chunk = new DirListingChunk;
+    wxStopWatch sinceLast;
+
+    bool more = reader.isOpened();
+    while (more && m_handle->isActive()) {
+        more = reader.read(chunk->entries, READ_STEP);
+        if (more && (chunk->entries.size() >= CHUNK_SIZE
+                || (!chunk->entries.empty() && sinceLast.Time() >= CHUNK_INTERVAL))) {
+            postChunk(chunk, false);
+            chunk = new DirListingChunk;
+            sinceLast.Start();
+        }
+    }
+
+    if (!m_handle->isActive()) {
+        delete chunk;
+        return 0;
+    }
+
+    // also when the directory couldn't be read, so the `Loading...' item goes.
+    postChunk(chunk, true);
+    return 0;
+}
+
+void DirListingThread::postChunk(DirListingChunk* chunk, bool done) {
+    chunk->done = done;
+
+    // The DirBrowser deletes the chunk in onDirListed().
+    wxCommandEvent event(naviDirListedEvent);
+    event.SetClientObject(chunk);
+    event.SetExtraLong(m_id);
+    if (!m_handle->post(m_parent, event)) {
+        delete chunk;
+    }
+}
 
 } //namespace navi 
 
@@ -21,8 +21,11 @@
 #define DIRBROWSER_HPP
 
 #include "audio.hpp"
+#include "librarydb.hpp"
 #include "main.hpp"
+#include "scanner.hpp"
 #include "tracktable.hpp"
+#include "watcher.hpp"
 
 #include <wx/wx.h>
 #include <wx/app.h>
@@ -35,6 +38,11 @@
 #include <wx/iconloc.h>
 #include <wx/artprov.h>
 #include <wx/dirdlg.h>
+#include <wx/stopwatch.h>
+#include <wx/timer.h>
+
+#include <map>
+#include <vector>
 
 #include <assert.h>
 
@@ -42,17 +50,61 @@ namespace navi {
 
 class NaviMainFrame;
 class DirTraversalThread;
+class DirListingThread;
+class DirListingHandle;
+class LibraryLoadThread;
 
+/**
+ * The data of every item in the DirBrowser. Everything needed to sort the items
+ * is worked out when the item is created, so sorting does no I/O at all.
+ */
 class DirBrowserItemData : public wxTreeItemData {
+public:
+    /// What the item is.
+    enum Kind {
+        KIND_DIR,
+        KIND_FILE,
+        /// The `Loading...' item of a directory which is still being read.
+        KIND_LOADING
+    };
+
 private:
 
     wxFileName m_fileName;
+
+    Kind m_kind;
+
+    /// See makeSortKey().
+    wxString m_sortKey;
 public:
-    DirBrowserItemData(const wxFileName& fileName);
+    /**
+     * Creates the item data.
+     *
+     * @param fileName The full path of the directory or file.
+     * @param kind Whether it's a directory or a file, as the listing told.
+     */
+    DirBrowserItemData(const wxFileName& fileName, Kind kind);
     ~DirBrowserItemData();
 
     const wxFileName& getFileName() const;
 
+    Kind getKind() const;
+
+    /**
+     * Returns the key to sort the item on, among the items of the same kind.
+     */
+    const wxString& getSortKey() const;
+
+    /**
+     * Makes a key which sorts names in `natural' order when compared as plain
+     * strings: case insensitive, and numbers by their value, so "CD 2" comes
+     * before "CD 10". Every run of digits is prefixed by its length (leading
+     * zeroes left out), so a longer number compares as the bigger one.
+     *
+     * @param name The name of the file or directory.
+     * @return The sort key.
+     */
+    static wxString makeSortKey(const wxString& name);
 };
 
 //==============================================================================
@@ -81,9 +133,53 @@ private:
     /// the UI get 'stuck', i.e. waiting until it's finished.
     DirTraversalThread* m_dirTraversalThread;
 
+    /// Turns the records of the LibraryDb into tracks, while the library is
+    /// being loaded.
+    LibraryLoadThread* m_libraryLoader;
+
+    /// Keeps an eye on the directory which is displayed in the TrackTable, so
+    /// changes on disk show up without re-reading everything.
+    DirWatcher* m_watcher;
+
+    /// Threads which were told to stop, but may still be busy (for instance
+    /// waiting for a slow file). They are deleted by onReapThreads() once they
+    /// have finished, so the UI never has to wait for them.
+    std::vector<wxThread*> m_abandoned;
+
+    /// Periodically calls onReapThreads() while there are abandoned threads.
+    wxTimer m_reapTimer;
+
+    /// Incremented for every traversal. The events of a traversal carry its
+    /// generation, so the TrackTable can drop events of an abandoned one.
+    long m_generation;
+
     /// The Navi mainframe parent, top level window.
     NaviMainFrame* m_mainFrame;
 
+    /// A directory which is being read by a DirListingThread.
+    struct PendingListing {
+        /// Shared with the thread reading the directory, which is detached.
+        DirListingHandle* handle;
+        /// The expanded item.
+        wxTreeItemId item;
+        /// Its `Loading...' child.
+        wxTreeItemId loading;
+    };
+
+    /// The directories being read, by the id of the listing.
+    std::map<long, PendingListing> m_listings;
+
+    /// The id of the latest listing. The events of a listing carry its id.
+    long m_lastListing;
+
+    /// Whether the TrackTable displays the library (see activateLibrary()).
+    bool m_libraryShown;
+
+    /// Whether the displayed library is complete: the LibraryLoadThread or
+    /// the DirTraversalThread is done with it. Only a complete library may be
+    /// saved.
+    bool m_libraryComplete;
+
     /**
      * This function will be invoked as a callback by the wxTreeCtrl.
      * When an item is collapsed, this will delete children of the children
@@ -97,8 +193,9 @@ private:
 
     /**
      * This callback function is invoked by the wxTreeCtrl parent, as soon
-     * as an item is expanded. After expansion, the children of the children
-     * of that item are fetched, and added at runtime to the wxTreeCtrl.
+     * as an item is expanded. The directory is read by a DirListingThread, so
+     * a slow disk doesn't freeze the UI. Until it's done, the item shows a
+     * `Loading...' child.
      *
      * @param event The wxTreeEvent with information about the wxTreeItemId
      *  and such which generate that event.
@@ -117,6 +214,8 @@ private:
     /**
      * Compares child elements. Directories get prevalence, then files. 
      * This function therefore makes sure that the dirs get displayed first.
+     * Items of the same kind are in natural order (see
+     * DirBrowserItemData::makeSortKey()).
      * This is an overridden function from the wxTreeCtrl class.
      * 
      * @param one The first tree item.
@@ -127,21 +226,101 @@ private:
     int OnCompareItems(const wxTreeItemId& one, const wxTreeItemId& two);
 
     /**
-     * Adds children to a certain parent, by checking the DirBrowserItemData's
-     * path etc.
+     * Adds children to a certain parent.
      *
      * @param parent The parent to add children to.
+     * @param entries The entries of the parent's directory.
      */
-    void addChildrenToDir(wxTreeItemId& parent);
+    void addChildrenToDir(const wxTreeItemId& parent, const std::vector<DirEntry>& entries);
+
+    /**
+     * Starts a DirListingThread to read the directory of an item, and adds
+     * the `Loading...' child to it.
+     *
+     * @param item The item which is expanded.
+     */
+    void startListing(const wxTreeItemId& item);
+
+    /**
+     * Stops reading the directories of an item and of all items below it.
+     * Must be called before these items are deleted.
+     *
+     * @param item The item, or an invalid item to stop all listings.
+     */
+    void cancelListings(const wxTreeItemId& item);
+
+    /**
+     * Adds the entries of a DirListingChunk to the item it was read for.
+     * Chunks of cancelled listings are dropped.
+     *
+     * @param event The naviDirListedEvent.
+     */
+    void onDirListed(wxCommandEvent& event);
 
     /**
      * Initializes icons for this wxTreeCtrl.
      */
     void initIcons();
 
+    /**
+     * Stops the running DirTraversalThread (if any), clears the TrackTable and
+     * starts a new thread to read the given path.
+     *
+     * @param path The directory to read.
+     * @param recursive Whether to read all subdirectories too.
+     */
+    void startTraversal(const wxFileName& path, bool recursive);
+
+    /**
+     * Starts a DirWatcher for the displayed directory.
+     *
+     * @param path The directory.
+     * @param recursive Whether to watch all subdirectories too.
+     */
+    void startWatcher(const wxFileName& path, bool recursive);
+
+    /**
+     * Displays the library from the LibraryDb, when it has one of the current
+     * base directory. The tracks are loaded by a LibraryLoadThread. Changes on
+     * disk are watched from then on.
+     *
+     * @return false if there's no usable database, and the library must be
+     *  read from disk.
+     */
+    bool loadLibrary();
+
+    /**
+     * Tells the DirTraversalThread, the LibraryLoadThread and the DirWatcher
+     * (if any) to stop, and hands them to the reaper instead of waiting for
+     * them.
+     */
+    void abandonThreads();
+
+    /**
+     * Hands a thread which has been told to stop (or is about to finish) to
+     * the reaper.
+     *
+     * @param thread The thread.
+     */
+    void abandonThread(wxThread* thread);
+
+    /**
+     * Deletes the abandoned threads which have finished. Invoked by the
+     * m_reapTimer.
+     *
+     * @param event The timer event.
+     */
+    void onReapThreads(wxTimerEvent& event);
+
 public:
     static const wxWindowID ID_NAVI_DIR_BROWSER = 1;
 
+    /// ID of the m_reapTimer.
+    static const int ID_REAP_TIMER = 1040;
+
+    /// Interval of the m_reapTimer, in milliseconds.
+    static const int REAP_INTERVAL = 250;
+
     DirBrowser(wxWindow* parent, NaviMainFrame* frame);
     ~DirBrowser();
 
@@ -170,6 +349,30 @@ public:
      */
     void setFilesVisible(bool visible);
 
+    /**
+     * Starts playing the whole library: all files in the base directory and
+     * all of its subdirectories. The library is taken from the LibraryDb
+     * when possible. Otherwise, or when the library is already displayed,
+     * it's read into the TrackTable from disk.
+     */
+    void activateLibrary();
+
+    /**
+     * Must be called when the DirTraversalThread of the library has read the
+     * whole tree, or the LibraryLoadThread has loaded all of it. The library
+     * is complete from then on, and saved when it has changed.
+     */
+    void libraryRead();
+
+    /**
+     * Writes the displayed library to the LibraryDb, when it has changed
+     * since it was read or loaded. Nothing happens when a single directory
+     * is displayed, or when the library is still being read: quitting halfway
+     * must not leave a partial library behind, which would be loaded as the
+     * whole one next time.
+     */
+    void saveLibrary();
+
     //void getFilesFromCurrentDi
 
     // wxWidgets macro: declare the event table... duh
@@ -187,8 +390,12 @@ private:
     DirBrowser* m_browser;
 
     void onBrowseNewDir(wxCommandEvent& event);
+
+    /// Reads the whole library into the TrackTable.
+    void onPlayLibrary(wxCommandEvent& event);
 public:
     static const short ID_BROWSE_DIR = 1030; 
+    static const short ID_PLAY_LIBRARY = 1031;
 
     DirBrowserContainer(wxWindow* parent, NaviMainFrame* frame);
 
@@ -200,6 +407,27 @@ public:
 
 //================================================================================
 
+/**
+ * The progress of a DirTraversalThread, used as the client object of the
+ * naviScanProgressEvent.
+ */
+class ScanProgress : public wxClientData {
+public:
+    /// Amount of addable files found so far.
+    size_t filesFound;
+    /// Amount of files read so far.
+    size_t filesRead;
+    /// Whether the whole directory (tree) has been read.
+    bool done;
+    /// Whether this was a recursive (library) scan.
+    bool recursive;
+    /// Whether the tracks are loaded from the LibraryDb, instead of being
+    /// read from disk.
+    bool stored;
+};
+
+//================================================================================
+
 /**
  * The DirTraversalThread is a joinable (not detached) thread to update the user interface
  * with new track infos. If we don't update the UI in another thread, the UI would
@@ -211,9 +439,13 @@ public:
  * has finished doing its work, and calling functions on the created instance will
  * then most certainly invoke terrorist attacks on the application.
  *
+ * The actual tag reading is done by a TrackScanner, which uses a few worker
+ * threads of its own (see Preferences::SCAN_THREADS). The results still arrive
+ * at the TrackTable in the order in which the files were found.
+ *
  * TODO: fer chrissake rename this thing. It's so generic.
  */
-class DirTraversalThread : public wxThread, wxDirTraverser {
+class DirTraversalThread : public wxThread, wxDirTraverser, public ScanListener {
 private:
     /// The tracktable parent. We will be add pending events to this wxWindow.
     TrackTable* m_parent;
@@ -224,17 +456,82 @@ private:
     /// Whether this thread should be active or not. This value is polled
     bool m_active;
 
+    /// The generation of this traversal, set on every posted event.
+    long m_generation;
+
+    /// Whether to descend into subdirectories (library mode).
+    bool m_recursive;
+
+    /// Full paths of found files which have not been read yet.
     wxArrayString m_files;
 
+    /// Amount of addable files found so far.
+    size_t m_filesFound;
+
+    /// Amount of files of which the tags were read so far.
+    size_t m_filesRead;
+
+    /// Amount of tracks posted to the TrackTable so far.
+    size_t m_tracksPosted;
+
+    /// False as soon as one of the scans was aborted.
+    bool m_completed;
+
+    /**
+     * Reads the tags of the files in m_files, and clears it afterwards.
+     */
+    void scanFiles();
+
+    /**
+     * Posts a ScanProgress event, which ends up in the NaviMainFrame.
+     *
+     * @param done Whether this is the final progress event.
+     */
+    void postProgress(bool done);
+
+    /// Reads the tags of the found files, using a few threads.
+    TrackScanner m_scanner;
+
+    /// Tracks which have been read, but are not posted to the TrackTable yet.
+    TrackInfoBatch* m_batch;
+
+    /// Time since the last batch was posted.
+    wxStopWatch m_batchTimer;
+
+    /// Posts the current batch (if any) to the TrackTable.
+    void postBatch();
+
 public:
+    /// Amount of tracks in one batch. Batches grow as more tracks have been
+    /// posted (up to MAX_BATCH_SIZE), to keep merging them into a large list
+    /// cheap.
+    static const size_t BATCH_SIZE = 64;
+
+    /// Upper limit of the batch size.
+    static const size_t MAX_BATCH_SIZE = 4096;
+
+    /// In library mode, the amount of found files to read in one go, so we
+    /// don't have to find all files of a huge tree before showing anything.
+    static const size_t SCAN_CHUNK = 1024;
+
+    /// Maximum amount of milliseconds tracks are held back in a batch.
+    static const long BATCH_INTERVAL = 100;
+
     /**
      * Creates the DirTraversalThread, with the 'parent' TrackTable (to add pending
      * events to) and the selected path to get a dir listing from.
      *
      * @param parent The TrackTable parent.
      * @param selectedPath The path to get a listing from.
+     * @param generation The generation of the traversal (see TrackTable::setGeneration()).
+     * @param recursive When true, all files in all subdirectories are read too.
+     */
+    DirTraversalThread(TrackTable* parent, const wxFileName& selectedPath, long generation, bool recursive = false);
+
+    /**
+     * Destructor, deletes a batch which has not been posted.
      */
-    DirTraversalThread(TrackTable* parent, const wxFileName& selectedPath);
+    ~DirTraversalThread();
 
     /**
      * Sets the 'activity' state of this thread. This is only useful right now
@@ -251,10 +548,232 @@ public:
      */
     virtual wxThread::ExitCode Entry(); 
 
+    /**
+     * Override from ScanListener. Adds the info to the current batch, which is
+     * posted to the TrackTable when it's full or old enough.
+     */
+    virtual void trackScanned(size_t index, TrackInfo* info) throw();
+
+    /**
+     * Override from ScanListener. Posts the current batch, so tracks don't
+     * linger while the next file takes long to read.
+     */
+    virtual void scanStalled() throw();
+
     virtual wxDirTraverseResult OnFile(const wxString& filename);
     virtual wxDirTraverseResult OnDir(const wxString& dirname);
 };
 
+//================================================================================
+
+/**
+ * Loads the library from the LibraryDb, so the UI doesn't freeze while the
+ * records of a large library are turned into tracks. The tracks are posted to
+ * the TrackTable in prepared batches (see TrackInfoBatch::prepare()), followed
+ * by ScanProgress events, just like a DirTraversalThread does.
+ *
+ * Like the DirTraversalThread, it's a joinable thread: stop it with
+ * setActive(false).
+ */
+class LibraryLoadThread : public wxThread {
+private:
+    /// The TrackTable to post the batches to.
+    TrackTable* m_parent;
+
+    /// The opened database, deleted by the thread.
+    LibraryDb* m_db;
+
+    /// The generation of the load, set on every posted event.
+    long m_generation;
+
+    /// Polled by the thread, false to stop.
+    bool m_active;
+
+    /// Amount of tracks posted so far.
+    size_t m_loaded;
+
+    /**
+     * Posts a ScanProgress event, which ends up in the NaviMainFrame.
+     *
+     * @param done Whether this is the final progress event.
+     */
+    void postProgress(bool done);
+
+public:
+    /// Amount of tracks in one batch.
+    static const size_t BATCH_SIZE = 4096;
+
+    /**
+     * Creates the thread.
+     *
+     * @param parent The TrackTable to post the batches to.
+     * @param db The opened database. The thread takes it over.
+     * @param generation The generation of the load (see TrackTable::setGeneration()).
+     */
+    LibraryLoadThread(TrackTable* parent, LibraryDb* db, long generation);
+
+    /**
+     * Destructor, closes the database.
+     */
+    ~LibraryLoadThread();
+
+    /**
+     * Sets the activity state. Set it to false to stop the thread.
+     */
+    void setActive(bool active);
+
+    /**
+     * Override from wxThread. Loads the tracks.
+     */
+    virtual wxThread::ExitCode Entry();
+};
+
+//================================================================================
+
+/**
+ * A part of a directory listing, used as the client object of the
+ * naviDirListedEvent posted by the DirListingThread to the DirBrowser.
+ */
+class DirListingChunk : public wxClientData {
+public:
+    /// The entries read since the previous chunk.
+    std::vector<DirEntry> entries;
+
+    /// Whether this is the last chunk of the listing.
+    bool done;
+};
+
+//================================================================================
+
+/**
+ * Shared by a DirListingThread and the DirBrowser which started it. Once the
+ * DirBrowser cancels the listing, the thread doesn't post to it anymore, so
+ * the DirBrowser may be destroyed while the thread is still running. Both hold
+ * a reference, and the last one to release it deletes it.
+ */
+class DirListingHandle {
+private:
+    /// Guards the other members.
+    wxMutex m_mutex;
+
+    /// False once the listing is cancelled.
+    bool m_active;
+
+    /// Amount of references.
+    int m_refs;
+
+    /// Use release().
+    ~DirListingHandle();
+
+public:
+    /**
+     * Creates an active handle, with one reference.
+     */
+    DirListingHandle();
+
+    /**
+     * Adds a reference.
+     */
+    void addRef();
+
+    /**
+     * Releases a reference. The handle is deleted when it was the last one.
+     */
+    void release();
+
+    /**
+     * Cancels the listing: nothing is posted to the DirBrowser from now on.
+     */
+    void cancel();
+
+    /**
+     * @return false when the listing is cancelled.
+     */
+    bool isActive();
+
+    /**
+     * Posts an event to the DirBrowser, unless the listing is cancelled. The
+     * DirBrowser can't go away while this is busy.
+     *
+     * @param parent The DirBrowser.
+     * @param event The event.
+     * @return false when the listing is cancelled, and nothing was posted.
+     */
+    bool post(wxEvtHandler* parent, wxEvent& event);
+};
+
+//================================================================================
+
+/**
+ * Reads one directory for the DirBrowser, so expanding an item on a slow disk
+ * (or an automounted share which has to wake up first) doesn't freeze the UI.
+ * The entries are posted in chunks, so the first ones of a huge directory show
+ * up while the rest is still being read.
+ *
+ * Unlike the other threads, it's detached. It may be stuck in opendir() or
+ * readdir() on a hung mount for good, so nobody waits for it, also not when
+ * Navi quits. The listing is stopped with DirListingHandle::cancel(), after
+ * which the thread never touches the DirBrowser again.
+ */
+class DirListingThread : public wxThread {
+private:
+    /// The DirBrowser to post the chunks to.
+    wxEvtHandler* m_parent;
+
+    /// Shared with the DirBrowser, released when the thread is done.
+    DirListingHandle* m_handle;
+
+    /// The directory to read.
+    wxString m_path;
+
+    /// Whether files are listed too.
+    bool m_withFiles;
+
+    /// The id of the listing, set on every posted event.
+    long m_id;
+
+    /**
+     * Posts a chunk to the DirBrowser, which deletes it. When the listing is
+     * cancelled, the chunk is deleted right here.
+     *
+     * @param chunk The chunk.
+     * @param done Whether it's the last chunk.
+     */
+    void postChunk(DirListingChunk* chunk, bool done);
+
+public:
+    /// Amount of entries read in between checks of the handle.
+    static const size_t READ_STEP = 64;
+
+    /// Maximum amount of entries in one chunk.
+    static const size_t CHUNK_SIZE = 1024;
+
+    /// Maximum amount of milliseconds entries are held back in a chunk.
+    static const long CHUNK_INTERVAL = 100;
+
+    /**
+     * Creates the thread.
+     *
+     * @param parent The DirBrowser to post the chunks to.
+     * @param handle Shared with the DirBrowser. The thread adds its own
+     *  reference.
+     * @param path The directory to read.
+     * @param withFiles false to only list the directories.
+     * @param id The id of the listing, set on every posted event.
+     */
+    DirListingThread(wxEvtHandler* parent, DirListingHandle* handle, const wxString& path, bool withFiles, long id);
+
+    /**
+     * Releases the reference to the handle.
+     */
+    ~DirListingThread();
+
+    /**
+     * Override from wxThread. Reads the directory.
+     */
+    virtual wxThread::ExitCode Entry();
+};
+
 } //namespace navi 
 
 #endif // DIRBROWSER_HPP
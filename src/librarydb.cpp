@@ -0,0 +1,259 @@
+//      librarydb.cpp
+//
+//      Copyright 2012 Kevin Pors <krpors@users.sf.net>
+//
+//      This program is free software; you can redistribute it and/or modify
+//      it under the terms of the GNU General Public License as published by
+//      the Free Software Foundation; either version 2 of the License, or
+//      (at your option) any later version.
+//
+//      This program is distributed in the hope that it will be useful,
+//      but WITHOUT ANY WARRANTY; without even the implied warranty of
+//      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//      GNU General Public License for more details.
+//
+//      You should have received a copy of the GNU General Public License
+//      along with this program; if not, write to the Free Software
+//      Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+//      MA 02110-1301, USA.
+
+#include "librarydb.hpp"
+#include "misc.hpp"
+
+#include <map>
+#include <cstring>
+#include <iostream>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+namespace navi {
+
+/// Prefix of the locations of files.
+static const char* FILE_URI_PREFIX = "file://";
+
+/**
+ * Collects the strings of the string table, and stores every distinct string
+ * only once.
+ */
+class StringTable {
+private:
+    std::string m_data;
+    std::map<std::string, uint32_t> m_offsets;
+public:
+    StringTable() {
+        // offset 0 is the empty string.
+        m_data += '\0';
+        m_offsets[std::string()] = 0;
+    }
+
+    uint32_t add(const std::string& str) {
+        std::map<std::string, uint32_t>::iterator it = m_offsets.find(str);
+        if (it != m_offsets.end()) {
+            return it->second;
+        }
+        uint32_t offset = m_data.size();
+        m_data += str;
+        m_data += '\0';
+        m_offsets[str] = offset;
+        return offset;
+    }
+
+    uint32_t add(const wxString& str) {
+        return add(std::string(str.mb_str(wxConvUTF8)));
+    }
+
+    const std::string& getData() const {
+        return m_data;
+    }
+};
+
+//================================================================================
+
+const wxString LibraryDb::DB_FILE = wxT("library.db");
+
+const char LibraryDb::FILE_MAGIC[8] = { 'N', 'A', 'V', 'I', 'L', 'I', 'B', '\0' };
+
+LibraryDb::LibraryDb() :
+        m_data(NULL),
+        m_size(0),
+        m_records(NULL),
+        m_strings(NULL),
+        m_stringsSize(0),
+        m_count(0) {
+}
+
+LibraryDb::~LibraryDb() {
+    close();
+}
+
+wxFileName LibraryDb::getDefaultFile() {
+    // same location as the preferences and the tag cache.
+    wxStandardPathsBase& wxsp = wxStandardPaths::Get();
+    wxFileName naviDir(wxsp.GetUserConfigDir(), wxT(".navi"));
+    if (!wxDirExists(naviDir.GetFullPath())) {
+        wxMkdir(naviDir.GetFullPath());
+    }
+
+    return wxFileName(naviDir.GetFullPath(), DB_FILE);
+}
+
+bool LibraryDb::open(const wxString& file) {
+    close();
+
+    int fd = ::open(file.fn_str(), O_RDONLY);
+    if (fd == -1) {
+        return false;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size < static_cast<off_t>(sizeof(Header))) {
+        ::close(fd);
+        return false;
+    }
+
+    void* data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    // the mapping stays valid without the descriptor.
+    ::close(fd);
+    if (data == MAP_FAILED) {
+        std::cerr << "Failed to map the library database." << std::endl;
+        return false;
+    }
+    m_data = static_cast<const char*>(data);
+    m_size = st.st_size;
+
+    const Header* header = reinterpret_cast<const Header*>(m_data);
+    bool valid = memcmp(header->magic, FILE_MAGIC, sizeof(FILE_MAGIC)) == 0
+        && header->version == FILE_VERSION
+        && header->tagCount == TrackInfo::TAG_COUNT
+        && header->recordSize == sizeof(Record)
+        && header->recordsOffset >= sizeof(Header)
+        && header->recordsOffset % sizeof(uint32_t) == 0
+        && header->recordsOffset <= m_size
+        && header->trackCount <= (m_size - header->recordsOffset) / sizeof(Record)
+        && header->stringsOffset <= m_size
+        && header->stringsSize > 0
+        && header->stringsSize <= m_size - header->stringsOffset;
+    // Every string must end within the table, so the last byte must be a NUL.
+    if (valid) {
+        valid = m_data[header->stringsOffset + header->stringsSize - 1] == '\0';
+    }
+    if (!valid) {
+        std::cerr << "Library database has an unknown format, ignoring it." << std::endl;
+        close();
+        return false;
+    }
+
+    m_records = reinterpret_cast<const Record*>(m_data + header->recordsOffset);
+    m_count = header->trackCount;
+    m_strings = m_data + header->stringsOffset;
+    m_stringsSize = header->stringsSize;
+    m_base = wxString(getString(header->base), wxConvUTF8);
+
+    // The tracks are read from the start to the end when the library is
+    // displayed.
+    madvise(const_cast<char*>(m_data), m_size, MADV_SEQUENTIAL);
+    return true;
+}
+
+void LibraryDb::close() {
+    if (m_data != NULL) {
+        munmap(const_cast<char*>(m_data), m_size);
+    }
+    m_data = NULL;
+    m_size = 0;
+    m_records = NULL;
+    m_strings = NULL;
+    m_stringsSize = 0;
+    m_count = 0;
+    m_base.Clear();
+}
+
+bool LibraryDb::isOpen() const {
+    return m_data != NULL;
+}
+
+const wxString& LibraryDb::getBase() const {
+    return m_base;
+}
+
+size_t LibraryDb::size() const {
+    return m_count;
+}
+
+const char* LibraryDb::getString(uint32_t offset) const {
+    return offset < m_stringsSize ? m_strings + offset : m_strings;
+}
+
+void LibraryDb::getTrackInfo(size_t index, TrackInfo& info) const {
+    const Record& record = m_records[index];
+
+    wxString uri = wxT("file://");
+    uri << wxString(getString(record.path), wxConvUTF8);
+    info.setLocation(uri);
+    info.setDurationSeconds(record.duration, (record.flags & FLAG_EXACT_DURATION) != 0);
+
+    for (int t = 0; t < TrackInfo::TAG_COUNT; t++) {
+        const char* value = getString(record.tags[t]);
+        if (*value != '\0') {
+            info.set(static_cast<TrackInfo::Tag>(t), wxString(value, wxConvUTF8));
+        }
+    }
+}
+
+bool LibraryDb::write(const wxString& file, const wxString& base, const std::vector<TrackInfo>& tracks) {
+    StringTable strings;
+    std::vector<Record> records;
+    records.reserve(tracks.size());
+
+    size_t prefixLen = strlen(FILE_URI_PREFIX);
+    for (size_t i = 0; i < tracks.size(); i++) {
+        const TrackInfo& info = tracks[i];
+        std::string location(info.getLocation().mb_str(wxConvUTF8));
+        if (location.compare(0, prefixLen, FILE_URI_PREFIX) != 0) {
+            // only files belong in the library.
+            continue;
+        }
+
+        Record record;
+        memset(&record, 0, sizeof(record));
+        record.path = strings.add(location.substr(prefixLen));
+        for (int t = 0; t < TrackInfo::TAG_COUNT; t++) {
+            record.tags[t] = strings.add(info.get(static_cast<TrackInfo::Tag>(t)));
+        }
+        record.duration = info.getDurationSeconds();
+        record.flags = info.isDurationExact() ? FLAG_EXACT_DURATION : 0;
+        records.push_back(record);
+    }
+
+    Header header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, FILE_MAGIC, sizeof(FILE_MAGIC));
+    header.version = FILE_VERSION;
+    header.tagCount = TrackInfo::TAG_COUNT;
+    header.recordSize = sizeof(Record);
+    header.trackCount = records.size();
+    header.base = strings.add(base);
+    header.recordsOffset = sizeof(Header);
+    header.stringsOffset = header.recordsOffset + records.size() * sizeof(Record);
+    header.stringsSize = strings.getData().size();
+
+    SyncedTempFile out(file);
+    bool ok = out.isOpened()
+        && out.write(&header, sizeof(header))
+        && (records.empty() || out.write(&records[0], records.size() * sizeof(Record)))
+        && out.write(strings.getData().data(), strings.getData().size())
+        && out.commit();
+    if (!ok) {
+        std::cerr << "Failed to write the library database." << std::endl;
+        return false;
+    }
+
+    std::cout << "Library database: " << records.size() << " tracks, "
+              << header.stringsOffset + header.stringsSize << " bytes." << std::endl;
+    return true;
+}
+
+} // namespace navi
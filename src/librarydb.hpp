@@ -0,0 +1,208 @@
+//      librarydb.hpp
+//
+//      Copyright 2012 Kevin Pors <krpors@users.sf.net>
+//
+//      This program is free software; you can redistribute it and/or modify
+//      it under the terms of the GNU General Public License as published by
+//      the Free Software Foundation; either version 2 of the License, or
+//      (at your option) any later version.
+//
+//      This program is distributed in the hope that it will be useful,
+//      but WITHOUT ANY WARRANTY; without even the implied warranty of
+//      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//      GNU General Public License for more details.
+//
+//      You should have received a copy of the GNU General Public License
+//      along with this program; if not, write to the Free Software
+//      Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+//      MA 02110-1301, USA.
+
+#ifndef LIBRARYDB_HPP
+#define LIBRARYDB_HPP
+
+#include "audio.hpp"
+
+#include <string>
+#include <vector>
+
+#include <stdint.h>
+
+#include <wx/wx.h>
+#include <wx/file.h>
+#include <wx/filename.h>
+#include <wx/stdpaths.h>
+
+namespace navi {
+
+//================================================================================
+
+/**
+ * The LibraryDb is the library (all tracks below the base directory) as it was
+ * last displayed, stored in ~/.navi so library mode can start without reading
+ * the whole tree again.
+ *
+ * The file is mapped into memory as a whole. Nothing is parsed when it's
+ * opened, apart from a check of the header, so it's cheap to find out whether
+ * the database can be used. The tracks are turned into TrackInfos one by one
+ * with getTrackInfo(), which the LibraryLoadThread does in the background. The
+ * layout is:
+ *
+ *  - a Header, with the version and the positions of the other parts;
+ *  - the track Records, all of the same size;
+ *  - the string table: NUL terminated UTF-8 strings, referred to by their
+ *    offset in the table. Offset 0 is the empty string. Equal strings (the
+ *    artist and album of a whole album, mostly) are stored once.
+ *
+ * Numbers are stored in the byte order of the machine, so the file can't be
+ * copied to a machine with another one. It's a cache after all: when the file
+ * is missing or can't be used, the library is simply read again.
+ *
+ * The file is written to a temporary file first, which is renamed over the old
+ * one when it's complete and on the disk, like the TagCache does (see
+ * SyncedTempFile).
+ */
+class LibraryDb {
+private:
+    /// The start of the file.
+    struct Header {
+        /// FILE_MAGIC.
+        char magic[8];
+        /// FILE_VERSION.
+        uint32_t version;
+        /// TrackInfo::TAG_COUNT when written.
+        uint32_t tagCount;
+        /// sizeof(Record) when written.
+        uint32_t recordSize;
+        /// Amount of records.
+        uint32_t trackCount;
+        /// Offset in the string table of the base directory of the library.
+        uint32_t base;
+        /// Zero.
+        uint32_t reserved;
+        /// Position of the first record in the file.
+        uint64_t recordsOffset;
+        /// Position of the string table in the file.
+        uint64_t stringsOffset;
+        /// Size of the string table in bytes.
+        uint64_t stringsSize;
+    };
+
+    /// A single track.
+    struct Record {
+        /// Offset of the full path of the file.
+        uint32_t path;
+        /// Offsets of the tags, in the order of TrackInfo::Tag.
+        uint32_t tags[TrackInfo::TAG_COUNT];
+        /// Duration in seconds, negative when unknown.
+        int32_t duration;
+        /// FLAG_EXACT_DURATION.
+        uint32_t flags;
+    };
+
+    /// Set in Record::flags when the duration is exact.
+    static const uint32_t FLAG_EXACT_DURATION = 1;
+
+    /// The mapped file, NULL when closed.
+    const char* m_data;
+
+    /// Size of the mapping.
+    size_t m_size;
+
+    /// The records, inside the mapping.
+    const Record* m_records;
+
+    /// The string table, inside the mapping.
+    const char* m_strings;
+
+    /// Size of the string table.
+    size_t m_stringsSize;
+
+    /// Amount of records.
+    size_t m_count;
+
+    /// The base directory of the library.
+    wxString m_base;
+
+    /**
+     * Returns a string of the string table. Offsets outside of the table (a
+     * damaged file) give an empty string.
+     */
+    const char* getString(uint32_t offset) const;
+
+public:
+    /// The file name of the database, inside the ~/.navi directory.
+    static const wxString DB_FILE;
+
+    /// The first bytes of the file.
+    static const char FILE_MAGIC[8];
+
+    /// The version of the layout. Bump it when anything changes.
+    static const uint32_t FILE_VERSION = 1;
+
+    /**
+     * Creates a closed database.
+     */
+    LibraryDb();
+
+    /**
+     * Unmaps the file, if open.
+     */
+    ~LibraryDb();
+
+    /**
+     * Returns the location of the database file (~/.navi/library.db). The
+     * ~/.navi directory is created when it doesn't exist.
+     */
+    static wxFileName getDefaultFile();
+
+    /**
+     * Maps a database file into memory, and checks whether it can be used.
+     *
+     * @param file The file.
+     * @return false if the file doesn't exist, or has another version or
+     *  layout, or is damaged.
+     */
+    bool open(const wxString& file);
+
+    /**
+     * Unmaps the file.
+     */
+    void close();
+
+    /**
+     * @return Whether a file is opened.
+     */
+    bool isOpen() const;
+
+    /**
+     * Returns the base directory the library was read from.
+     */
+    const wxString& getBase() const;
+
+    /**
+     * Returns the amount of tracks.
+     */
+    size_t size() const;
+
+    /**
+     * Fills a TrackInfo with a track, the way the TrackScanner would have.
+     *
+     * @param index The index of the track, below size().
+     * @param info The TrackInfo to fill.
+     */
+    void getTrackInfo(size_t index, TrackInfo& info) const;
+
+    /**
+     * Writes a database file.
+     *
+     * @param file The file to write.
+     * @param base The base directory the library was read from.
+     * @param tracks The tracks (with file:// locations).
+     * @return false if writing the file failed.
+     */
+    static bool write(const wxString& file, const wxString& base, const std::vector<TrackInfo>& tracks);
+};
+
+} // namespace navi
+
+#endif // LIBRARYDB_HPP
@@ -23,6 +23,10 @@
 
 namespace navi {
 
+// Declared in misc.cpp
+extern const wxEventType naviScanProgressEvent;
+extern const wxEventType naviPipelineNotifyEvent;
+
 class Test {
 private:
     GenericPipeline* m_p;
@@ -47,26 +51,40 @@ public:
 //==============================================================================
 //
 bool NaviApp::OnInit() {
+    StartupTrace::start();
+
     // initialize the gstreamer api here:
     gst_init(NULL, NULL);
+    StartupTrace::mark(wxT("gstreamer"));
 
     wxInitAllImageHandlers();
 
     // Initialize default preferences crap here
     Preferences* prefs = Preferences::createInstance(); //should be done once
     wxConfigBase::Set(prefs);
+    StartupTrace::mark(wxT("preferences"));
 
-    // construct the main frame.
+    // construct the main frame. Anything it doesn't need to be displayed is
+    // done when it's on screen, see NaviMainFrame::initDeferred().
     NaviMainFrame* frame = new NaviMainFrame;
     frame->SetSize(800, 600);
     frame->Center();
     frame->Show();
     SetTopWindow(frame);
+    StartupTrace::mark(wxT("showing the main frame"));
 
     //Test* t = new Test;
     return true;
 }
 
+int NaviApp::OnRun() {
+    int status = wxApp::OnRun();
+    if (status == 0 && StartupTrace::isOverBudget()) {
+        return 1;
+    }
+    return status;
+}
+
 //==============================================================================
 
 SystrayIcon::SystrayIcon(NaviMainFrame* frame) :
@@ -88,7 +106,8 @@ END_EVENT_TABLE()
 NaviMainFrame::NaviMainFrame() :
         wxFrame((wxFrame*) NULL, wxID_ANY, wxT("Navi")),
         m_noteBook(NULL),
-        m_taskBarIcon(NULL) {
+        m_taskBarIcon(NULL),
+        m_deferredDone(false) {
     // create our menu here 
     initMenu();
 
@@ -98,9 +117,11 @@ NaviMainFrame::NaviMainFrame() :
     panelMain->SetSizer(sizer);
 
     m_navigation = new NavigationContainer(panelMain, this);
+    StartupTrace::mark(wxT("menu and navigation"));
 
     // bottom part:
     wxPanel* p = createBottom(panelMain);
+    StartupTrace::mark(wxT("browser and track table"));
 
     // Add the components to the sizer. Add a border of 5 px so the widgets aren't
     // 'attached' to the edges of the wxFrame itself (looks neater).
@@ -121,6 +142,25 @@ NaviMainFrame::NaviMainFrame() :
     // Push that event handler, otherwise events will not be propagated to
     // this new track status handler.
     PushEventHandler(m_trackStatusHandler);
+}
+
+NaviMainFrame::~NaviMainFrame() {
+    // must delete this pointer, or else the program will not exit.
+    if (m_taskBarIcon != NULL) {
+        delete m_taskBarIcon;
+    }
+}
+
+void NaviMainFrame::initDeferred() {
+    // Create the tag cache and the reader pool on the main thread, before any
+    // traversal thread gets the chance to do so. Nothing reads tags before
+    // the window is on screen.
+    TagCache::get();
+    TagReaderPool::get();
+    StartupTrace::mark(wxT("tag cache"));
+
+    m_streamBrowser->getStreamTable()->loadFromFile();
+    StartupTrace::mark(wxT("streams"));
 
     // create a systray icon.
     bool trayEnabled;
@@ -131,13 +171,16 @@ NaviMainFrame::NaviMainFrame() :
         wxIcon icon;
         icon.CopyFromBitmap(bm);
         m_taskBarIcon->SetIcon(icon, wxT("Navi - Hey, listen!"));
+        StartupTrace::mark(wxT("tray icon"));
     }
-}
 
-NaviMainFrame::~NaviMainFrame() {
-    // must delete this pointer, or else the program will not exit.
-    if (m_taskBarIcon != NULL) {
-        delete m_taskBarIcon;
+    // Display the library again when that's what was displayed last time. It
+    // comes from the library database, so this is quick.
+    bool libraryMode;
+    wxConfigBase::Get()->Read(Preferences::LIBRARY_MODE, &libraryMode, false);
+    if (libraryMode) {
+        m_dirBrowser->getDirBrowser()->activateLibrary();
+        StartupTrace::mark(wxT("library"));
     }
 }
 
@@ -176,13 +219,14 @@ wxPanel* NaviMainFrame::createDirBrowserPanel(wxWindow* parent) {
     m_dirBrowser->getDirBrowser()->setBase(directory);
     m_dirBrowser->getDirBrowser()->setFilesVisible(false);
 
-    // track table (right side)
-    m_trackTable = new TrackTable(split);
+    // track table (right side), with the filter box above it.
+    TrackTableContainer* tracks = new TrackTableContainer(split);
+    m_trackTable = tracks->getTrackTable();
 
     // FIXME: all of a sudden, setting the MINIMUM pane size to 20, explicitly
     // sets the actual pane size to 20... Thats why I increased it to 200, or else...
     split->SetMinimumPaneSize(200);
-    split->SplitVertically(m_dirBrowser, m_trackTable);
+    split->SplitVertically(m_dirBrowser, tracks);
 
     sizer->Add(split, wxSizerFlags(1).Expand());
     
@@ -232,6 +276,24 @@ void NaviMainFrame::onResize(wxSizeEvent& event) {
     event.Skip();
 }
 
+void NaviMainFrame::onIdle(wxIdleEvent& event) {
+    event.Skip();
+    if (m_deferredDone) {
+        return;
+    }
+    m_deferredDone = true;
+
+    // Idle events are only sent when there's nothing else to do, including
+    // painting, so the window is on screen now.
+    long shown = StartupTrace::mark(wxT("first paint"));
+    initDeferred();
+
+    if (StartupTrace::finish(shown)) {
+        // only started to time the startup. No questions asked.
+        Close(true);
+    }
+}
+
 void NaviMainFrame::onAbout(wxCommandEvent& event) {
     wxAboutDialogInfo info;
     info.SetName(wxT("Navi"));
@@ -276,10 +338,56 @@ NavigationContainer* NaviMainFrame::getNavigationContainer() const {
     return m_navigation;
 }
 
+StreamBrowserContainer* NaviMainFrame::getStreamBrowser() const {
+    return m_streamBrowser;
+}
+
+void NaviMainFrame::onScanProgress(wxCommandEvent& event) {
+    ScanProgress* progress = static_cast<ScanProgress*>(event.GetClientObject());
+    if (progress == NULL) {
+        return;
+    }
+    if (event.GetExtraLong() != getTrackTable()->getGeneration()) {
+        // progress of an abandoned traversal.
+        delete progress;
+        return;
+    }
+
+    wxString text;
+    if (progress->stored) {
+        if (progress->done) {
+            text = wxString::Format(wxT("Loaded %lu tracks from the library."), (unsigned long) progress->filesRead);
+        } else {
+            text = wxString::Format(wxT("Loading library: %lu of %lu tracks..."),
+                (unsigned long) progress->filesRead, (unsigned long) progress->filesFound);
+        }
+    } else if (progress->done) {
+        text = wxString::Format(wxT("Read %lu tracks."), (unsigned long) progress->filesRead);
+    } else if (progress->recursive) {
+        text = wxString::Format(wxT("Indexing library: read %lu of %lu files found so far..."),
+            (unsigned long) progress->filesRead, (unsigned long) progress->filesFound);
+    } else {
+        text = wxString::Format(wxT("Reading tags: %lu of %lu files..."),
+            (unsigned long) progress->filesRead, (unsigned long) progress->filesFound);
+    }
+    SetStatusText(text);
+
+    if (progress->done && progress->recursive) {
+        // the whole library has been read (or loaded), so keep it for next
+        // time. Nothing is written when it didn't change.
+        m_dirBrowser->getDirBrowser()->libraryRead();
+    }
+
+    // created on the heap by the DirTraversalThread.
+    delete progress;
+}
+
 void NaviMainFrame::onClose(wxCloseEvent& event) {
     if (!event.CanVeto()) {
         // must destroy window if CanVeto() returns false. See documentation of
         // wxCloseEvent.
+        TagCache::get().save();
+        m_dirBrowser->getDirBrowser()->saveLibrary();
         Destroy();
     } else {
         bool ask;
@@ -292,6 +400,8 @@ void NaviMainFrame::onClose(wxCloseEvent& event) {
         }
 
         // cleanup all stuff
+        TagCache::get().save();
+        m_dirBrowser->getDirBrowser()->saveLibrary();
         gst_deinit(); // not really necessary, but lets do it anyway.
         
         Destroy();
@@ -301,11 +411,13 @@ void NaviMainFrame::onClose(wxCloseEvent& event) {
 // Event table.
 BEGIN_EVENT_TABLE(NaviMainFrame, wxFrame)
     EVT_SIZE(NaviMainFrame::onResize)
+    EVT_IDLE(NaviMainFrame::onIdle)
     EVT_MENU(wxID_PREFERENCES, NaviMainFrame::onPreferences)
     EVT_MENU(wxID_ABOUT, NaviMainFrame::onAbout)
     EVT_MENU(wxID_EXIT, NaviMainFrame::onExit)
     EVT_ICONIZE(NaviMainFrame::onIconize)
     EVT_CLOSE(NaviMainFrame::onClose)
+    EVT_COMMAND(wxID_ANY, naviScanProgressEvent, NaviMainFrame::onScanProgress)
 END_EVENT_TABLE()
 
 //================================================================================
@@ -337,9 +449,36 @@ wxPanel* PreferencesDialog::createTopPanel(wxWindow* parent) {
     m_chkSortOnTrackNum = new wxCheckBox(panel, wxID_ANY, wxT("Automatically sort on tracknumber"));
     m_chkSortOnTrackNum->SetToolTip(wxT("When listing the files in a directory, attempt to automatically sort on track number (requires a valid track number tag)"));
 
+    wxBoxSizer* sizerThreads = new wxBoxSizer(wxHORIZONTAL);
+    wxStaticText* lblThreads = new wxStaticText(panel, wxID_ANY, wxT("Tag reading threads (0 = one per processor)"));
+    m_spinScanThreads = new wxSpinCtrl(panel, wxID_ANY);
+    m_spinScanThreads->SetRange(0, 64);
+    m_spinScanThreads->SetToolTip(wxT("The maximum amount of files of which the tags are read at the same time, when a directory is activated."));
+    sizerThreads->Add(lblThreads, wxSizerFlags().Center().Border(wxRIGHT, 5));
+    sizerThreads->Add(m_spinScanThreads);
+
+    wxBoxSizer* sizerBufferSize = new wxBoxSizer(wxHORIZONTAL);
+    wxStaticText* lblBufferSize = new wxStaticText(panel, wxID_ANY, wxT("Stream buffer size in KB (0 = default)"));
+    m_spinBufferSize = new wxSpinCtrl(panel, wxID_ANY);
+    m_spinBufferSize->SetRange(0, 65536);
+    m_spinBufferSize->SetToolTip(wxT("How much of an internet stream is buffered. Playback pauses when the buffer runs low, until it's full again."));
+    sizerBufferSize->Add(lblBufferSize, wxSizerFlags().Center().Border(wxRIGHT, 5));
+    sizerBufferSize->Add(m_spinBufferSize);
+
+    wxBoxSizer* sizerBufferDuration = new wxBoxSizer(wxHORIZONTAL);
+    wxStaticText* lblBufferDuration = new wxStaticText(panel, wxID_ANY, wxT("Stream buffer duration in seconds (0 = default)"));
+    m_spinBufferDuration = new wxSpinCtrl(panel, wxID_ANY);
+    m_spinBufferDuration->SetRange(0, 600);
+    m_spinBufferDuration->SetToolTip(wxT("How many seconds of an internet stream are buffered. The buffer is full when either the size or the duration is reached."));
+    sizerBufferDuration->Add(lblBufferDuration, wxSizerFlags().Center().Border(wxRIGHT, 5));
+    sizerBufferDuration->Add(m_spinBufferDuration);
+
     sizer->Add(m_chkMinimizeToTray);
     sizer->Add(m_chkAskOnExit);
     sizer->Add(m_chkSortOnTrackNum);
+    sizer->Add(sizerThreads, wxSizerFlags().Border(wxTOP, 5));
+    sizer->Add(sizerBufferSize, wxSizerFlags().Border(wxTOP, 5));
+    sizer->Add(sizerBufferDuration, wxSizerFlags().Border(wxTOP, 5));
 
     bool trayEnabled;
     wxConfigBase::Get()->Read(Preferences::MINIMIZE_TO_TRAY, &trayEnabled, false);
@@ -353,6 +492,17 @@ wxPanel* PreferencesDialog::createTopPanel(wxWindow* parent) {
     wxConfigBase::Get()->Read(Preferences::AUTO_SORT, &sortTrackNum, true);
     m_chkSortOnTrackNum->SetValue(sortTrackNum);
 
+    long scanThreads;
+    wxConfigBase::Get()->Read(Preferences::SCAN_THREADS, &scanThreads, 0L);
+    m_spinScanThreads->SetValue(scanThreads);
+
+    long bufferSize;
+    wxConfigBase::Get()->Read(Preferences::BUFFER_SIZE, &bufferSize, 256L);
+    m_spinBufferSize->SetValue(bufferSize);
+
+    long bufferDuration;
+    wxConfigBase::Get()->Read(Preferences::BUFFER_DURATION, &bufferDuration, 5L);
+    m_spinBufferDuration->SetValue(bufferDuration);
 
     return panel;
 }
@@ -376,6 +526,9 @@ void PreferencesDialog::onOK(wxCommandEvent& event) {
     prefs->Write(Preferences::MINIMIZE_TO_TRAY, m_chkMinimizeToTray->GetValue());
     prefs->Write(Preferences::ASK_ON_EXIT,      m_chkAskOnExit->GetValue());
     prefs->Write(Preferences::AUTO_SORT,        m_chkSortOnTrackNum->GetValue());
+    prefs->Write(Preferences::SCAN_THREADS,     (long) m_spinScanThreads->GetValue());
+    prefs->Write(Preferences::BUFFER_SIZE,      (long) m_spinBufferSize->GetValue());
+    prefs->Write(Preferences::BUFFER_DURATION,  (long) m_spinBufferDuration->GetValue());
 
     prefs->save();
 
@@ -393,7 +546,12 @@ END_EVENT_TABLE()
 
 TrackStatusHandler::TrackStatusHandler(NaviMainFrame* frame) throw() :
         m_mainFrame(frame),
-        m_pipeline(NULL) {
+        m_pipeline(NULL),
+        m_frameShown(true),
+        m_frameIconized(false),
+        m_frameActive(true),
+        m_pipelineEpoch(0),
+        m_stalled(false) {
 }
 
 Pipeline* TrackStatusHandler::getPipeline() const throw() {
@@ -446,6 +604,8 @@ void TrackStatusHandler::onPosChange(wxScrollEvent& event) {
         if (m_pipeline != NULL) {
             m_pipeline->seekSeconds(event.GetPosition());
             m_scrolling = false;
+            // show where we ended up without waiting for the interval.
+            m_pipeline->requestPosition();
         }
     }
 }
@@ -461,10 +621,10 @@ void TrackStatusHandler::onVolChange(wxScrollEvent& event) {
 void TrackStatusHandler::onTrackActivated(wxListEvent& event) {
     m_pipelineType = PIPELINE_TRACK;
 
-    // 'data' holds the selected index of the list control.
-    long data = event.GetData();    
+    // the event holds the activated row of the list control, which is not
+    // the same as the index of the track (the list may be sorted).
     TrackTable* tt = m_mainFrame->getTrackTable();
-    TrackInfo trax = tt->getTrackInfo(data);
+    TrackInfo trax = tt->getTrackInfo(tt->getTrackIndex(event.GetIndex()));
     m_playedTrack = trax;
 
     play();
@@ -481,20 +641,119 @@ void TrackStatusHandler::onStreamItemActivated(wxListEvent& event) {
     delete info;
 }
 
-void TrackStatusHandler::onTagRead(wxCommandEvent& event) {
-    // for now, just dont do anything when we're not a stream.
-    if (m_pipelineType != PIPELINE_STREAM) {
+void TrackStatusHandler::onFrameActivate(wxActivateEvent& event) {
+    m_frameActive = event.GetActive();
+    updatePositionInterval();
+    event.Skip();
+}
+
+void TrackStatusHandler::onFrameIconize(wxIconizeEvent& event) {
+    m_frameIconized = event.Iconized();
+    updatePositionInterval();
+    event.Skip();
+}
+
+void TrackStatusHandler::onFrameShow(wxShowEvent& event) {
+    m_frameShown = event.GetShow();
+    if (m_frameShown) {
+        // shown from the system tray icon, which doesn't restore it.
+        m_frameIconized = m_mainFrame->IsIconized();
+    }
+    updatePositionInterval();
+    event.Skip();
+}
+
+unsigned int TrackStatusHandler::getPositionInterval() const throw() {
+    if (!m_frameShown || m_frameIconized) {
+        return 0;
+    }
+    return m_frameActive ? POSITION_INTERVAL_ACTIVE : POSITION_INTERVAL_INACTIVE;
+}
+
+void TrackStatusHandler::updatePositionInterval() throw() {
+    if (m_pipeline == NULL) {
         return;
     }
 
-    NavigationContainer* nav = m_mainFrame->getNavigationContainer();
-    StreamTagData* td = static_cast<StreamTagData*>(event.GetClientObject());
-    // dbl check if not null
-    if (td != NULL) {
-        if (td->m_type == TrackInfo::TITLE) {
-            nav->setInfo(td->m_value, m_playedTrack.getLocation());
-       }
-        delete td;
+    unsigned int interval = getPositionInterval();
+    bool wasHidden = m_pipeline->getPositionInterval() == 0;
+    m_pipeline->setPositionInterval(interval);
+    if (wasHidden && interval > 0) {
+        // the slider has been standing still while nobody was looking.
+        m_pipeline->requestPosition();
+    }
+}
+
+void TrackStatusHandler::onPipelineNotify(wxCommandEvent& event) {
+    const long epoch = event.GetExtraLong();
+    if (m_pipeline == NULL || epoch != m_pipelineEpoch) {
+        // posted by a pipeline which has been deleted in the meantime.
+        return;
+    }
+
+    m_pipeline->rearmNotify();
+
+    PipelineNotification n;
+    while (m_pipeline != NULL && epoch == m_pipelineEpoch && m_pipeline->popNotification(n)) {
+        switch (n.kind) {
+            case PipelineNotification::NOTIFY_TAG:
+                pipelineTagRead(n.tagType, wxString(n.value, wxConvUTF8));
+                break;
+            case PipelineNotification::NOTIFY_POSITION:
+                pipelinePosChanged(n.position, n.length);
+                break;
+            case PipelineNotification::NOTIFY_ERROR:
+                pipelineError(wxString(n.value, wxConvUTF8));
+                break;
+            case PipelineNotification::NOTIFY_END:
+                pipelineStreamEnd();
+                break;
+            case PipelineNotification::NOTIFY_TRACK_CHANGED:
+                pipelineTrackChanged(m_pipeline->getLocation());
+                break;
+            case PipelineNotification::NOTIFY_BUFFERING:
+                pipelineBuffering(n.position, n.length != 0);
+                break;
+        }
+    }
+}
+
+void TrackStatusHandler::deletePipeline() throw() {
+    endStall();
+    if (m_pipeline != NULL) {
+        m_pipeline->stop();
+        // The pipeline removes its bus watch and interval before anything
+        // else, and those run on this thread, so nothing can be queued by
+        // it anymore. Its wake up may still be pending, but it carries the
+        // old epoch and will be ignored.
+        delete m_pipeline;
+        m_pipeline = NULL;
+    }
+    m_queuedTrack = TrackInfo();
+}
+
+void TrackStatusHandler::endStall() throw() {
+    if (!m_stalled) {
+        return;
+    }
+    m_stalled = false;
+
+    long ms = m_stallTime.Time();
+    std::cout << "Stream stalled for " << ms << " ms." << std::endl;
+    m_mainFrame->getStreamBrowser()->getStreamTable()->recordStall(m_stallLocation, ms);
+}
+
+void TrackStatusHandler::queueNextTrack() throw() {
+    if (m_pipeline == NULL || m_pipelineType != PIPELINE_TRACK) {
+        return;
+    }
+
+    TrackTable* tt = m_mainFrame->getTrackTable();
+    TrackInfo next = tt->getNext();
+    if (next.getLocation() != m_queuedTrack.getLocation()) {
+        m_queuedTrack = next;
+        // an invalid track has an empty location, which clears the queue.
+        m_pipeline->setNextLocation(next.getLocation());
     }
 }
 
@@ -505,32 +764,50 @@ void TrackStatusHandler::play() throw() {
 
     NavigationContainer* nav = m_mainFrame->getNavigationContainer();
     
+    // how long it takes until the track is (about to be) heard.
+    wxStopWatch switchTime;
+    bool reused = m_pipeline != NULL;
+
+    // the previous stream may be waiting for its buffer.
+    endStall();
+
+    long bufferSize;
+    long bufferDuration;
+    wxConfigBase::Get()->Read(Preferences::BUFFER_SIZE, &bufferSize, 256L);
+    wxConfigBase::Get()->Read(Preferences::BUFFER_DURATION, &bufferDuration, 5L);
+
     const wxString& loc = m_playedTrack.getLocation();
     if (m_pipeline != NULL) {
-        // if a pipeline already exists, stop it, delete it, nullify it, and
-        // start a new pipeline.
-        m_pipeline->stop();
-
-        // Since we are using pipeline listeners (callbacks) which return the
-        // 'this' pointer, we must ensure that the pipeline does not get deleted
-        // too 'soon'. Or else we get segfaults your mother will be jealous of.
-        // Therefore, we lock the mutex before deleting it. See the 
-        // Pipeline::fireX functions to see how the mutex is positioned.
-        s_pipelineListenerMutex.Lock(); 
-        delete m_pipeline;
-        m_pipeline = NULL;
-        s_pipelineListenerMutex.Unlock(); 
+        // keep the playbin and its audio sink, only swap the location.
+        try {
+            m_pipeline->setBuffering(bufferSize, bufferDuration);
+            m_pipeline->setLocation(loc);
+            m_queuedTrack = TrackInfo();
+        } catch (const AudioException& ex) {
+            std::cerr << "Can't reuse the pipeline: " << ex.what() << std::endl;
+            deletePipeline();
+            reused = false;
+        }
     }
 
-    try {
-        m_pipeline = new GenericPipeline(loc);
-        // subscribe to pipeline events here:
-        m_pipeline->addListener(this);
-    } catch (const AudioException& ex) {
-        wxMessageDialog dlg(m_mainFrame, ex.getAsWxString(), wxT("Error"), wxOK | wxICON_ERROR);
-        dlg.ShowModal();
+    if (m_pipeline == NULL) {
+        try {
+            m_pipeline = new GenericPipeline(loc, bufferSize, bufferDuration);
+        } catch (const AudioException& ex) {
+            wxMessageDialog dlg(m_mainFrame, ex.getAsWxString(), wxT("Error"), wxOK | wxICON_ERROR);
+            dlg.ShowModal();
+            return;
+        }
     }
 
+    // get woken up for the notifications of the (new) location. Wake ups
+    // for the previous one carry an older epoch.
+    m_pipeline->setNotifyHandler(this, ++m_pipelineEpoch);
+
+    // no position updates while the window is hidden (a new pipeline updates
+    // every second, a reused one has the interval it had).
+    m_pipeline->setPositionInterval(getPositionInterval());
+
     // set the initial volume of the pipeline
     m_pipeline->setVolume(nav->getVolume());
     m_pipeline->play();
@@ -545,7 +822,11 @@ void TrackStatusHandler::play() throw() {
         nav->setTrack(m_playedTrack);
         nav->setSeekerValues(0, m_pipeline->getDurationSeconds(), true);
         nav->setPlayPauseButtonEnabled(true);
+        queueNextTrack();
     }
+
+    std::cout << "Track switch took " << switchTime.Time() << " ms ("
+              << (reused ? "reused" : "new") << " pipeline)." << std::endl;
 }
 
 void TrackStatusHandler::unpause() throw() {
@@ -578,59 +859,86 @@ void TrackStatusHandler::stop() throw() {
         TrackInfo empty;
         nav->setTrack(empty); // this will reset the 'display'.
 
-        // same story as play(): mutexes.
-        s_pipelineListenerMutex.Lock(); 
-        delete m_pipeline;
-        m_pipeline = NULL;
-        s_pipelineListenerMutex.Unlock(); 
+        deletePipeline();
     }    
 }
 
-void TrackStatusHandler::pipelineTagRead(Pipeline* const pipeline, const char* type, const wxString& value) throw() {
-    // NOTE: this function is called from a gst thread.
-    wxCommandEvent evt(NAVI_EVENT_TAG_READ);
-    //std::cout << "pipelineTagRead: " << type << " -> " << value.mb_str() << std::endl;
-    StreamTagData* td = new StreamTagData(type, value);
-    evt.SetClientObject(td);
-    AddPendingEvent(evt);
-    // will call onTagRead() in turn.
+void TrackStatusHandler::pipelineTagRead(const char* type, const wxString& value) throw() {
+    // for now, just dont do anything when we're not a stream.
+    if (m_pipelineType != PIPELINE_STREAM) {
+        return;
+    }
+
+    if (type == TrackInfo::TITLE) {
+        NavigationContainer* nav = m_mainFrame->getNavigationContainer();
+        nav->setInfo(value, m_playedTrack.getLocation());
+    }
 }
 
-void TrackStatusHandler::pipelineStreamEnd(Pipeline* const pipeline) throw() {
-    // NOTE: this function is called from a gst thread.
+void TrackStatusHandler::pipelineStreamEnd() throw() {
+    // onNext() deletes the current pipeline, so let it happen after the
+    // notifications have been handled.
     wxCommandEvent evt(NAVI_EVENT_TRACK_NEXT);
     AddPendingEvent(evt);
 }
 
-void TrackStatusHandler::pipelineError(Pipeline* const pipeline, const wxString& error) throw() {
-    // NOTE: this function is called from a gst thread.
-    // Shouldn't this be called using AddPendingEvent()?
-    wxMessageDialog dlg(m_mainFrame, error, wxT("Error"), wxOK | wxICON_ERROR);
-    dlg.ShowModal();
+void TrackStatusHandler::pipelineTrackChanged(const wxString& location) throw() {
+    // The list may have been sorted or filtered since the track was queued,
+    // so it's looked up by its location. It may even be gone from the list.
+    TrackTable* tt = m_mainFrame->getTrackTable();
+    TrackInfo info = tt->markPlayedLocation(location);
+    if (info.isValid()) {
+        m_playedTrack = info;
+    } else if (m_queuedTrack.getLocation() == location) {
+        m_playedTrack = m_queuedTrack;
+    } else {
+        // at least don't show the previous track, the tags follow.
+        m_playedTrack = TrackInfo();
+        m_playedTrack.setLocation(location);
+    }
+    m_queuedTrack = TrackInfo();
+
+    // the position notifications correct an unknown duration soon enough.
+    int duration = m_playedTrack.getDurationSeconds();
+    NavigationContainer* nav = m_mainFrame->getNavigationContainer();
+    nav->setTrack(m_playedTrack);
+    nav->setSeekerValues(0, duration > 0 ? duration : 1, true);
+
+    queueNextTrack();
 }
 
-void TrackStatusHandler::pipelinePosChanged(Pipeline* const pipeline, unsigned int pos, unsigned int len) throw() {
-    // NOTE: this function is called from a gst thread.
-    wxCommandEvent evt(NAVI_EVENT_POS_CHANGED);
-    StreamPositionData* d = new StreamPositionData(pos, len);
-    evt.SetClientObject(d);
-    AddPendingEvent(evt);
-    // this will in turn call doUpdateSlider.
+void TrackStatusHandler::pipelineError(const wxString& error) throw() {
+    wxMessageDialog dlg(m_mainFrame, error, wxT("Error"), wxOK | wxICON_ERROR);
+    dlg.ShowModal();
 }
 
-void TrackStatusHandler::doUpdateSlider(wxCommandEvent& evt) {
-    // called because of AddPendingEvent()
-    StreamPositionData* derpity = static_cast<StreamPositionData*>(evt.GetClientObject());
+void TrackStatusHandler::pipelinePosChanged(unsigned int pos, unsigned int len) throw() {
     // !m_scrolling determines whether we are currently dragging the slider.
     // If so, do not dynamically update the seeker values.
-    if (derpity != NULL && !m_scrolling) {
-        if (m_pipelineType == PIPELINE_STREAM) {
-        } else {
-            NavigationContainer* nav = m_mainFrame->getNavigationContainer();
-            nav->setSeekerValues(derpity->m_pos, derpity->m_max);
-        }
+    if (!m_scrolling && m_pipelineType != PIPELINE_STREAM) {
+        NavigationContainer* nav = m_mainFrame->getNavigationContainer();
+        nav->setSeekerValues(pos, len);
     }
-    delete derpity;
+
+    queueNextTrack();
+}
+
+void TrackStatusHandler::pipelineBuffering(unsigned int percent, bool stalled) throw() {
+    // local files don't buffer, so this is about streams.
+    if (m_pipelineType != PIPELINE_STREAM) {
+        return;
+    }
+
+    if (stalled && !m_stalled) {
+        m_stalled = true;
+        m_stallTime.Start();
+        m_stallLocation = m_playedTrack.getLocation();
+    } else if (!stalled) {
+        endStall();
+    }
+
+    NavigationContainer* nav = m_mainFrame->getNavigationContainer();
+    nav->setBufferFill(percent, stalled);
 }
 
 BEGIN_EVENT_TABLE(TrackStatusHandler, wxEvtHandler)
@@ -645,10 +953,13 @@ BEGIN_EVENT_TABLE(TrackStatusHandler, wxEvtHandler)
     EVT_LIST_ITEM_ACTIVATED(TrackTable::ID_TRACKTABLE, TrackStatusHandler::onTrackActivated)
     EVT_LIST_ITEM_ACTIVATED(StreamTable::ID_STREAMTABLE, TrackStatusHandler::onStreamItemActivated)
 
-    EVT_COMMAND(wxID_ANY, NAVI_EVENT_POS_CHANGED, TrackStatusHandler::doUpdateSlider)
+    EVT_ACTIVATE(TrackStatusHandler::onFrameActivate)
+    EVT_ICONIZE(TrackStatusHandler::onFrameIconize)
+    EVT_SHOW(TrackStatusHandler::onFrameShow)
+
+    EVT_COMMAND(wxID_ANY, naviPipelineNotifyEvent, TrackStatusHandler::onPipelineNotify)
     EVT_COMMAND(wxID_ANY, NAVI_EVENT_STREAM_STOP, TrackStatusHandler::onStop)
     EVT_COMMAND(wxID_ANY, NAVI_EVENT_TRACK_NEXT, TrackStatusHandler::onNext)
-    EVT_COMMAND(wxID_ANY, NAVI_EVENT_TAG_READ, TrackStatusHandler::onTagRead)
 END_EVENT_TABLE()
 
 } // namespace navi 
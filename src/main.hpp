@@ -24,6 +24,7 @@
 #include "audio.hpp"
 #include "dirbrowser.hpp"
 #include "streambrowser.hpp"
+#include "tagcache.hpp"
 #include "tracktable.hpp"
 #include "navigation.hpp"
 #include "misc.hpp"
@@ -39,6 +40,8 @@
 #include <wx/bitmap.h>
 #include <wx/msgdlg.h>
 #include <wx/splitter.h>
+#include <wx/spinctrl.h>
+#include <wx/stopwatch.h>
 
 
 namespace navi {
@@ -63,6 +66,12 @@ public:
      * Initialization stuff.
      */
     virtual bool OnInit();
+
+    /**
+     * Runs the main loop. The exit status is 1 when the main window took
+     * longer than the startup budget to get on screen (see StartupTrace).
+     */
+    virtual int OnRun();
 };
 
 //==============================================================================
@@ -119,8 +128,19 @@ private:
     /// 'System tray' icon.
     SystrayIcon* m_taskBarIcon;
 
+    /// Whether initDeferred() has been called.
+    bool m_deferredDone;
+
     void initMenu();
 
+    /**
+     * Does the part of the initialization which is not needed to show the
+     * window: loading the streams, the tray icon, and restoring the library
+     * (which starts the background scanners). Called on the first idle event,
+     * when the window is on screen.
+     */
+    void initDeferred();
+
     wxPanel* createDirBrowserPanel(wxWindow* parent);
     wxPanel* createBottom(wxWindow* parent);
 
@@ -128,6 +148,9 @@ private:
 
     void onResize(wxSizeEvent& event);
 
+    /// Calls initDeferred() the first time.
+    void onIdle(wxIdleEvent& event);
+
     void onAbout(wxCommandEvent& event);
 
     void onIconize(wxIconizeEvent& event);
@@ -138,6 +161,9 @@ private:
 
     void onClose(wxCloseEvent& event);
 
+    /// Shows the progress of a DirTraversalThread in the status bar.
+    void onScanProgress(wxCommandEvent& event);
+
 public:
     NaviMainFrame();
     ~NaviMainFrame();
@@ -146,6 +172,8 @@ public:
 
     NavigationContainer* getNavigationContainer() const;
 
+    StreamBrowserContainer* getStreamBrowser() const;
+
     DECLARE_EVENT_TABLE()
 };
 
@@ -159,6 +187,9 @@ private:
     wxCheckBox* m_chkMinimizeToTray;
     wxCheckBox* m_chkAskOnExit;
     wxCheckBox* m_chkSortOnTrackNum;
+    wxSpinCtrl* m_spinScanThreads;
+    wxSpinCtrl* m_spinBufferSize;
+    wxSpinCtrl* m_spinBufferDuration;
 
     wxPanel* createTopPanel(wxWindow* parent);
     wxPanel* createButtonPanel(wxWindow* parent);
@@ -179,14 +210,23 @@ public:
 /**
  * This class can be seen as quite some meat of the playability of Navi. It makes
  * sure the play, stop, next etc. buttons do its work, and update the UI accordingly.
- * It is also a listener to any pipeline changes (due to it subclassing the
- * PipelineListener).
+ * It also handles the notifications of the playing pipeline (tags, position, end
+ * of stream and errors), which it pops from the pipeline's queue when woken up
+ * by a naviPipelineNotifyEvent.
  */
-class TrackStatusHandler : public wxEvtHandler, public PipelineListener {
+class TrackStatusHandler : public wxEvtHandler {
 private:
     const static unsigned short PIPELINE_STREAM = 0;
     const static unsigned short PIPELINE_TRACK = 1;
 
+    /// Milliseconds between position updates while the main window has the
+    /// focus (the user is probably looking at it).
+    const static unsigned int POSITION_INTERVAL_ACTIVE = 500;
+
+    /// Milliseconds between position updates while the main window is visible,
+    /// but doesn't have the focus. When it's hidden, there are no updates.
+    const static unsigned int POSITION_INTERVAL_INACTIVE = 1000;
+
 
     /// Boolean to indicate whether we are currently scrolling with the
     /// slider. XXX: this may be a butt fugly hack!?!?! BUT WORKS
@@ -205,6 +245,59 @@ private:
     /// Pipeline with the current song.
     GenericPipeline* m_pipeline;
 
+    /// The track queued with Pipeline::setNextLocation(), to be played without
+    /// a gap after m_playedTrack. Invalid when there is none.
+    TrackInfo m_queuedTrack;
+
+    /// Whether the main window is shown, iconized and active (has the focus).
+    bool m_frameShown;
+    bool m_frameIconized;
+    bool m_frameActive;
+
+    /// Epoch of m_pipeline, incremented for every new pipeline. Wake ups of
+    /// pipelines which have been deleted since carry an older epoch.
+    long m_pipelineEpoch;
+
+    /// Whether the played stream stalled (ran out of buffered data), since
+    /// when, and which stream it was.
+    bool m_stalled;
+    wxStopWatch m_stallTime;
+    wxString m_stallLocation;
+
+    /**
+     * Stops and deletes the current pipeline, if any.
+     */
+    void deletePipeline() throw();
+
+    /**
+     * Records the stall of the played stream in the StreamTable, if it
+     * stalled. Called when it plays again, or when it's stopped or replaced
+     * before that.
+     */
+    void endStall() throw();
+
+    /**
+     * Returns the milliseconds between position updates that suit the current
+     * state of the main window, 0 when it's hidden.
+     */
+    unsigned int getPositionInterval() const throw();
+
+    /**
+     * Applies getPositionInterval() to the pipeline. When the interval went
+     * up from 0, the position is requested right away.
+     */
+    void updatePositionInterval() throw();
+
+    /**
+     * Queues the track which follows the played one in the TrackTable on the
+     * pipeline, so it's played without a gap. Called again with every position
+     * update, so it follows when the list is sorted or changed. There are no
+     * updates while the main window is hidden, so a change made then may not
+     * be followed: the track which was queued is played, and marked as the
+     * playing one (see pipelineTrackChanged()).
+     */
+    void queueNextTrack() throw();
+
 /**
  * @name UI callbacks
  * User Interface callback functions. These are functions which respond
@@ -255,68 +348,90 @@ private:
     void onStreamItemActivated(wxListEvent& event);
 
     /**
-     * Invoked when a tag is read from a stream or just a plain local playable
-     * file.
+     * Invoked when the main window is (de)activated. This handler is pushed on
+     * the main frame, so it sees the events of the frame first. Like the other
+     * frame events, it's skipped so the frame gets it too.
+     */
+    void onFrameActivate(wxActivateEvent& event);
+
+    /**
+     * Invoked when the main window is iconized or restored.
+     */
+    void onFrameIconize(wxIconizeEvent& event);
+
+    /**
+     * Invoked when the main window is shown or hidden (minimizing to the
+     * system tray hides it).
+     */
+    void onFrameShow(wxShowEvent& event);
+
+    /**
+     * Invoked when the pipeline has queued notifications. Pops them one by one,
+     * and stops as soon as the pipeline has been replaced or deleted (which may
+     * happen while an error dialog is shown, for instance).
      */
-    void onTagRead(wxCommandEvent& event);
+    void onPipelineNotify(wxCommandEvent& event);
 ///@}
 
 
 /**
- * @name Pipeline callbacks
- * Pipeline object callbacks, which are the callbacks due to this TrackStatusHandler
- * being registered as a listener. All of these functions are called from a GST thread.
- * So all updates to the UI of wx need to be done with an `AddPendingEvent' call!!
+ * @name Pipeline notifications
+ * Handlers for the notifications popped by onPipelineNotify(). These run on the
+ * main thread, so they can update the UI directly.
  */
 ///@{
 
-    void pipelineTagRead(Pipeline* const pipeline, const char* type, const wxString& value) throw();
+    /**
+     * A tag was read from a stream or just a plain local playable file.
+     *
+     * @param type One of the TrackInfo static consts.
+     * @param value The value of the tag.
+     */
+    void pipelineTagRead(const char* type, const wxString& value) throw();
+
+    /**
+     * The pipeline has reached its end. Proceeds to the next track.
+     */
+    void pipelineStreamEnd() throw();
 
     /**
-     * Callback listener function from a Pipeline object. Invoked when the
-     * pipeline has reached its end.
+     * The queued track has started playing, without a gap. Marks it as the
+     * played track (also in the TrackTable, which may have changed since it
+     * was queued), and queues the one after it.
      *
-     * @param pipeline The pipeline instance pointer.
+     * @param location The URI of the track which started.
      */
-    void pipelineStreamEnd(Pipeline* const pipeline) throw();
+    void pipelineTrackChanged(const wxString& location) throw();
 
     /**
-     * Callback listener function from a Pipeline object. Invoked when the
-     * pipeline has found an error.
+     * The pipeline has found an error, during playback, initialization or
+     * whatever.
      *
-     * @param pipeline The pipeline instance pointer.
      * @param error The error string returned from gstreamer.
      */
-    void pipelineError(Pipeline* const pipeline, const wxString& error) throw();
+    void pipelineError(const wxString& error) throw();
 
     /**
-     * Callback listener function from a Pipeline object. Invoked as soon
-     * as the position was changed in a stream (caused by playback). This
-     * function will update the user interface accordingly (by displaying
-     * the new time and updating the slider and whatnot). This function
-     * may be tricky at first, because it adds a pending wxCommand event
-     * to the instance of this TrackStatusHandler object. The callback
-     * function then responds to this event to update the UI. Why like this?
-     * Because wxWidgets requires us to update the UI in the main thread, and
-     * this pipelinePosChanged function is called by a GStreamer thread.
+     * The position was changed in a stream (caused by playback). Updates the
+     * slider, unless the user is dragging it.
      *
-     * @param pipeline The pipeline instance pointar.
      * @param pos The current position in the pipeline, measured in seconds.
      * @param len The length of the pipeline, measured in seconds 
      *  (if appropriate, because live streams for instance don't have a 
      *  specific length or duration).
      */
-    void pipelinePosChanged(Pipeline* const pipeline, unsigned int pos, unsigned int len) throw();
-///@}    
+    void pipelinePosChanged(unsigned int pos, unsigned int len) throw();
 
     /**
-     * Being called by the main wx thread to periodically (every second) update
-     * the slider position.
+     * The buffer of a network stream filled or drained. Shows the fill, and
+     * keeps track of the stalls.
      *
-     * @param evt The command event. The client object passed is a StreamPositionData
-     *   pointer, and is deleted within this function.
+     * @param percent How full the buffer is.
+     * @param stalled Whether playback is paused until the buffer is full,
+     *  because it ran dry. Not during the initial fill of the buffer.
      */
-    void doUpdateSlider(wxCommandEvent& evt);
+    void pipelineBuffering(unsigned int percent, bool stalled) throw();
+///@}    
 
 public:
     TrackStatusHandler(NaviMainFrame* frame) throw();
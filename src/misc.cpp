@@ -20,10 +20,19 @@
 #include "misc.hpp"
 
 #include <iostream>
+#include <cctype>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
 
 namespace navi {
 
 extern const wxEventType naviDirTraversedEvent = wxNewEventType();
+extern const wxEventType naviScanProgressEvent = wxNewEventType();
+extern const wxEventType naviDirChangedEvent = wxNewEventType();
+extern const wxEventType naviPipelineNotifyEvent = wxNewEventType();
+extern const wxEventType naviDirListedEvent = wxNewEventType();
 
 // seconds to minutes formatting.
 const wxString formatSeconds(int secs) {
@@ -57,12 +66,314 @@ long strToInt(const wxString& str, int def) {
     return val;
 }
 
+long leadingNumber(const wxString& str, long def) {
+    size_t i = 0;
+    while (i < str.Len() && str[i] == wxT(' ')) {
+        i++;
+    }
+    if (i == str.Len() || !wxIsdigit(str[i])) {
+        return def;
+    }
+
+    long val = 0;
+    while (i < str.Len() && wxIsdigit(str[i])) {
+        val = val * 10 + (str[i] - wxT('0'));
+        i++;
+    }
+    return val;
+}
+
+/// Base letters of U+00C0 up to U+017F, lower case. A `*' is a letter which
+/// becomes two (see makeCollationKey()), a `.' is left alone.
+static const char* LATIN_BASE_LETTERS =
+    // U+00C0
+    "aaaaaa*ceeeeiiiidnooooo.ouuuuy**"
+    "aaaaaa*ceeeeiiiidnooooo.ouuuuy*y"
+    // U+0100
+    "aaaaaaccccccccddddeeeeeeeeeegggggggghhhhiiiiiiiiii**jjkkkllllllllll"
+    "nnnnnnnnnoooooo**rrrrrrssssssssttttttuuuuuuuuuuuuwwyyyzzzzzzs";
+
+std::string makeCollationKey(const wxString& text) {
+    wxString folded;
+    folded.reserve(text.Len());
+
+    for (size_t i = 0; i < text.Len(); i++) {
+        wxChar c = text[i];
+        if (c < 0x80) {
+            folded << static_cast<wxChar>(tolower(c));
+            continue;
+        }
+
+        if (c >= 0xC0 && c <= 0x17F) {
+            char base = LATIN_BASE_LETTERS[c - 0xC0];
+            if (base == '*') {
+                switch (c) {
+                    case 0xC6: case 0xE6: folded << wxT("ae"); break;
+                    case 0xDE: case 0xFE: folded << wxT("th"); break;
+                    case 0xDF: folded << wxT("ss"); break;
+                    case 0x132: case 0x133: folded << wxT("ij"); break;
+                    default: folded << wxT("oe"); break; // U+0152, U+0153
+                }
+                continue;
+            } else if (base != '.') {
+                folded << static_cast<wxChar>(base);
+                continue;
+            }
+        }
+
+        folded << static_cast<wxChar>(wxTolower(c));
+    }
+
+    return std::string(folded.mb_str(wxConvUTF8));
+}
+
 wxString escapeMnemonics(const wxString& str) {
     wxString s(str);
     s.Replace(wxT("&"), wxT("&&"));
     return s;
 }
 
+bool isPlayableFile(const wxString& filename) {
+    static const wxChar* allowed[] = {
+        wxT(".ogg"), wxT(".oga"), wxT(".mp3"), wxT(".aac"), wxT(".wav"), wxT(".flac")
+    };
+
+    for (size_t i = 0; i < sizeof(allowed) / sizeof(allowed[0]); i++) {
+        if (filename.EndsWith(allowed[i])) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+bool listDirectory(const wxString& path, std::vector<DirEntry>& entries, bool withFiles) {
+    DirReader reader(path, withFiles);
+    if (!reader.isOpened()) {
+        return false;
+    }
+
+    while (reader.read(entries, static_cast<size_t>(-1))) {
+    }
+    return true;
+}
+
+//================================================================================
+
+DirReader::DirReader(const wxString& path, bool withFiles) :
+        m_path(path.fn_str()),
+        m_withFiles(withFiles) {
+    m_dir = opendir(m_path.c_str());
+    if (m_path.empty() || m_path[m_path.size() - 1] != '/') {
+        m_path += '/';
+    }
+}
+
+DirReader::~DirReader() {
+    if (m_dir != NULL) {
+        closedir(m_dir);
+    }
+}
+
+bool DirReader::isOpened() const {
+    return m_dir != NULL;
+}
+
+bool DirReader::read(std::vector<DirEntry>& entries, size_t max) {
+    if (m_dir == NULL) {
+        return false;
+    }
+
+    size_t added = 0;
+    while (added < max) {
+        struct dirent* ent = readdir(m_dir);
+        if (ent == NULL) {
+            // done, no need to keep the descriptor around any longer.
+            closedir(m_dir);
+            m_dir = NULL;
+            return false;
+        }
+
+        // hidden, or `.' and `..'.
+        if (ent->d_name[0] == '.') {
+            continue;
+        }
+
+        bool isDir = ent->d_type == DT_DIR;
+        bool isFile = ent->d_type == DT_REG;
+        if (ent->d_type == DT_UNKNOWN || ent->d_type == DT_LNK) {
+            // no type from the file system, or a link: ask where it leads.
+            struct stat st;
+            if (stat((m_path + ent->d_name).c_str(), &st) != 0) {
+                continue;
+            }
+            isDir = S_ISDIR(st.st_mode);
+            isFile = S_ISREG(st.st_mode);
+        }
+
+        if (isDir || (isFile && m_withFiles)) {
+            DirEntry entry;
+            entry.name = wxString(ent->d_name, *wxConvFileName);
+            entry.isDir = isDir;
+            entries.push_back(entry);
+            added++;
+        }
+    }
+
+    return true;
+}
+
+//================================================================================
+
+SyncedTempFile::SyncedTempFile(const wxString& path) :
+        m_path(path) {
+    // in the same directory, so the rename doesn't cross file systems.
+    m_tempPath = wxFileName::CreateTempFileName(path, &m_file);
+}
+
+SyncedTempFile::~SyncedTempFile() {
+    if (m_file.IsOpened()) {
+        m_file.Close();
+        wxRemoveFile(m_tempPath);
+    }
+}
+
+bool SyncedTempFile::isOpened() const {
+    return m_file.IsOpened();
+}
+
+bool SyncedTempFile::write(const void* data, size_t size) {
+    return m_file.IsOpened() && m_file.Write(data, size) == size;
+}
+
+bool SyncedTempFile::commit() {
+    if (!m_file.IsOpened()) {
+        return false;
+    }
+
+    bool synced = fsync(m_file.fd()) == 0;
+    m_file.Close();
+    if (!synced || !wxRenameFile(m_tempPath, m_path)) {
+        wxRemoveFile(m_tempPath);
+        return false;
+    }
+
+    // The rename is a change of the directory, which has to reach the disk as
+    // well. When that fails, the file itself is fine.
+    int dir = open(wxPathOnly(m_path).fn_str(), O_RDONLY);
+    if (dir >= 0) {
+        fsync(dir);
+        close(dir);
+    }
+    return true;
+}
+
+//================================================================================
+
+TrackSortKey::TrackSortKey() :
+        disc(0),
+        track(0),
+        duration(-1) {
+}
+
+TrackSortKey::TrackSortKey(const TrackInfo& info) :
+        title(makeCollationKey(info.get(TrackInfo::TAG_TITLE))),
+        album(makeCollationKey(info.get(TrackInfo::TAG_ALBUM))),
+        disc(leadingNumber(info.get(TrackInfo::TAG_DISC_NUMBER), 0)),
+        track(leadingNumber(info.get(TrackInfo::TAG_TRACK_NUMBER), 0)),
+        duration(info.getDurationSeconds()) {
+    const wxString& tagArtist = info.get(TrackInfo::TAG_ARTIST);
+    artist = makeCollationKey(tagArtist.IsEmpty() ? info.getSimpleName() : tagArtist);
+}
+
+/// Three-way comparison of two numbers.
+static int compareNumbers(long one, long two) {
+    return one < two ? -1 : (one > two ? 1 : 0);
+}
+
+int TrackSortKey::compare(const TrackSortKey& one, const TrackSortKey& two, Column column) {
+    int result = 0;
+    switch (column) {
+        case COLUMN_ARTIST:
+            result = one.artist.compare(two.artist);
+            if (result != 0) {
+                return result;
+            }
+            // fall through: the albums of the artist.
+        case COLUMN_ALBUM:
+            result = one.album.compare(two.album);
+            if (result != 0) {
+                return result;
+            }
+            // fall through: in the order of the album.
+        case COLUMN_TRACK:
+            result = compareNumbers(one.disc, two.disc);
+            if (result != 0) {
+                return result;
+            }
+            return compareNumbers(one.track, two.track);
+        case COLUMN_TITLE:
+            return one.title.compare(two.title);
+        case COLUMN_DURATION:
+            return compareNumbers(one.duration, two.duration);
+        default:
+            return 0;
+    }
+}
+
+//================================================================================
+
+const wxString StartupTrace::ENV_TRACE  = wxT("NAVI_TRACE_STARTUP");
+const wxString StartupTrace::ENV_BUDGET = wxT("NAVI_STARTUP_BUDGET");
+
+wxStopWatch StartupTrace::s_watch;
+long StartupTrace::s_lastMark = 0;
+bool StartupTrace::s_verbose = false;
+long StartupTrace::s_budget = -1;
+bool StartupTrace::s_overBudget = false;
+
+void StartupTrace::start() {
+    s_watch.Start();
+    s_lastMark = 0;
+
+    s_verbose = wxGetEnv(ENV_TRACE, NULL);
+
+    wxString budget;
+    if (wxGetEnv(ENV_BUDGET, &budget)) {
+        s_budget = strToInt(budget, -1);
+        if (s_budget < 0) {
+            std::cerr << "Ignoring " << ENV_BUDGET.mb_str() << ", it's not an amount of milliseconds." << std::endl;
+        }
+    }
+}
+
+long StartupTrace::mark(const wxString& phase) {
+    long now = s_watch.Time();
+    if (s_verbose) {
+        std::cout << "Startup: " << phase.mb_str() << " took " << now - s_lastMark
+                  << " ms (" << now << " ms total)" << std::endl;
+    }
+    s_lastMark = now;
+    return now;
+}
+
+bool StartupTrace::finish(long shown) {
+    std::cout << "Startup: window on screen after " << shown << " ms" << std::endl;
+    if (s_budget < 0) {
+        return false;
+    }
+
+    s_overBudget = shown > s_budget;
+    if (s_overBudget) {
+        std::cerr << "Startup: over the budget of " << s_budget << " ms!" << std::endl;
+    }
+    return true;
+}
+
+bool StartupTrace::isOverBudget() {
+    return s_overBudget;
+}
+
 //================================================================================
 
 const wxString StreamConfiguration::CONFIG_FILE = wxT("streams");
@@ -145,11 +456,88 @@ std::vector<std::pair<wxString, wxString> >& StreamConfiguration::getStreams() {
 
 //================================================================================
 
+StallStatistics::Stalls::Stalls() :
+        count(0),
+        milliseconds(0) {
+}
+
+const wxString StallStatistics::STATS_FILE = wxT("stalls");
+
+StallStatistics::StallStatistics() {
+    // same location as the stream configuration.
+    wxStandardPathsBase& wxsp = wxStandardPaths::Get();
+    wxFileName naviDir(wxsp.GetUserConfigDir(), wxT(".navi"));
+    if (!wxDirExists(naviDir.GetFullPath())) {
+        wxMkdir(naviDir.GetFullPath());
+    }
+
+    m_file = wxFileName(naviDir.GetFullPath(), STATS_FILE);
+}
+
+void StallStatistics::load() {
+    m_stalls.clear();
+    if (!wxFileExists(m_file.GetFullPath())) {
+        return;
+    }
+
+    wxXmlDocument doc;
+    if (!doc.Load(m_file.GetFullPath()) || doc.GetRoot() == NULL) {
+        std::cerr << "Failed to read the stall statistics." << std::endl;
+        return;
+    }
+
+    wxXmlNode* station = doc.GetRoot()->GetChildren();
+    while (station != NULL) {
+        if (station->GetName() == wxT("station")) {
+            wxString loc = station->GetPropVal(wxT("location"), wxT(""));
+            Stalls& stalls = m_stalls[loc];
+            stalls.count = strToInt(station->GetPropVal(wxT("stalls"), wxT("0")), 0);
+            stalls.milliseconds = strToInt(station->GetPropVal(wxT("milliseconds"), wxT("0")), 0);
+        }
+
+        station = station->GetNext();
+    }
+}
+
+void StallStatistics::save() {
+    wxXmlDocument doc;
+    wxXmlNode* root = new wxXmlNode(NULL, wxXML_ELEMENT_NODE, wxT("stall-statistics"));
+
+    std::map<wxString, Stalls>::const_iterator it;
+    for (it = m_stalls.begin(); it != m_stalls.end(); it++) {
+        wxXmlNode* station = new wxXmlNode(NULL, wxXML_ELEMENT_NODE, wxT("station"));
+        station->AddProperty(wxT("location"), it->first);
+        station->AddProperty(wxT("stalls"), wxString::Format(wxT("%lu"), it->second.count));
+        station->AddProperty(wxT("milliseconds"), wxString::Format(wxT("%lu"), it->second.milliseconds));
+        root->AddChild(station);
+    }
+
+    doc.SetRoot(root);
+    doc.Save(m_file.GetFullPath());
+}
+
+void StallStatistics::addStall(const wxString& location, unsigned long milliseconds) {
+    Stalls& stalls = m_stalls[location];
+    stalls.count++;
+    stalls.milliseconds += milliseconds;
+}
+
+StallStatistics::Stalls StallStatistics::getStalls(const wxString& location) const {
+    std::map<wxString, Stalls>::const_iterator it = m_stalls.find(location);
+    return it != m_stalls.end() ? it->second : Stalls();
+}
+
+//================================================================================
+
 const wxString Preferences::CONFIG_FILE      = wxT("preferences");
 const wxString Preferences::MINIMIZE_TO_TRAY = wxT("/Preferences/MinimizeToTray");
 const wxString Preferences::ASK_ON_EXIT      = wxT("/Preferences/AskOnExit");
 const wxString Preferences::MEDIA_DIRECTORY  = wxT("/Preferences/MediaDirectory");
 const wxString Preferences::AUTO_SORT        = wxT("/Preferences/AutoSortOnTrackNum");
+const wxString Preferences::SCAN_THREADS     = wxT("/Preferences/ScanThreads");
+const wxString Preferences::LIBRARY_MODE     = wxT("/Preferences/LibraryMode");
+const wxString Preferences::BUFFER_SIZE      = wxT("/Preferences/BufferSize");
+const wxString Preferences::BUFFER_DURATION  = wxT("/Preferences/BufferDuration");
 
 Preferences::Preferences(wxInputStream& is, const wxString& configFile) :
         wxFileConfig(is),
@@ -167,6 +555,10 @@ void Preferences::setDefaults() {
     Write(ASK_ON_EXIT,      false);
     Write(MEDIA_DIRECTORY,  wxT("/"));
     Write(AUTO_SORT,        true);
+    Write(SCAN_THREADS,     0L);
+    Write(LIBRARY_MODE,     false);
+    Write(BUFFER_SIZE,      256L);
+    Write(BUFFER_DURATION,  5L);
 
     save();
 }
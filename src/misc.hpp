@@ -20,18 +20,24 @@
 #ifndef MISC_HPP 
 #define MISC_HPP 
 
+#include <map>
 #include <vector>
+#include <string>
 #include <utility> // for pair
 
+#include <dirent.h>
+
 #include "audio.hpp"
 
 #include <wx/wx.h>
+#include <wx/file.h>
 #include <wx/xml/xml.h>
 #include <wx/fileconf.h>
 #include <wx/wfstream.h>
 #include <wx/stdpaths.h>
 #include <wx/filename.h>
 #include <wx/uri.h>
+#include <wx/stopwatch.h>
 
 
 namespace navi {
@@ -54,6 +60,25 @@ const wxString formatSeconds(int seconds);
  */
 long strToInt(const wxString& str, int def);
 
+/**
+ * Returns the number a string starts with, like "3" of a track number "3/12".
+ *
+ * @param str The string.
+ * @param def Returned when the string doesn't start with a digit.
+ * @return The number.
+ */
+long leadingNumber(const wxString& str, long def);
+
+/**
+ * Makes a key to sort texts on, compared byte by byte: case folded, and with
+ * accents stripped from Latin letters, so "Björk" sorts with the other b's
+ * and "Élan" with the e's.
+ *
+ * @param text The text.
+ * @return The key, as UTF-8.
+ */
+std::string makeCollationKey(const wxString& text);
+
 /**
  * Escapes any single ampersand with a double ampersand, to escape
  * any possible menu mnemonics.
@@ -61,6 +86,249 @@ long strToInt(const wxString& str, int def);
  */
 wxString escapeMnemonics(const wxString& str);
 
+/**
+ * Checks whether a file has one of the extensions we know how to play, so
+ * it's worth reading its tags.
+ *
+ * @param filename The file name or (full) path.
+ * @return true if the file looks like a playable media file.
+ */
+bool isPlayableFile(const wxString& filename);
+
+/**
+ * An entry of a directory, as returned by listDirectory() and the DirReader.
+ */
+struct DirEntry {
+    /// The name of the entry (not the full path).
+    wxString name;
+
+    /// Whether it's a directory (or a link to one).
+    bool isDir;
+};
+
+/**
+ * Lists a directory in one pass with readdir(). The entry types reported by
+ * readdir are used, so nothing is stat()ed, except for symbolic links (which
+ * are followed) and on file systems which don't report types. Hidden entries
+ * are skipped, like wxDir does. Only directories and regular files are listed.
+ *
+ * @param path The directory to list.
+ * @param entries Receives the entries, in no particular order.
+ * @param withFiles false to only list the directories.
+ * @return false if the directory could not be opened.
+ */
+bool listDirectory(const wxString& path, std::vector<DirEntry>& entries, bool withFiles);
+
+/**
+ * Reads a directory a few entries at a time, the same way listDirectory()
+ * does. Used to show the first entries of a large (or slow) directory before
+ * the rest has been read.
+ */
+class DirReader {
+private:
+    /// The opened directory, NULL if it couldn't be opened or is finished.
+    DIR* m_dir;
+
+    /// The path of the directory, ending with a slash.
+    std::string m_path;
+
+    /// Whether files are listed too.
+    bool m_withFiles;
+
+public:
+    /**
+     * Opens the directory.
+     *
+     * @param path The directory to read.
+     * @param withFiles false to only list the directories.
+     */
+    DirReader(const wxString& path, bool withFiles);
+
+    /**
+     * Closes the directory, if still open.
+     */
+    ~DirReader();
+
+    /**
+     * @return false if the directory could not be opened.
+     */
+    bool isOpened() const;
+
+    /**
+     * Reads the next entries.
+     *
+     * @param entries The entries are appended to this vector.
+     * @param max The maximum amount of entries to append.
+     * @return true if there may be more entries, false when the whole
+     *  directory has been read.
+     */
+    bool read(std::vector<DirEntry>& entries, size_t max);
+};
+
+//================================================================================
+
+/**
+ * Writes a file like wxTempFile does: to a temporary file in the same
+ * directory, which is renamed over the file on commit(). Unlike wxTempFile, it
+ * flushes the data to the disk before the rename, and the rename after it.
+ * Otherwise a power loss right after the rename may leave an empty or
+ * truncated file, with the old one gone.
+ */
+class SyncedTempFile {
+private:
+    /// The file to replace.
+    wxString m_path;
+
+    /// The temporary file, empty if it couldn't be created.
+    wxString m_tempPath;
+
+    /// The opened temporary file.
+    wxFile m_file;
+
+public:
+    /**
+     * Creates and opens the temporary file.
+     *
+     * @param path The file to replace.
+     */
+    SyncedTempFile(const wxString& path);
+
+    /**
+     * Removes the temporary file, unless it was committed.
+     */
+    ~SyncedTempFile();
+
+    /**
+     * @return false if the temporary file could not be created.
+     */
+    bool isOpened() const;
+
+    /**
+     * Appends data to the temporary file.
+     *
+     * @return false if writing failed.
+     */
+    bool write(const void* data, size_t size);
+
+    /**
+     * Flushes the temporary file to the disk, and renames it over the file.
+     *
+     * @return false if that failed. The file is left alone then.
+     */
+    bool commit();
+};
+
+//================================================================================
+
+/**
+ * The values the TrackTable sorts a track on, worked out once when the track
+ * is added. Comparing two of them doesn't allocate or parse anything.
+ */
+struct TrackSortKey {
+    /// The columns of the TrackTable, in order.
+    enum Column {
+        COLUMN_TRACK,
+        COLUMN_ARTIST,
+        COLUMN_TITLE,
+        COLUMN_ALBUM,
+        COLUMN_DURATION
+    };
+
+    /// The displayed artist (the file name when there's no artist tag).
+    std::string artist;
+    std::string title;
+    std::string album;
+
+    /// Disc and track number, 0 when unknown.
+    long disc;
+    long track;
+
+    /// Duration in seconds, -1 when unknown.
+    int duration;
+
+    TrackSortKey();
+
+    /**
+     * Works out the keys of a track.
+     */
+    explicit TrackSortKey(const TrackInfo& info);
+
+    /**
+     * Compares two tracks on a column. Ties are broken on the columns that
+     * make sense after it: the artist column sorts on album, disc and track
+     * number next, the album column on disc and track number, and the track
+     * column on the disc number first.
+     *
+     * @return A negative, zero or positive value if the first track goes
+     *  before, at the same spot or after the second one (ascending).
+     */
+    static int compare(const TrackSortKey& one, const TrackSortKey& two, Column column);
+};
+
+//================================================================================
+
+/**
+ * Times the phases of startup. NaviApp::OnInit() starts the clock, and every
+ * phase is marked when it's done. The time until the main window is on screen
+ * is always printed; the separate phases only when the NAVI_TRACE_STARTUP
+ * environment variable is set.
+ *
+ * When NAVI_STARTUP_BUDGET is set to an amount of milliseconds, navi quits as
+ * soon as the window is on screen, with exit status 1 when that took longer
+ * than the budget. That's what scripts (and tests) can check on.
+ */
+class StartupTrace {
+private:
+    /// Runs since start().
+    static wxStopWatch s_watch;
+
+    /// Elapsed milliseconds at the previous mark.
+    static long s_lastMark;
+
+    /// Whether the phases are printed.
+    static bool s_verbose;
+
+    /// The budget in milliseconds, -1 when there is none.
+    static long s_budget;
+
+    /// Whether the window took longer than the budget.
+    static bool s_overBudget;
+
+public:
+    /// The environment variable which enables printing the phases.
+    static const wxString ENV_TRACE;
+
+    /// The environment variable with the budget in milliseconds.
+    static const wxString ENV_BUDGET;
+
+    /**
+     * Starts the clock, and reads the environment variables.
+     */
+    static void start();
+
+    /**
+     * Marks the end of a phase.
+     *
+     * @param phase A description of what has been done since the previous mark.
+     * @return The milliseconds since start().
+     */
+    static long mark(const wxString& phase);
+
+    /**
+     * Reports the time until the window was on screen, and compares it with
+     * the budget, if there is one.
+     *
+     * @param shown The milliseconds since start() until the window was on screen.
+     * @return true if a budget was given, in which case navi should quit.
+     */
+    static bool finish(long shown);
+
+    /**
+     * Whether the window took longer than the budget to get on screen.
+     */
+    static bool isOverBudget();
+};
+
 //================================================================================
 
 class StreamConfiguration {
@@ -84,6 +352,59 @@ public:
 
 //================================================================================
 
+/**
+ * How often every internet radio station ran out of buffered data while it was
+ * playing (a stall), and how long it took in total to fill up again. Stored by
+ * location in ~/.navi/stalls, so the flaky stations stand out over time.
+ */
+class StallStatistics {
+public:
+    /// The stalls of one station.
+    struct Stalls {
+        /// The amount of stalls.
+        unsigned long count;
+        /// The total time spent refilling the buffer, in milliseconds.
+        unsigned long milliseconds;
+
+        Stalls();
+    };
+
+private:
+    std::map<wxString, Stalls> m_stalls;
+
+    wxFileName m_file;
+
+public:
+    static const wxString STATS_FILE;
+
+    StallStatistics();
+
+    /**
+     * Reads the statistics from the file, if it exists.
+     */
+    void load();
+
+    /**
+     * Writes the statistics to the file.
+     */
+    void save();
+
+    /**
+     * Records a stall.
+     *
+     * @param location The location of the station.
+     * @param milliseconds How long it took until it played again.
+     */
+    void addStall(const wxString& location, unsigned long milliseconds);
+
+    /**
+     * Returns the stalls of a station, none when it never stalled.
+     */
+    Stalls getStalls(const wxString& location) const;
+};
+
+//================================================================================
+
 /**
  * This class represents the global preferences of this application. It extends
  * the functionality of wxFileConfig, and thus can be used as such. At start of
@@ -128,6 +449,18 @@ public:
     /// Whether to automatically sort on track number when loading a new dir.
     /// Holds a boolean (0, 1).
     static const wxString AUTO_SORT;
+    /// The maximum amount of threads reading tags when a directory is activated.
+    /// Holds a number, 0 means one thread per processor.
+    static const wxString SCAN_THREADS;
+    /// Whether the library was displayed (instead of a single directory) when
+    /// Navi was closed. Holds a boolean (0, 1).
+    static const wxString LIBRARY_MODE;
+    /// The size of the buffer for network streams, in kilobytes. Holds a
+    /// number, 0 means the GStreamer default.
+    static const wxString BUFFER_SIZE;
+    /// The duration of the buffer for network streams, in seconds. Holds a
+    /// number, 0 means the GStreamer default.
+    static const wxString BUFFER_DURATION;
 ///@}    
 
     /**
@@ -26,20 +26,6 @@ namespace navi {
 
 //================================================================================
 
-StreamTagData::StreamTagData(const char* type, const wxString& value) :
-        m_type(type),
-        m_value(value) {
-}
-
-//================================================================================
-
-StreamPositionData::StreamPositionData(unsigned int pos, unsigned int max) :
-        m_pos(pos),
-        m_max(max) {
-}
-
-//================================================================================
-
 NavigationContainer::NavigationContainer(wxWindow* parent, NaviMainFrame* naviFrame) :
         wxPanel(parent, wxID_ANY),
         m_naviFrame(naviFrame) {
@@ -182,6 +168,16 @@ void NavigationContainer::setSeekerValues(unsigned int pos, unsigned int max, bo
     }
 }
 
+void NavigationContainer::setBufferFill(unsigned int percent, bool stalled) {
+    m_positionSlider->SetRange(0, 100);
+    m_positionSlider->SetValue(percent);
+    m_positionSlider->Enable(false);
+
+    wxString label = wxString::Format(stalled ? wxT("Buffering: %u%%") : wxT("Buffer: %u%%"), percent);
+    m_txtTimeIndicator->SetLabel(label);
+    m_txtTimeIndicator->GetParent()->Layout();
+}
+
 unsigned short NavigationContainer::getVolume() throw() {
     return m_volumeSlider->GetValue();
 }
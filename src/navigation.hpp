@@ -35,29 +35,7 @@ class NaviMainFrame;
 class NavigationContainer;
 
 const wxEventType NAVI_EVENT_TRACK_NEXT  = wxNewEventType();
-const wxEventType NAVI_EVENT_POS_CHANGED = wxNewEventType();
 const wxEventType NAVI_EVENT_STREAM_STOP = wxNewEventType();
-const wxEventType NAVI_EVENT_TAG_READ    = wxNewEventType();
-
-//================================================================================
-
-class StreamTagData : public wxClientData {
-public:
-    StreamTagData(const char* type, const wxString& value);
-
-    const char* m_type;
-    const wxString m_value;
-};
-
-//================================================================================
-
-class StreamPositionData : public wxClientData {
-public:
-    StreamPositionData(unsigned int pos, unsigned int max);
-
-    unsigned int m_pos;
-    unsigned int m_max;
-};
 
 //================================================================================
 
@@ -157,6 +135,16 @@ public:
      */
     void setSeekerValues(unsigned int pos, unsigned int max, bool enabled = true);
 
+    /**
+     * Shows how full the buffer of a network stream is. The seeker is of no
+     * use for a stream anyway, so it's (disabled and) filled up to the
+     * percentage.
+     *
+     * @param percent How full the buffer is.
+     * @param stalled Whether playback waits for the buffer to fill.
+     */
+    void setBufferFill(unsigned int percent, bool stalled);
+
     /**
      * Gets the selected volume in percentage (from the slider).
      *
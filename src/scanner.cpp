@@ -0,0 +1,224 @@
+//      scanner.cpp
+//
+//      Copyright 2012 Kevin Pors <krpors@users.sf.net>
+//
+//      This program is free software; you can redistribute it and/or modify
+//      it under the terms of the GNU General Public License as published by
+//      the Free Software Foundation; either version 2 of the License, or
+//      (at your option) any later version.
+//
+//      This program is distributed in the hope that it will be useful,
+//      but WITHOUT ANY WARRANTY; without even the implied warranty of
+//      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//      GNU General Public License for more details.
+//
+//      You should have received a copy of the GNU General Public License
+//      along with this program; if not, write to the Free Software
+//      Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+//      MA 02110-1301, USA.
+
+#include "scanner.hpp"
+
+#include <iostream>
+
+#include <sys/time.h>
+
+namespace navi {
+
+/// Returns a timestamp in microseconds, for measuring read times.
+static long long nowMicros() {
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec * 1000000LL + tv.tv_usec;
+}
+
+//================================================================================
+
+TrackScanner::Worker::Worker(TrackScanner& scanner) :
+        wxThread(wxTHREAD_JOINABLE),
+        m_scanner(scanner) {
+}
+
+wxThread::ExitCode TrackScanner::Worker::Entry() {
+    m_scanner.work();
+    return 0;
+}
+
+//================================================================================
+
+TrackScanner::TrackScanner(ScanListener* listener, unsigned int threadCount) :
+        m_listener(listener),
+        m_threadCount(threadCount),
+        m_nextFile(0),
+        m_nextDelivery(0),
+        m_window(0),
+        m_active(true),
+        m_recordTimes(false),
+        m_condition(m_mutex) {
+    if (m_threadCount == 0) {
+        int cpus = wxThread::GetCPUCount();
+        m_threadCount = cpus > 0 ? cpus : 1;
+    }
+}
+
+void TrackScanner::setActive(bool active) {
+    wxMutexLocker lock(m_mutex);
+    m_active = active;
+    m_condition.Broadcast();
+}
+
+void TrackScanner::setRecordTimes(bool record) {
+    m_recordTimes = record;
+}
+
+const std::vector<long>& TrackScanner::getReadTimes() const {
+    return m_readTimes;
+}
+
+bool TrackScanner::run(const wxArrayString& files) {
+    m_mutex.Lock();
+    m_files = files;
+    m_results.assign(files.GetCount(), NULL);
+    m_done.assign(files.GetCount(), false);
+    m_readTimes.assign(m_recordTimes ? files.GetCount() : 0, 0);
+    m_nextFile = 0;
+    m_nextDelivery = 0;
+    m_window = m_threadCount * READ_AHEAD_PER_THREAD;
+    m_mutex.Unlock();
+
+    // no need for more threads than there are files.
+    size_t threads = m_threadCount;
+    if (threads > files.GetCount()) {
+        threads = files.GetCount();
+    }
+
+    std::vector<Worker*> workers;
+    for (size_t i = 0; i < threads; i++) {
+        Worker* worker = new Worker(*this);
+        if (worker->Create() != wxTHREAD_NO_ERROR || worker->Run() != wxTHREAD_NO_ERROR) {
+            std::cerr << "TrackScanner: couldn't start worker thread" << std::endl;
+            delete worker;
+            break;
+        }
+        workers.push_back(worker);
+    }
+
+    if (workers.empty() && !files.IsEmpty()) {
+        return false;
+    }
+
+    // Deliver the results in order, as soon as the next one is done.
+    m_mutex.Lock();
+    while (m_nextDelivery < m_files.GetCount()) {
+        if (m_active && !m_done[m_nextDelivery]) {
+            m_mutex.Unlock();
+            m_listener->scanStalled();
+            m_mutex.Lock();
+        }
+        while (m_active && !m_done[m_nextDelivery]) {
+            m_condition.Wait();
+        }
+        if (!m_active) {
+            break;
+        }
+
+        size_t index = m_nextDelivery++;
+        TrackInfo* info = m_results[index];
+        m_results[index] = NULL;
+        // the read ahead window has moved, so waiting workers may continue.
+        m_condition.Broadcast();
+
+        m_mutex.Unlock();
+        if (info != NULL) {
+            m_listener->trackScanned(index, info);
+        }
+        m_mutex.Lock();
+    }
+    bool completed = m_nextDelivery == m_files.GetCount();
+    m_mutex.Unlock();
+
+    for (size_t i = 0; i < workers.size(); i++) {
+        workers[i]->Wait();
+        delete workers[i];
+    }
+
+    // when aborted, some results may never have been delivered.
+    for (size_t i = 0; i < m_results.size(); i++) {
+        delete m_results[i];
+    }
+    m_results.clear();
+    m_done.clear();
+
+    return completed;
+}
+
+void TrackScanner::work() {
+    m_mutex.Lock();
+    while (true) {
+        while (m_active
+                && m_nextFile < m_files.GetCount()
+                && m_nextFile >= m_nextDelivery + m_window) {
+            m_condition.Wait();
+        }
+        if (!m_active || m_nextFile >= m_files.GetCount()) {
+            break;
+        }
+
+        size_t index = m_nextFile++;
+        wxString path = m_files[index];
+        m_mutex.Unlock();
+
+        long long start = m_recordTimes ? nowMicros() : 0;
+        TrackInfo* info = new TrackInfo;
+        try {
+            readTrackInfo(path, *info);
+        } catch (const AudioException& ex) {
+            // this exception is thrown when for instance a file is trying to
+            // be parsed when it's not a valid audio/video file.
+            std::cerr << "TrackScanner() err : " << ex.what() << std::endl;
+            delete info;
+            info = NULL;
+        }
+
+        m_mutex.Lock();
+        if (m_recordTimes) {
+            m_readTimes[index] = nowMicros() - start;
+        }
+        m_results[index] = info;
+        m_done[index] = true;
+        m_condition.Broadcast();
+    }
+    m_mutex.Unlock();
+}
+
+void TrackScanner::readTrackInfo(const wxString& path, TrackInfo& info) throw (AudioException) {
+    if (TagCache::get().lookup(path, info)) {
+        return;
+    }
+
+    // Read the tags straight from the file headers first. Only when
+    // the native reader doesn't understand the file, we take the
+    // slow route by building a GStreamer pipeline.
+    NativeTagReader native(path);
+    if (!native.read(info)) {
+        wxString uri = wxT("file://");
+        uri << path;
+
+        // Reuse a pipeline of an earlier file. One which failed is not
+        // trusted to be reused.
+        TagReaderPool& pool = TagReaderPool::get();
+        TagReader* reader = pool.acquire();
+        try {
+            reader->read(uri);
+        } catch (const AudioException& ex) {
+            pool.discard(reader);
+            throw;
+        }
+        info = reader->getTrackInfo();
+        pool.release(reader);
+    }
+
+    TagCache::get().store(path, info);
+}
+
+} // namespace navi
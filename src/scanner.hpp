@@ -0,0 +1,197 @@
+//      scanner.hpp
+//
+//      Copyright 2012 Kevin Pors <krpors@users.sf.net>
+//
+//      This program is free software; you can redistribute it and/or modify
+//      it under the terms of the GNU General Public License as published by
+//      the Free Software Foundation; either version 2 of the License, or
+//      (at your option) any later version.
+//
+//      This program is distributed in the hope that it will be useful,
+//      but WITHOUT ANY WARRANTY; without even the implied warranty of
+//      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//      GNU General Public License for more details.
+//
+//      You should have received a copy of the GNU General Public License
+//      along with this program; if not, write to the Free Software
+//      Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+//      MA 02110-1301, USA.
+
+#ifndef SCANNER_HPP
+#define SCANNER_HPP
+
+#include "audio.hpp"
+#include "tagparser.hpp"
+#include "tagcache.hpp"
+
+#include <vector>
+
+#include <wx/wx.h>
+#include <wx/thread.h>
+
+namespace navi {
+
+//================================================================================
+
+/**
+ * Interface to receive the results of a TrackScanner.
+ */
+class ScanListener {
+public:
+    virtual ~ScanListener() {}
+
+    /**
+     * Invoked for every file which has been read successfully, in the same order
+     * as the files were handed to TrackScanner::run(). This function is called
+     * on the thread which called run(), never on one of the workers.
+     *
+     * @param index The index of the file in the list given to run().
+     * @param info The read track info, allocated on the heap. The listener
+     *  takes ownership, so it must be deleted (or passed on) by the listener.
+     */
+    virtual void trackScanned(size_t index, TrackInfo* info) throw() = 0;
+
+    /**
+     * Invoked when the next result is not available yet, right before the
+     * scanner starts waiting for it. Listeners which collect results before
+     * passing them on should hand over what they have now. Like trackScanned(),
+     * this is called on the thread which called run().
+     */
+    virtual void scanStalled() throw() = 0;
+};
+
+//================================================================================
+
+/**
+ * The TrackScanner reads the tags of a list of files using a bounded pool of
+ * worker threads. Most of the time of a TagReader is spent waiting for the
+ * GStreamer pipeline to preroll, so reading a few files at a time makes loading
+ * a large directory a lot quicker.
+ *
+ * Workers may finish files in any order, but results are always handed to the
+ * ScanListener in the order of the input list. To keep the amount of finished
+ * but undelivered results bounded, workers never run more than a few files per
+ * thread ahead of the delivery.
+ */
+class TrackScanner {
+private:
+    /**
+     * A worker thread. It just calls TrackScanner::work() until there's
+     * nothing left to do.
+     */
+    class Worker : public wxThread {
+    private:
+        TrackScanner& m_scanner;
+    public:
+        Worker(TrackScanner& scanner);
+        virtual wxThread::ExitCode Entry();
+    };
+
+    /// The listener to deliver the results to.
+    ScanListener* m_listener;
+
+    /// The maximum amount of worker threads.
+    unsigned int m_threadCount;
+
+    /// The files of the current run.
+    wxArrayString m_files;
+
+    /// Finished results by index. NULL for files which failed (or are not done).
+    std::vector<TrackInfo*> m_results;
+
+    /// Whether the file at the same index has been processed.
+    std::vector<bool> m_done;
+
+    /// Index of the next file a worker will pick up.
+    size_t m_nextFile;
+
+    /// Index of the next result to be delivered to the listener.
+    size_t m_nextDelivery;
+
+    /// How far workers may run ahead of m_nextDelivery.
+    size_t m_window;
+
+    /// False when the scan must be aborted.
+    bool m_active;
+
+    /// Whether the read time of every file should be recorded.
+    bool m_recordTimes;
+
+    /// Read times of the files of the last run, in microseconds, by index.
+    std::vector<long> m_readTimes;
+
+    /// Guards all members above which are touched by the workers.
+    wxMutex m_mutex;
+
+    /// Signaled when a result is done, when a result is delivered, or when
+    /// the scanner gets deactivated.
+    wxCondition m_condition;
+
+    /**
+     * The loop of a worker thread. Claims the next file, reads it, and stores
+     * the result until all files are done or the scanner is deactivated.
+     */
+    void work();
+
+public:
+    /// Amount of files a worker may read ahead of the delivery, per thread.
+    static const size_t READ_AHEAD_PER_THREAD = 4;
+
+    /**
+     * Creates the scanner.
+     *
+     * @param listener The listener which receives the results.
+     * @param threadCount The maximum amount of worker threads. When 0, the
+     *  amount of processors is used.
+     */
+    TrackScanner(ScanListener* listener, unsigned int threadCount = 0);
+
+    /**
+     * Reads all files and delivers the results to the listener, in order. This
+     * function blocks until all files are read, or until the scanner is
+     * deactivated using setActive(false).
+     *
+     * @param files The full paths of the files to read.
+     * @return true when all files have been processed, false when aborted.
+     */
+    bool run(const wxArrayString& files);
+
+    /**
+     * Sets the activity state. Setting it to false makes run() return as soon
+     * as the workers have finished the file they are currently reading. This
+     * function can be called from any thread.
+     *
+     * @param active false to abort the scan.
+     */
+    void setActive(bool active);
+
+    /**
+     * Enables recording how long reading every single file takes. Used by the
+     * benchmark (see bench.cpp), the DirTraversalThread doesn't need it.
+     *
+     * @param record true to record the read times of the following runs.
+     */
+    void setRecordTimes(bool record);
+
+    /**
+     * Returns the read times of the last run, in microseconds, in the order
+     * of the input list. Only filled when setRecordTimes(true) was called.
+     */
+    const std::vector<long>& getReadTimes() const;
+
+    /**
+     * Reads the tags of a single file. The TagCache is consulted first, then
+     * the NativeTagReader, and when all else fails, the (slow) TagReader,
+     * taken from the TagReaderPool.
+     * Freshly read tags are stored in the cache.
+     *
+     * @param path The full path to the file.
+     * @param info The TrackInfo to fill.
+     * @throws AudioException when the TagReader fails.
+     */
+    static void readTrackInfo(const wxString& path, TrackInfo& info) throw (AudioException);
+};
+
+} // namespace navi
+
+#endif // SCANNER_HPP
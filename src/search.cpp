@@ -0,0 +1,250 @@
+//      search.cpp
+//
+//      Copyright 2012 Kevin Pors <krpors@users.sf.net>
+//
+//      This program is free software; you can redistribute it and/or modify
+//      it under the terms of the GNU General Public License as published by
+//      the Free Software Foundation; either version 2 of the License, or
+//      (at your option) any later version.
+//
+//      This program is distributed in the hope that it will be useful,
+//      but WITHOUT ANY WARRANTY; without even the implied warranty of
+//      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//      GNU General Public License for more details.
+//
+//      You should have received a copy of the GNU General Public License
+//      along with this program; if not, write to the Free Software
+//      Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+//      MA 02110-1301, USA.
+
+#include "search.hpp"
+
+#include <algorithm>
+#include <cctype>
+
+namespace navi {
+
+/// Orders postings by length, so the shortest one is intersected first.
+static bool shorterPostings(const std::vector<unsigned int>* one, const std::vector<unsigned int>* two) {
+    return one->size() < two->size();
+}
+
+//================================================================================
+
+SearchIndex::SearchIndex() :
+        m_count(0) {
+}
+
+std::string SearchIndex::normalize(const wxString& text) {
+    return std::string(text.Lower().mb_str(wxConvUTF8));
+}
+
+void SearchIndex::collectTrigrams(const std::string& text, std::vector<Trigram>& trigrams) {
+    trigrams.clear();
+    if (text.size() < 3) {
+        return;
+    }
+
+    trigrams.reserve(text.size());
+    for (size_t i = 0; i + 2 < text.size(); i++) {
+        unsigned char a = text[i];
+        unsigned char b = text[i + 1];
+        unsigned char c = text[i + 2];
+        if (a == FIELD_SEPARATOR || b == FIELD_SEPARATOR || c == FIELD_SEPARATOR) {
+            continue;
+        }
+        trigrams.push_back((a << 16) | (b << 8) | c);
+    }
+
+    std::sort(trigrams.begin(), trigrams.end());
+    trigrams.erase(std::unique(trigrams.begin(), trigrams.end()), trigrams.end());
+}
+
+void SearchIndex::splitWords(const wxString& query, std::vector<std::string>& words) {
+    words.clear();
+    std::string normalized = normalize(query);
+
+    size_t start = 0;
+    for (size_t i = 0; i <= normalized.size(); i++) {
+        if (i == normalized.size() || isspace(static_cast<unsigned char>(normalized[i]))) {
+            if (i > start) {
+                words.push_back(normalized.substr(start, i - start));
+            }
+            start = i + 1;
+        }
+    }
+}
+
+bool SearchIndex::containsAll(const std::string& text, const std::vector<std::string>& words) {
+    for (size_t i = 0; i < words.size(); i++) {
+        if (text.find(words[i]) == std::string::npos) {
+            return false;
+        }
+    }
+    return true;
+}
+
+std::string SearchIndex::makeText(const TrackInfo& info) {
+    std::string text;
+    text += normalize(info.get(TrackInfo::TAG_ARTIST));
+    text += FIELD_SEPARATOR;
+    text += normalize(info.get(TrackInfo::TAG_TITLE));
+    text += FIELD_SEPARATOR;
+    text += normalize(info.get(TrackInfo::TAG_ALBUM));
+    text += FIELD_SEPARATOR;
+    text += normalize(info.getSimpleName());
+    return text;
+}
+
+void SearchIndex::add(long id, const TrackInfo& info) {
+    add(id, makeText(info));
+}
+
+void SearchIndex::add(long id, const std::string& text) {
+    remove(id);
+
+    if (static_cast<size_t>(id) >= m_texts.size()) {
+        m_texts.resize(id + 1);
+    }
+    m_texts[id] = text;
+    m_count++;
+
+    std::vector<Trigram> trigrams;
+    collectTrigrams(text, trigrams);
+    for (size_t i = 0; i < trigrams.size(); i++) {
+        Postings& postings = m_postings[trigrams[i]];
+        if (postings.empty() || postings.back() < static_cast<unsigned int>(id)) {
+            // the common case: tracks are added in the order of their ids.
+            postings.push_back(id);
+        } else {
+            postings.insert(std::lower_bound(postings.begin(), postings.end(),
+                static_cast<unsigned int>(id)), id);
+        }
+    }
+}
+
+void SearchIndex::remove(long id) {
+    if (id < 0 || static_cast<size_t>(id) >= m_texts.size() || m_texts[id].empty()) {
+        return;
+    }
+
+    std::vector<Trigram> trigrams;
+    collectTrigrams(m_texts[id], trigrams);
+    for (size_t i = 0; i < trigrams.size(); i++) {
+        std::map<Trigram, Postings>::iterator it = m_postings.find(trigrams[i]);
+        if (it == m_postings.end()) {
+            continue;
+        }
+        Postings& postings = it->second;
+        Postings::iterator pos = std::lower_bound(postings.begin(), postings.end(),
+            static_cast<unsigned int>(id));
+        if (pos != postings.end() && *pos == static_cast<unsigned int>(id)) {
+            postings.erase(pos);
+        }
+        if (postings.empty()) {
+            m_postings.erase(it);
+        }
+    }
+
+    // swap, so the memory is released too.
+    std::string().swap(m_texts[id]);
+    m_count--;
+}
+
+void SearchIndex::clear() {
+    m_postings.clear();
+    std::vector<std::string>().swap(m_texts);
+    m_count = 0;
+}
+
+void SearchIndex::compact(const std::vector<long>& remap) {
+    // the ids keep their order, so the postings stay sorted.
+    std::map<Trigram, Postings>::iterator it;
+    for (it = m_postings.begin(); it != m_postings.end(); it++) {
+        Postings& postings = it->second;
+        for (size_t i = 0; i < postings.size(); i++) {
+            postings[i] = remap[postings[i]];
+        }
+    }
+
+    std::vector<std::string> texts;
+    texts.reserve(m_count);
+    for (size_t id = 0; id < m_texts.size() && id < remap.size(); id++) {
+        if (remap[id] == -1) {
+            continue;
+        }
+        if (static_cast<size_t>(remap[id]) >= texts.size()) {
+            texts.resize(remap[id] + 1);
+        }
+        texts[remap[id]].swap(m_texts[id]);
+    }
+    m_texts.swap(texts);
+}
+
+size_t SearchIndex::size() const {
+    return m_count;
+}
+
+void SearchIndex::find(const wxString& query, std::vector<long>& ids) const {
+    std::vector<std::string> words;
+    splitWords(query, words);
+    find(words, ids);
+}
+
+void SearchIndex::find(const std::vector<std::string>& words, std::vector<long>& ids) const {
+    ids.clear();
+
+    // The postings of all trigrams of all words. A track must be in each.
+    std::vector<const Postings*> lists;
+    std::vector<Trigram> trigrams;
+    for (size_t w = 0; w < words.size(); w++) {
+        collectTrigrams(words[w], trigrams);
+        for (size_t i = 0; i < trigrams.size(); i++) {
+            std::map<Trigram, Postings>::const_iterator it = m_postings.find(trigrams[i]);
+            if (it == m_postings.end()) {
+                // no track has it, so no track matches.
+                return;
+            }
+            lists.push_back(&it->second);
+        }
+    }
+
+    if (lists.empty()) {
+        // only short words (or none at all): check every track.
+        for (size_t id = 0; id < m_texts.size(); id++) {
+            if (!m_texts[id].empty() && containsAll(m_texts[id], words)) {
+                ids.push_back(id);
+            }
+        }
+        return;
+    }
+
+    std::sort(lists.begin(), lists.end(), shorterPostings);
+    const Postings& shortest = *lists[0];
+    for (size_t i = 0; i < shortest.size(); i++) {
+        unsigned int id = shortest[i];
+        bool inAll = true;
+        for (size_t l = 1; l < lists.size() && inAll; l++) {
+            inAll = std::binary_search(lists[l]->begin(), lists[l]->end(), id);
+        }
+        // having all trigrams doesn't mean the words are in there, in order.
+        if (inAll && containsAll(m_texts[id], words)) {
+            ids.push_back(id);
+        }
+    }
+}
+
+bool SearchIndex::matches(long id, const wxString& query) const {
+    std::vector<std::string> words;
+    splitWords(query, words);
+    return matches(id, words);
+}
+
+bool SearchIndex::matches(long id, const std::vector<std::string>& words) const {
+    if (id < 0 || static_cast<size_t>(id) >= m_texts.size() || m_texts[id].empty()) {
+        return false;
+    }
+    return containsAll(m_texts[id], words);
+}
+
+} // namespace navi
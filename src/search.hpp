@@ -0,0 +1,196 @@
+//      search.hpp
+//
+//      Copyright 2012 Kevin Pors <krpors@users.sf.net>
+//
+//      This program is free software; you can redistribute it and/or modify
+//      it under the terms of the GNU General Public License as published by
+//      the Free Software Foundation; either version 2 of the License, or
+//      (at your option) any later version.
+//
+//      This program is distributed in the hope that it will be useful,
+//      but WITHOUT ANY WARRANTY; without even the implied warranty of
+//      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//      GNU General Public License for more details.
+//
+//      You should have received a copy of the GNU General Public License
+//      along with this program; if not, write to the Free Software
+//      Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+//      MA 02110-1301, USA.
+
+#ifndef SEARCH_HPP
+#define SEARCH_HPP
+
+#include "audio.hpp"
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include <wx/wx.h>
+
+namespace navi {
+
+//================================================================================
+
+/**
+ * A trigram index over the artist, title, album and file name of tracks, used
+ * to filter the TrackTable while typing.
+ *
+ * The searchable text of every track is lower cased and stored as UTF-8. For
+ * every three consecutive bytes of it (within one field) the index keeps a
+ * sorted list of the tracks which contain them. A query is split in words, and
+ * a track matches when every word occurs somewhere in its text. The candidates
+ * are found by intersecting the lists of the trigrams of the query (starting
+ * with the shortest one), and are then checked for the actual words, so
+ * searching hardly depends on the amount of tracks. Words shorter than three
+ * characters can't be looked up, so a query with only those checks every track.
+ *
+ * Tracks are identified by an id chosen by the caller (the TrackTable uses the
+ * index in its backing vector). Ids should be small and dense, since the texts
+ * are stored in a vector indexed by them. Adding tracks in increasing id order
+ * is the cheapest, which is what happens while a directory is read.
+ */
+class SearchIndex {
+private:
+    /// Three bytes of text, packed in an int.
+    typedef unsigned int Trigram;
+
+    /// The ids of the tracks containing a trigram, in ascending order.
+    typedef std::vector<unsigned int> Postings;
+
+    /// The postings by trigram.
+    std::map<Trigram, Postings> m_postings;
+
+    /// The searchable texts by id. Empty for ids which are not in the index.
+    std::vector<std::string> m_texts;
+
+    /// Amount of tracks in the index.
+    size_t m_count;
+
+    /**
+     * Collects the distinct trigrams of a text. Trigrams which span the field
+     * separator are left out.
+     *
+     * @param text The searchable (or query) text.
+     * @param trigrams Receives the trigrams, sorted.
+     */
+    static void collectTrigrams(const std::string& text, std::vector<Trigram>& trigrams);
+
+    /**
+     * Whether the text contains all words.
+     */
+    static bool containsAll(const std::string& text, const std::vector<std::string>& words);
+
+public:
+    /// Separates the fields in the searchable text.
+    static const char FIELD_SEPARATOR = '\n';
+
+    /**
+     * Creates an empty index.
+     */
+    SearchIndex();
+
+    /**
+     * Lower cases a text and converts it to UTF-8, the way both the tracks and
+     * the queries are compared.
+     *
+     * @param text The text.
+     * @return The normalized text.
+     */
+    static std::string normalize(const wxString& text);
+
+    /**
+     * Splits a query in normalized words. A query which is used for many
+     * tracks is best split once, see matches().
+     *
+     * @param query The query, as typed.
+     * @param words Receives the words.
+     */
+    static void splitWords(const wxString& query, std::vector<std::string>& words);
+
+    /**
+     * Returns the searchable text of a track: its normalized artist, title,
+     * album and file name. It doesn't touch an index, so another thread may
+     * prepare the texts (see TrackInfoBatch::prepare()).
+     *
+     * @param info The track.
+     */
+    static std::string makeText(const TrackInfo& info);
+
+    /**
+     * Adds a track to the index. When there already is a track with this id,
+     * it's replaced.
+     *
+     * @param id The id of the track.
+     * @param info The track.
+     */
+    void add(long id, const TrackInfo& info);
+
+    /**
+     * Adds a track to the index by its searchable text (see makeText()).
+     *
+     * @param id The id of the track.
+     * @param text The searchable text of the track.
+     */
+    void add(long id, const std::string& text);
+
+    /**
+     * Removes a track from the index. Nothing happens if it's not in there.
+     *
+     * @param id The id of the track.
+     */
+    void remove(long id);
+
+    /**
+     * Removes all tracks.
+     */
+    void clear();
+
+    /**
+     * Renumbers the tracks, after the caller dropped some of its ids and moved
+     * the others down. Nothing is normalized again, only the ids are replaced.
+     *
+     * @param remap The new id of every old id, -1 for ids which are gone.
+     *  Those must have been removed from the index already, and the order of
+     *  the others must stay the same.
+     */
+    void compact(const std::vector<long>& remap);
+
+    /**
+     * Returns the amount of tracks in the index.
+     */
+    size_t size() const;
+
+    /**
+     * Finds all tracks which match a query.
+     *
+     * @param query The query. Every (whitespace separated) word must occur in
+     *  the artist, title, album or file name of a track, ignoring case.
+     * @param ids Receives the ids of the matching tracks, in ascending order.
+     *  An empty query matches every track.
+     */
+    void find(const wxString& query, std::vector<long>& ids) const;
+
+    /**
+     * Finds all tracks which match a query, split by splitWords().
+     */
+    void find(const std::vector<std::string>& words, std::vector<long>& ids) const;
+
+    /**
+     * Whether a single track matches a query, like find() would decide.
+     *
+     * @param id The id of the track.
+     * @param query The query.
+     * @return false if the track doesn't match, or is not in the index.
+     */
+    bool matches(long id, const wxString& query) const;
+
+    /**
+     * Whether a single track matches a query, split by splitWords().
+     */
+    bool matches(long id, const std::vector<std::string>& words) const;
+};
+
+} // namespace navi
+
+#endif // SEARCH_HPP
@@ -40,7 +40,12 @@ StreamTable::StreamTable(wxWindow* parent) :
     InsertColumn(1, item);
     SetColumnWidth(1, 340);
 
-    loadFromFile();
+    item.SetText(wxT("Stalls"));
+    InsertColumn(2, item);
+    SetColumnWidth(2, 100);
+
+    // the streams are loaded when the main frame is on screen, see
+    // NaviMainFrame::initDeferred().
 }
 
 const wxString StreamTable::getCellContents(long row, long col) const {
@@ -64,8 +69,9 @@ void StreamTable::onResize(wxSizeEvent& event) {
     GetSize(&width, &height);
 
     // automatically set some widths here after resizing
-    SetColumnWidth(0, 0.5 * width);
-    SetColumnWidth(1, 0.5 * width);
+    SetColumnWidth(0, 0.4 * width);
+    SetColumnWidth(1, 0.4 * width);
+    SetColumnWidth(2, 0.2 * width);
 
     // re-layout the control, to make sure the column sizes are actually being done.
     Layout();
@@ -110,6 +116,30 @@ void StreamTable::addStream(const wxString& desc, const wxString& loc) {
 
     SetItem(index, 0, desc);
     SetItem(index, 1, loc);
+    setStallsCell(index);
+}
+
+void StreamTable::setStallsCell(long row) {
+    StallStatistics::Stalls stalls = m_stallStatistics.getStalls(getLocation(row));
+    wxString text;
+    if (stalls.count > 0) {
+        // how often, and how long it was silent in total.
+        text << stalls.count << wxT(" (") << formatSeconds(stalls.milliseconds / 1000) << wxT(")");
+    } else {
+        text = wxT("-");
+    }
+    SetItem(row, 2, text);
+}
+
+void StreamTable::recordStall(const wxString& location, unsigned long milliseconds) {
+    m_stallStatistics.addStall(location, milliseconds);
+    m_stallStatistics.save();
+
+    for (long i = 0; i < GetItemCount(); i++) {
+        if (getLocation(i) == location) {
+            setStallsCell(i);
+        }
+    }
 }
 
 void StreamTable::removeSelectedStream() {
@@ -133,6 +163,8 @@ void StreamTable::saveToFile() {
 }
 
 void StreamTable::loadFromFile() {
+    m_stallStatistics.load();
+
     StreamConfiguration sc;
     sc.load(); // load configured streams
     std::vector<std::pair<wxString, wxString> >::iterator it;
@@ -22,6 +22,7 @@
 
 #include "audio.hpp"
 #include "main.hpp"
+#include "misc.hpp"
 
 #include <wx/wx.h>
 #include <wx/app.h>
@@ -42,8 +43,14 @@ class NaviMainFrame;
 
 class StreamTable: public wxListCtrl {
 private:
+    /// How often the stations stalled, shown in the last column.
+    StallStatistics m_stallStatistics;
+
     const wxString getCellContents(long row, long col) const;
 
+    /// Shows the stalls of the station on a row.
+    void setStallsCell(long row);
+
 public:
 
     /// The window ID for this track table.
@@ -62,6 +69,14 @@ public:
     void saveToFile();
     void loadFromFile();
 
+    /**
+     * Records that a station stalled (ran out of buffered data), and shows it.
+     *
+     * @param location The location of the station.
+     * @param milliseconds How long it took until it played again.
+     */
+    void recordStall(const wxString& location, unsigned long milliseconds);
+
     DECLARE_EVENT_TABLE()
 };
 
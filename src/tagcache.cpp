@@ -0,0 +1,366 @@
+//      tagcache.cpp
+//
+//      Copyright 2012 Kevin Pors <krpors@users.sf.net>
+//
+//      This program is free software; you can redistribute it and/or modify
+//      it under the terms of the GNU General Public License as published by
+//      the Free Software Foundation; either version 2 of the License, or
+//      (at your option) any later version.
+//
+//      This program is distributed in the hope that it will be useful,
+//      but WITHOUT ANY WARRANTY; without even the implied warranty of
+//      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//      GNU General Public License for more details.
+//
+//      You should have received a copy of the GNU General Public License
+//      along with this program; if not, write to the Free Software
+//      Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+//      MA 02110-1301, USA.
+
+#include "tagcache.hpp"
+#include "misc.hpp"
+
+#include <set>
+#include <vector>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+
+#include <sys/stat.h>
+
+namespace navi {
+
+/// First line of the cache file. Bump the number when the layout changes.
+static const char* CACHE_HEADER = "navi-tagcache 2";
+
+/// First line of the previous layout, without the exact duration flag. These
+/// files are still read, their durations are taken as estimates.
+static const char* CACHE_HEADER_V1 = "navi-tagcache 1";
+
+/// Prefix of the last line of the cache file, followed by the entry count.
+static const char* CACHE_END = "#end ";
+
+/// The fields of a line (separated by tabs) are: path, size, mtime, duration,
+/// whether the duration is exact (1 or 0) and the known tags, in the order of
+/// TrackInfo::Tag. Version 1 files lack the exact flag.
+static const size_t CACHE_TAG_FIELD = 5;
+
+/// Escapes tabs, newlines and backslashes so a value fits in a field.
+static void appendEscaped(std::string& out, const wxString& value) {
+    std::string utf8(value.mb_str(wxConvUTF8));
+    for (size_t i = 0; i < utf8.size(); i++) {
+        switch (utf8[i]) {
+            case '\t': out += "\\t"; break;
+            case '\n': out += "\\n"; break;
+            case '\\': out += "\\\\"; break;
+            default: out += utf8[i]; break;
+        }
+    }
+}
+
+/// The reverse of appendEscaped().
+static wxString unescape(const std::string& field) {
+    std::string utf8;
+    utf8.reserve(field.size());
+    for (size_t i = 0; i < field.size(); i++) {
+        if (field[i] == '\\' && i + 1 < field.size()) {
+            i++;
+            utf8 += (field[i] == 't') ? '\t' : (field[i] == 'n') ? '\n' : field[i];
+        } else {
+            utf8 += field[i];
+        }
+    }
+    return wxString(utf8.c_str(), wxConvUTF8);
+}
+
+//================================================================================
+
+TagCache* TagCache::s_instance = NULL;
+
+wxMutex TagCache::s_instanceMutex;
+
+const wxString TagCache::CACHE_FILE = wxT("tagcache");
+
+TagCache::TagCache() :
+        m_loaded(false),
+        m_dirty(false),
+        m_enabled(true),
+        m_hits(0),
+        m_misses(0) {
+    // same location as the preferences and the streams.
+    wxStandardPathsBase& wxsp = wxStandardPaths::Get();
+    wxFileName naviDir(wxsp.GetUserConfigDir(), wxT(".navi"));
+    if (!wxDirExists(naviDir.GetFullPath())) {
+        wxMkdir(naviDir.GetFullPath());
+    }
+
+    m_cacheFile = wxFileName(naviDir.GetFullPath(), CACHE_FILE);
+}
+
+TagCache& TagCache::get() {
+    wxMutexLocker lock(s_instanceMutex);
+    if (s_instance == NULL) {
+        s_instance = new TagCache;
+    }
+    return *s_instance;
+}
+
+bool TagCache::statFile(const wxString& path, long long& size, long long& mtime) {
+    struct stat st;
+    if (stat(path.fn_str(), &st) != 0) {
+        return false;
+    }
+    size = st.st_size;
+    mtime = st.st_mtime;
+    return true;
+}
+
+void TagCache::load() {
+    m_loaded = true;
+
+    const wxString& path = m_cacheFile.GetFullPath();
+    if (!wxFileExists(path)) {
+        return;
+    }
+
+    wxFile file;
+    if (!file.Open(path)) {
+        return;
+    }
+
+    wxFileOffset len = file.Length();
+    if (len <= 0) {
+        return;
+    }
+    std::vector<char> buf(len);
+    if (file.Read(&buf[0], len) != len) {
+        return;
+    }
+
+    std::map<wxString, Entry> entries;
+    bool headerSeen = false;
+    bool endSeen = false;
+    // index of the first tag field, which depends on the version.
+    size_t tagField = CACHE_TAG_FIELD;
+    size_t pos = 0;
+
+    while (pos < buf.size() && !endSeen) {
+        size_t eol = pos;
+        while (eol < buf.size() && buf[eol] != '\n') {
+            eol++;
+        }
+        std::string line(&buf[pos], eol - pos);
+        pos = eol + 1;
+
+        if (!headerSeen) {
+            if (line == CACHE_HEADER_V1) {
+                tagField = 4;
+            } else if (line != CACHE_HEADER) {
+                std::cerr << "Tag cache has an unknown format, ignoring it." << std::endl;
+                return;
+            }
+            headerSeen = true;
+            continue;
+        }
+
+        if (line.compare(0, strlen(CACHE_END), CACHE_END) == 0) {
+            endSeen = strtoul(line.c_str() + strlen(CACHE_END), NULL, 10) == entries.size();
+            break;
+        }
+
+        std::vector<std::string> fields;
+        size_t start = 0;
+        for (size_t i = 0; i <= line.size(); i++) {
+            if (i == line.size() || line[i] == '\t') {
+                fields.push_back(line.substr(start, i - start));
+                start = i + 1;
+            }
+        }
+        if (fields.size() != tagField + TrackInfo::TAG_COUNT) {
+            break;
+        }
+
+        wxString filePath = unescape(fields[0]);
+        Entry& entry = entries[filePath];
+        entry.size = strtoll(fields[1].c_str(), NULL, 10);
+        entry.mtime = strtoll(fields[2].c_str(), NULL, 10);
+        bool exact = tagField == CACHE_TAG_FIELD && fields[4] == "1";
+        entry.info.setDurationSeconds(strtol(fields[3].c_str(), NULL, 10), exact);
+
+        wxString uri = wxT("file://");
+        uri << filePath;
+        entry.info.setLocation(uri);
+        for (int t = 0; t < TrackInfo::TAG_COUNT; t++) {
+            if (!fields[tagField + t].empty()) {
+                entry.info.set(static_cast<TrackInfo::Tag>(t), unescape(fields[tagField + t]));
+            }
+        }
+    }
+
+    // A file without a (matching) end marker was not written completely.
+    if (!endSeen) {
+        std::cerr << "Tag cache is incomplete, ignoring it." << std::endl;
+        return;
+    }
+
+    m_entries.swap(entries);
+}
+
+bool TagCache::lookup(const wxString& path, TrackInfo& info) {
+    if (!m_enabled) {
+        return false;
+    }
+
+    long long size, mtime;
+    bool exists = statFile(path, size, mtime);
+
+    wxMutexLocker lock(m_mutex);
+    if (!m_loaded) {
+        load();
+    }
+
+    std::map<wxString, Entry>::iterator it = m_entries.find(path);
+    if (it == m_entries.end()) {
+        m_misses++;
+        return false;
+    }
+
+    if (!exists || it->second.size != size || it->second.mtime != mtime) {
+        // the file changed (or vanished) since we've read it.
+        m_entries.erase(it);
+        m_dirty = true;
+        m_misses++;
+        return false;
+    }
+
+    info = it->second.info;
+    m_hits++;
+    return true;
+}
+
+void TagCache::store(const wxString& path, const TrackInfo& info) {
+    if (!m_enabled) {
+        return;
+    }
+
+    long long size, mtime;
+    if (!statFile(path, size, mtime)) {
+        return;
+    }
+
+    wxMutexLocker lock(m_mutex);
+    if (!m_loaded) {
+        load();
+    }
+
+    Entry& entry = m_entries[path];
+    entry.size = size;
+    entry.mtime = mtime;
+    entry.info = info;
+    m_dirty = true;
+}
+
+void TagCache::remove(const wxString& path) {
+    wxMutexLocker lock(m_mutex);
+    if (m_entries.erase(path) > 0) {
+        m_dirty = true;
+    }
+}
+
+void TagCache::prune(const wxString& dir, const wxArrayString& present) {
+    std::set<wxString> presentSet;
+    for (size_t i = 0; i < present.GetCount(); i++) {
+        presentSet.insert(present[i]);
+    }
+
+    wxString prefix = dir;
+    if (!prefix.EndsWith(wxT("/"))) {
+        prefix << wxT("/");
+    }
+
+    wxMutexLocker lock(m_mutex);
+    // the map is sorted, so all files in `dir' are in one consecutive range.
+    std::map<wxString, Entry>::iterator it = m_entries.lower_bound(prefix);
+    while (it != m_entries.end() && it->first.StartsWith(prefix)) {
+        bool inSubDir = it->first.Mid(prefix.Len()).Find(wxT('/')) != wxNOT_FOUND;
+        if (!inSubDir && presentSet.find(it->first) == presentSet.end()) {
+            m_entries.erase(it++);
+            m_dirty = true;
+        } else {
+            ++it;
+        }
+    }
+}
+
+bool TagCache::save() {
+    // One save at a time, from taking the snapshot until it's committed:
+    // otherwise an older snapshot could be renamed over a newer one, which
+    // has already cleared m_dirty.
+    wxMutexLocker saveLock(m_saveMutex);
+
+    // serialize while holding the lock, but write the file without it so the
+    // scanning threads don't have to wait for the disk.
+    std::string out;
+    {
+        wxMutexLocker lock(m_mutex);
+        if (!m_dirty) {
+            return true;
+        }
+
+        out.reserve(m_entries.size() * 128);
+        out += CACHE_HEADER;
+        out += '\n';
+
+        std::map<wxString, Entry>::iterator it = m_entries.begin();
+        while (it != m_entries.end()) {
+            Entry& entry = it->second;
+            appendEscaped(out, it->first);
+            out += '\t';
+            out += wxString::Format(wxT("%lld\t%lld\t%i\t%i"),
+                entry.size, entry.mtime, entry.info.getDurationSeconds(),
+                entry.info.isDurationExact() ? 1 : 0).mb_str(wxConvUTF8);
+            for (int t = 0; t < TrackInfo::TAG_COUNT; t++) {
+                out += '\t';
+                appendEscaped(out, entry.info.get(static_cast<TrackInfo::Tag>(t)));
+            }
+            out += '\n';
+            it++;
+        }
+
+        out += CACHE_END;
+        out += wxString::Format(wxT("%lu"), (unsigned long) m_entries.size()).mb_str(wxConvUTF8);
+        out += '\n';
+
+        m_dirty = false;
+    }
+
+    // Written to a temporary file in the same directory, which is flushed to
+    // the disk and renamed over the cache file. A crash or a power loss
+    // halfway leaves the old file.
+    SyncedTempFile file(m_cacheFile.GetFullPath());
+    if (!file.isOpened() || !file.write(out.data(), out.size()) || !file.commit()) {
+        std::cerr << "Failed to write the tag cache." << std::endl;
+        wxMutexLocker lock(m_mutex);
+        m_dirty = true;
+        return false;
+    }
+
+    return true;
+}
+
+void TagCache::setEnabled(bool enabled) {
+    wxMutexLocker lock(m_mutex);
+    m_enabled = enabled;
+}
+
+unsigned long TagCache::getHits() {
+    wxMutexLocker lock(m_mutex);
+    return m_hits;
+}
+
+unsigned long TagCache::getMisses() {
+    wxMutexLocker lock(m_mutex);
+    return m_misses;
+}
+
+} // namespace navi
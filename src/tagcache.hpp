@@ -0,0 +1,187 @@
+//      tagcache.hpp
+//
+//      Copyright 2012 Kevin Pors <krpors@users.sf.net>
+//
+//      This program is free software; you can redistribute it and/or modify
+//      it under the terms of the GNU General Public License as published by
+//      the Free Software Foundation; either version 2 of the License, or
+//      (at your option) any later version.
+//
+//      This program is distributed in the hope that it will be useful,
+//      but WITHOUT ANY WARRANTY; without even the implied warranty of
+//      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//      GNU General Public License for more details.
+//
+//      You should have received a copy of the GNU General Public License
+//      along with this program; if not, write to the Free Software
+//      Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+//      MA 02110-1301, USA.
+
+#ifndef TAGCACHE_HPP
+#define TAGCACHE_HPP
+
+#include "audio.hpp"
+
+#include <map>
+#include <string>
+
+#include <wx/wx.h>
+#include <wx/file.h>
+#include <wx/filename.h>
+#include <wx/stdpaths.h>
+#include <wx/thread.h>
+
+namespace navi {
+
+//================================================================================
+
+/**
+ * The TagCache is a persistent cache of read TrackInfo objects, stored in the
+ * ~/.navi directory. Entries are keyed by the path of the file, and are only
+ * valid as long as the size and the modification time of the file are the same
+ * as when the tags were read. Re-activating a directory we've seen before is
+ * then a matter of a few stat() calls instead of parsing every file again.
+ *
+ * The cache is shared by all directory traversal threads, so every public
+ * function is guarded by a mutex. Retrieve the instance with TagCache::get().
+ *
+ * The cache file is written to a temporary file first, which is renamed over
+ * the old one when it's complete and on the disk (see SyncedTempFile). An
+ * `end' marker at the bottom of the file makes sure a truncated file is never
+ * trusted.
+ */
+class TagCache {
+private:
+    /// A single cache entry.
+    struct Entry {
+        /// Size of the file in bytes, when the tags were read.
+        long long size;
+        /// Modification time of the file, when the tags were read.
+        long long mtime;
+        /// The read tags (and duration).
+        TrackInfo info;
+    };
+
+    /// The single instance.
+    static TagCache* s_instance;
+
+    /// Guards the creation of s_instance.
+    static wxMutex s_instanceMutex;
+
+    /// All entries, keyed by full path.
+    std::map<wxString, Entry> m_entries;
+
+    /// Guards everything in here.
+    wxMutex m_mutex;
+
+    /// Makes sure only one thread saves at a time, from the snapshot until the
+    /// file is committed. Taken before m_mutex.
+    wxMutex m_saveMutex;
+
+    /// The location of the cache file.
+    wxFileName m_cacheFile;
+
+    /// Whether the cache file has been loaded yet (it's done lazily).
+    bool m_loaded;
+
+    /// Whether there are changes which have not been saved.
+    bool m_dirty;
+
+    /// When false, lookups always miss and nothing is stored.
+    bool m_enabled;
+
+    /// Amount of successful lookups.
+    unsigned long m_hits;
+
+    /// Amount of failed lookups (unknown, or changed files).
+    unsigned long m_misses;
+
+    /**
+     * Private constructor, use get().
+     */
+    TagCache();
+
+    /**
+     * Loads the cache file, if it exists and is valid. Must be called with
+     * the mutex locked.
+     */
+    void load();
+
+    /**
+     * Gets the size and modification time of a file.
+     *
+     * @return false if the file could not be stat()'ed.
+     */
+    static bool statFile(const wxString& path, long long& size, long long& mtime);
+
+public:
+    /// The filename of the cache, inside the ~/.navi directory.
+    static const wxString CACHE_FILE;
+
+    /**
+     * Returns the single TagCache instance. It's created on the first call,
+     * which NaviMainFrame::initDeferred() makes, but any thread may be the
+     * first.
+     */
+    static TagCache& get();
+
+    /**
+     * Looks up the tags of a file. The entry is only used when the file still
+     * has the same size and modification time. Stale entries are dropped.
+     *
+     * @param path The full path to the file.
+     * @param info The TrackInfo to fill when the lookup succeeded.
+     * @return true on a cache hit, false otherwise.
+     */
+    bool lookup(const wxString& path, TrackInfo& info);
+
+    /**
+     * Stores (or replaces) the tags of a file.
+     *
+     * @param path The full path to the file.
+     * @param info The tags read from the file.
+     */
+    void store(const wxString& path, const TrackInfo& info);
+
+    /**
+     * Removes the entry of a single file, if there is one.
+     *
+     * @param path The full path to the file.
+     */
+    void remove(const wxString& path);
+
+    /**
+     * Drops entries of files which are directly inside `dir', but which are
+     * not in the list of present files anymore (i.e. they were deleted).
+     *
+     * @param dir The directory which has been read completely.
+     * @param present The full paths of the files which are still there.
+     */
+    void prune(const wxString& dir, const wxArrayString& present);
+
+    /**
+     * Writes the cache to disk, when anything has changed since the last save.
+     *
+     * @return false if writing the file failed.
+     */
+    bool save();
+
+    /**
+     * Enables or disables the cache. A disabled cache never finds anything
+     * and doesn't store anything, which is what the benchmark uses to measure
+     * the actual tag readers. Call it before any scanning starts.
+     *
+     * @param enabled false to disable the cache.
+     */
+    void setEnabled(bool enabled);
+
+    /// Returns the amount of cache hits since startup.
+    unsigned long getHits();
+
+    /// Returns the amount of cache misses since startup.
+    unsigned long getMisses();
+};
+
+} // namespace navi
+
+#endif // TAGCACHE_HPP
@@ -0,0 +1,1033 @@
+//      tagparser.cpp
+//
+//      Copyright 2012 Kevin Pors <krpors@users.sf.net>
+//
+//      This program is free software; you can redistribute it and/or modify
+//      it under the terms of the GNU General Public License as published by
+//      the Free Software Foundation; either version 2 of the License, or
+//      (at your option) any later version.
+//
+//      This program is distributed in the hope that it will be useful,
+//      but WITHOUT ANY WARRANTY; without even the implied warranty of
+//      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//      GNU General Public License for more details.
+//
+//      You should have received a copy of the GNU General Public License
+//      along with this program; if not, write to the Free Software
+//      Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+//      MA 02110-1301, USA.
+
+#include "tagparser.hpp"
+
+#include <cstring>
+#include <string>
+
+namespace navi {
+
+/// Frames and comment blocks larger than this are skipped (usually pictures).
+static const long long MAX_TAG_PAYLOAD = 1024 * 1024;
+
+/// The amount of bytes searched for the first MPEG frame after an ID3v2 tag.
+static const long long MPEG_SYNC_SEARCH = 64 * 1024;
+
+/// The amount of bytes at the end of an Ogg file searched for the last page.
+static const long long OGG_TAIL_SEARCH = 64 * 1024;
+
+/// ID3v1 genres, including the Winamp extensions.
+static const char* s_genres[] = {
+    "Blues", "Classic Rock", "Country", "Dance", "Disco", "Funk", "Grunge",
+    "Hip-Hop", "Jazz", "Metal", "New Age", "Oldies", "Other", "Pop", "R&B",
+    "Rap", "Reggae", "Rock", "Techno", "Industrial", "Alternative", "Ska",
+    "Death Metal", "Pranks", "Soundtrack", "Euro-Techno", "Ambient",
+    "Trip-Hop", "Vocal", "Jazz+Funk", "Fusion", "Trance", "Classical",
+    "Instrumental", "Acid", "House", "Game", "Sound Clip", "Gospel", "Noise",
+    "AlternRock", "Bass", "Soul", "Punk", "Space", "Meditative",
+    "Instrumental Pop", "Instrumental Rock", "Ethnic", "Gothic", "Darkwave",
+    "Techno-Industrial", "Electronic", "Pop-Folk", "Eurodance", "Dream",
+    "Southern Rock", "Comedy", "Cult", "Gangsta", "Top 40", "Christian Rap",
+    "Pop/Funk", "Jungle", "Native American", "Cabaret", "New Wave",
+    "Psychadelic", "Rave", "Showtunes", "Trailer", "Lo-Fi", "Tribal",
+    "Acid Punk", "Acid Jazz", "Polka", "Retro", "Musical", "Rock & Roll",
+    "Hard Rock", "Folk", "Folk-Rock", "National Folk", "Swing", "Fast Fusion",
+    "Bebob", "Latin", "Revival", "Celtic", "Bluegrass", "Avantgarde",
+    "Gothic Rock", "Progressive Rock", "Psychedelic Rock", "Symphonic Rock",
+    "Slow Rock", "Big Band", "Chorus", "Easy Listening", "Acoustic", "Humour",
+    "Speech", "Chanson", "Opera", "Chamber Music", "Sonata", "Symphony",
+    "Booty Bass", "Primus", "Porn Groove", "Satire", "Slow Jam", "Club",
+    "Tango", "Samba", "Folklore", "Ballad", "Power Ballad", "Rhythmic Soul",
+    "Freestyle", "Duet", "Punk Rock", "Drum Solo", "A capella", "Euro-House",
+    "Dance Hall", "Goa", "Drum & Bass", "Club-House", "Hardcore", "Terror",
+    "Indie", "BritPop", "Afro-Punk", "Polsk Punk", "Beat",
+    "Christian Gangsta Rap", "Heavy Metal", "Black Metal", "Crossover",
+    "Contemporary Christian", "Christian Rock", "Merengue", "Salsa",
+    "Thrash Metal", "Anime", "JPop", "Synthpop"
+};
+
+static const unsigned int s_genreCount = sizeof(s_genres) / sizeof(s_genres[0]);
+
+//================================================================================
+
+// Byte order helpers. Everything in ID3v2 and FLAC is big endian, everything in
+// Ogg and RIFF is little endian.
+
+static unsigned long readBE32(const unsigned char* p) {
+    return ((unsigned long) p[0] << 24) | ((unsigned long) p[1] << 16) | ((unsigned long) p[2] << 8) | p[3];
+}
+
+static unsigned long readBE24(const unsigned char* p) {
+    return ((unsigned long) p[0] << 16) | ((unsigned long) p[1] << 8) | p[2];
+}
+
+static unsigned long readLE32(const unsigned char* p) {
+    return ((unsigned long) p[3] << 24) | ((unsigned long) p[2] << 16) | ((unsigned long) p[1] << 8) | p[0];
+}
+
+static unsigned int readLE16(const unsigned char* p) {
+    return ((unsigned int) p[1] << 8) | p[0];
+}
+
+static long long readLE64(const unsigned char* p) {
+    unsigned long long hi = readLE32(p + 4);
+    return static_cast<long long>((hi << 32) | readLE32(p));
+}
+
+/// Synchsafe integers (ID3v2) only use 7 bits of every byte.
+static unsigned long readSynchsafe(const unsigned char* p) {
+    return ((unsigned long) (p[0] & 0x7F) << 21) | ((unsigned long) (p[1] & 0x7F) << 14)
+        | ((unsigned long) (p[2] & 0x7F) << 7) | (p[3] & 0x7F);
+}
+
+//================================================================================
+
+// Text decoding helpers. All of them stop at the first terminator.
+
+static wxString decodeLatin1(const unsigned char* data, size_t len) {
+    wxString s;
+    s.Alloc(len);
+    for (size_t i = 0; i < len && data[i] != 0; i++) {
+        s += static_cast<wxChar>(data[i]);
+    }
+    return s;
+}
+
+static wxString decodeUtf8(const unsigned char* data, size_t len) {
+    size_t n = 0;
+    while (n < len && data[n] != 0) {
+        n++;
+    }
+    wxString s(reinterpret_cast<const char*>(data), wxConvUTF8, n);
+    // Lots of taggers write Latin-1 where they should be writing UTF-8. When
+    // the conversion fails, we get an empty string, so retry it as Latin-1.
+    if (s.IsEmpty() && n > 0) {
+        return decodeLatin1(data, n);
+    }
+    return s;
+}
+
+static wxString decodeUtf16(const unsigned char* data, size_t len, bool bigEndian) {
+    // a byte order mark overrides whatever we were told.
+    if (len >= 2 && data[0] == 0xFF && data[1] == 0xFE) {
+        bigEndian = false;
+        data += 2;
+        len -= 2;
+    } else if (len >= 2 && data[0] == 0xFE && data[1] == 0xFF) {
+        bigEndian = true;
+        data += 2;
+        len -= 2;
+    }
+
+    size_t n = 0;
+    while (n + 1 < len && (data[n] != 0 || data[n + 1] != 0)) {
+        n += 2;
+    }
+
+    if (bigEndian) {
+        wxMBConvUTF16BE conv;
+        return wxString(reinterpret_cast<const char*>(data), conv, n);
+    }
+
+    wxMBConvUTF16LE conv;
+    return wxString(reinterpret_cast<const char*>(data), conv, n);
+}
+
+/// Decodes text using an ID3v2 text encoding byte.
+static wxString decodeId3Text(unsigned char encoding, const unsigned char* data, size_t len) {
+    switch (encoding) {
+        case 0:  return decodeLatin1(data, len);
+        case 1:  return decodeUtf16(data, len, false);
+        case 2:  return decodeUtf16(data, len, true);
+        case 3:  return decodeUtf8(data, len);
+        default: return decodeLatin1(data, len);
+    }
+}
+
+/**
+ * Returns the offset just after the first terminator in an ID3v2 string with
+ * the given encoding. UTF-16 strings are terminated by two zero bytes.
+ */
+static size_t skipId3Text(unsigned char encoding, const unsigned char* data, size_t len) {
+    if (encoding == 1 || encoding == 2) {
+        for (size_t i = 0; i + 1 < len; i += 2) {
+            if (data[i] == 0 && data[i + 1] == 0) {
+                return i + 2;
+            }
+        }
+    } else {
+        for (size_t i = 0; i < len; i++) {
+            if (data[i] == 0) {
+                return i + 1;
+            }
+        }
+    }
+    return len;
+}
+
+/**
+ * Translates an ID3v2 genre to a name. ID3v2.3 uses references to the ID3v1
+ * genres like `(17)' or `(17)Rock', some taggers just write `17'.
+ */
+static wxString translateGenre(const wxString& genre) {
+    unsigned long index;
+    if (genre.StartsWith(wxT("("))) {
+        wxString refined = genre.AfterFirst(wxT(')'));
+        if (!refined.IsEmpty()) {
+            return refined;
+        }
+        if (genre.Mid(1).BeforeFirst(wxT(')')).ToULong(&index) && index < s_genreCount) {
+            return wxString::FromAscii(s_genres[index]);
+        }
+    } else if (genre.ToULong(&index) && index < s_genreCount) {
+        return wxString::FromAscii(s_genres[index]);
+    }
+
+    return genre;
+}
+
+/// Removes the ID3v2 unsynchronisation scheme (every 0xFF 0x00 becomes 0xFF).
+static void removeUnsynchronisation(std::vector<unsigned char>& data) {
+    size_t out = 0;
+    for (size_t in = 0; in < data.size(); in++) {
+        data[out++] = data[in];
+        if (data[in] == 0xFF && in + 1 < data.size() && data[in + 1] == 0x00) {
+            in++;
+        }
+    }
+    data.resize(out);
+}
+
+//================================================================================
+
+/**
+ * A decoded MPEG audio frame header. Only the parts we need for validating
+ * the stream and estimating the duration.
+ */
+struct MpegHeader {
+    /// true for MPEG-1, false for MPEG-2 and MPEG-2.5.
+    bool mpeg1;
+    /// Layer 1, 2 or 3.
+    int layer;
+    /// Bitrate in kbit/s.
+    int bitrate;
+    /// Sampling rate in Hz.
+    int sampleRate;
+    /// Length of the frame in bytes, including the header.
+    int frameLength;
+    /// Amount of samples (per channel) in one frame.
+    int samplesPerFrame;
+    /// Length of the side information following the header (layer 3 only).
+    int sideInfoLength;
+};
+
+static const int s_mpegBitrates[2][3][15] = {
+    { // MPEG-1, layer 1, 2, 3
+        { 0, 32, 64, 96, 128, 160, 192, 224, 256, 288, 320, 352, 384, 416, 448 },
+        { 0, 32, 48, 56,  64,  80,  96, 112, 128, 160, 192, 224, 256, 320, 384 },
+        { 0, 32, 40, 48,  56,  64,  80,  96, 112, 128, 160, 192, 224, 256, 320 }
+    },
+    { // MPEG-2 and MPEG-2.5, layer 1, 2, 3
+        { 0, 32, 48, 56, 64, 80, 96, 112, 128, 144, 160, 176, 192, 224, 256 },
+        { 0,  8, 16, 24, 32, 40, 48,  56,  64,  80,  96, 112, 128, 144, 160 },
+        { 0,  8, 16, 24, 32, 40, 48,  56,  64,  80,  96, 112, 128, 144, 160 }
+    }
+};
+
+static const int s_mpegSampleRates[3][3] = {
+    { 44100, 48000, 32000 }, // MPEG-1
+    { 22050, 24000, 16000 }, // MPEG-2
+    { 11025, 12000,  8000 }  // MPEG-2.5
+};
+
+/**
+ * Parses four bytes as an MPEG audio frame header.
+ *
+ * @return false when the bytes don't form a valid (and supported) header.
+ *  Free format bitrates are not supported.
+ */
+static bool parseMpegHeader(const unsigned char* h, MpegHeader& header) {
+    if (h[0] != 0xFF || (h[1] & 0xE0) != 0xE0) {
+        return false;
+    }
+
+    int versionBits = (h[1] >> 3) & 0x03; // 0 = 2.5, 1 = reserved, 2 = 2, 3 = 1
+    int layerBits   = (h[1] >> 1) & 0x03; // 0 = reserved, 1 = III, 2 = II, 3 = I
+    int bitrateIdx  = (h[2] >> 4) & 0x0F;
+    int rateIdx     = (h[2] >> 2) & 0x03;
+    int padding     = (h[2] >> 1) & 0x01;
+    bool mono       = ((h[3] >> 6) & 0x03) == 3;
+
+    if (versionBits == 1 || layerBits == 0 || bitrateIdx == 0 || bitrateIdx == 15 || rateIdx == 3) {
+        return false;
+    }
+
+    header.mpeg1 = versionBits == 3;
+    header.layer = 4 - layerBits;
+    header.bitrate = s_mpegBitrates[header.mpeg1 ? 0 : 1][header.layer - 1][bitrateIdx];
+
+    int rateRow = header.mpeg1 ? 0 : (versionBits == 2 ? 1 : 2);
+    header.sampleRate = s_mpegSampleRates[rateRow][rateIdx];
+
+    if (header.layer == 1) {
+        header.frameLength = (12000 * header.bitrate / header.sampleRate + padding) * 4;
+        header.samplesPerFrame = 384;
+    } else if (header.layer == 3 && !header.mpeg1) {
+        header.frameLength = 72000 * header.bitrate / header.sampleRate + padding;
+        header.samplesPerFrame = 576;
+    } else {
+        header.frameLength = 144000 * header.bitrate / header.sampleRate + padding;
+        header.samplesPerFrame = 1152;
+    }
+
+    if (header.layer == 3) {
+        header.sideInfoLength = header.mpeg1 ? (mono ? 17 : 32) : (mono ? 9 : 17);
+    } else {
+        header.sideInfoLength = 0;
+    }
+
+    return header.frameLength > 4;
+}
+
+//================================================================================
+
+NativeTagReader::NativeTagReader(const wxString& path) :
+        m_path(path),
+        m_file(NULL),
+        m_fileSize(0),
+        m_trackInfo(NULL),
+        m_encoderGap(0) {
+}
+
+NativeTagReader::~NativeTagReader() {
+    if (m_file != NULL) {
+        fclose(m_file);
+    }
+}
+
+bool NativeTagReader::read(TrackInfo& info) {
+    m_file = fopen(m_path.fn_str(), "rb");
+    if (m_file == NULL) {
+        return false;
+    }
+
+    if (fseeko(m_file, 0, SEEK_END) != 0) {
+        fclose(m_file);
+        m_file = NULL;
+        return false;
+    }
+    m_fileSize = ftello(m_file);
+
+    // same form of location as the TagReader gets it.
+    wxString uri = wxT("file://");
+    uri << m_path;
+    info.setLocation(uri);
+    m_trackInfo = &info;
+
+    bool understood = false;
+    unsigned char magic[12];
+    if (readAt(0, magic, sizeof(magic))) {
+        MpegHeader mpeg;
+        if (memcmp(magic, "ID3", 3) == 0) {
+            long long tagSize = 0;
+            if (readId3v2(0, tagSize)) {
+                // FLAC files are sometimes (against the specs) prefixed with
+                // an ID3v2 tag. Everything else is treated as MPEG audio.
+                unsigned char next[4];
+                if (readAt(tagSize, next, 4) && memcmp(next, "fLaC", 4) == 0) {
+                    understood = readFlac(tagSize);
+                } else {
+                    bool hasId3v1 = readId3v1();
+                    understood = readMpeg(tagSize, m_fileSize - (hasId3v1 ? 128 : 0));
+                }
+            }
+        } else if (memcmp(magic, "fLaC", 4) == 0) {
+            understood = readFlac(0);
+        } else if (memcmp(magic, "OggS", 4) == 0) {
+            understood = readOgg();
+        } else if (memcmp(magic, "RIFF", 4) == 0 && memcmp(magic + 8, "WAVE", 4) == 0) {
+            understood = readRiff();
+        } else if (parseMpegHeader(magic, mpeg)) {
+            bool hasId3v1 = readId3v1();
+            understood = readMpeg(0, m_fileSize - (hasId3v1 ? 128 : 0));
+        }
+    }
+
+    fclose(m_file);
+    m_file = NULL;
+    m_trackInfo = NULL;
+
+    return understood;
+}
+
+bool NativeTagReader::readAt(long long offset, void* buffer, size_t len) {
+    if (offset < 0 || offset + static_cast<long long>(len) > m_fileSize) {
+        return false;
+    }
+    if (fseeko(m_file, offset, SEEK_SET) != 0) {
+        return false;
+    }
+    return fread(buffer, 1, len, m_file) == len;
+}
+
+void NativeTagReader::setTag(const char* type, const wxString& rawValue, bool overwrite) {
+    wxString value(rawValue);
+    value.Trim(true).Trim(false);
+    if (value.IsEmpty()) {
+        return;
+    }
+
+    if (type == TrackInfo::TRACK_NUMBER || type == TrackInfo::DISC_NUMBER) {
+        // `3/12' or `03' should just become `3'.
+        long num;
+        if (!value.BeforeFirst(wxT('/')).ToLong(&num) || num <= 0) {
+            return;
+        }
+        value = wxString::Format(wxT("%li"), num);
+    } else if (type == TrackInfo::DATE) {
+        // only the year, like the TagReader does.
+        long year;
+        if (!value.Left(4).ToLong(&year)) {
+            return;
+        }
+        value = wxString::Format(wxT("%li"), year);
+    }
+
+    wxString& current = (*m_trackInfo)[type];
+    if (overwrite || current.IsEmpty()) {
+        current = value;
+    }
+}
+
+bool NativeTagReader::readId3v1() {
+    if (m_fileSize < 128) {
+        return false;
+    }
+
+    unsigned char tag[128];
+    if (!readAt(m_fileSize - 128, tag, sizeof(tag)) || memcmp(tag, "TAG", 3) != 0) {
+        return false;
+    }
+
+    // ID3v1 is just a bunch of fixed width Latin-1 fields. Never overwrite
+    // anything, since an ID3v2 tag may already have been read.
+    setTag(TrackInfo::TITLE,  decodeLatin1(tag + 3, 30), false);
+    setTag(TrackInfo::ARTIST, decodeLatin1(tag + 33, 30), false);
+    setTag(TrackInfo::ALBUM,  decodeLatin1(tag + 63, 30), false);
+    setTag(TrackInfo::DATE,   decodeLatin1(tag + 93, 4), false);
+
+    // ID3v1.1: a zero byte followed by the track number at the end of the comment.
+    if (tag[125] == 0 && tag[126] != 0) {
+        setTag(TrackInfo::COMMENT, decodeLatin1(tag + 97, 28), false);
+        setTag(TrackInfo::TRACK_NUMBER, wxString::Format(wxT("%i"), tag[126]), false);
+    } else {
+        setTag(TrackInfo::COMMENT, decodeLatin1(tag + 97, 30), false);
+    }
+
+    if (tag[127] < s_genreCount) {
+        setTag(TrackInfo::GENRE, wxString::FromAscii(s_genres[tag[127]]), false);
+    }
+
+    return true;
+}
+
+bool NativeTagReader::readId3v2(long long offset, long long& tagSize) {
+    unsigned char header[10];
+    if (!readAt(offset, header, sizeof(header)) || memcmp(header, "ID3", 3) != 0) {
+        return false;
+    }
+
+    unsigned char version = header[3];
+    unsigned char flags = header[5];
+    if (version < 2 || version > 4 || header[4] == 0xFF) {
+        return false;
+    }
+    if ((header[6] | header[7] | header[8] | header[9]) & 0x80) {
+        return false;
+    }
+
+    long long size = readSynchsafe(header + 6);
+    tagSize = 10 + size + ((flags & 0x10) ? 10 : 0);
+    if (offset + 10 + size > m_fileSize) {
+        return false;
+    }
+
+    // In ID3v2.2 and ID3v2.3, unsynchronisation applies to the tag as a whole,
+    // so the frame sizes can't be trusted without decoding everything first.
+    // It's rare enough to let the TagReader handle it. The same goes for
+    // ID3v2.2 compression, which never has been defined.
+    if (version < 4 && (flags & 0x80)) {
+        return false;
+    }
+    if (version == 2 && (flags & 0x40)) {
+        return false;
+    }
+
+    long long pos = offset + 10;
+    long long end = offset + 10 + size;
+
+    // skip the extended header. Its size excludes itself in v2.3, but not in v2.4.
+    if (version > 2 && (flags & 0x40)) {
+        unsigned char ext[4];
+        if (!readAt(pos, ext, sizeof(ext))) {
+            return false;
+        }
+        pos += (version == 3) ? 4 + readBE32(ext) : readSynchsafe(ext);
+    }
+
+    size_t headerLen = (version == 2) ? 6 : 10;
+    while (pos + static_cast<long long>(headerLen) <= end) {
+        unsigned char fh[10];
+        if (!readAt(pos, fh, headerLen) || fh[0] == 0) {
+            // we've hit the padding (or garbage), so we're done.
+            break;
+        }
+
+        char id[5];
+        long long frameSize;
+        unsigned int frameFlags = 0;
+        if (version == 2) {
+            memcpy(id, fh, 3);
+            id[3] = '\0';
+            frameSize = readBE24(fh + 3);
+        } else {
+            memcpy(id, fh, 4);
+            id[4] = '\0';
+            frameSize = (version == 4) ? readSynchsafe(fh + 4) : readBE32(fh + 4);
+            frameFlags = (fh[8] << 8) | fh[9];
+        }
+
+        pos += headerLen;
+        if (frameSize <= 0 || pos + frameSize > end) {
+            break;
+        }
+
+        // Only text frames and comments are interesting. This skips pictures
+        // without reading them.
+        bool wanted = (id[0] == 'T' || strcmp(id, "COMM") == 0 || strcmp(id, "COM") == 0);
+        long long dataPos = pos;
+        long long dataLen = frameSize;
+        if (version == 3) {
+            // compressed or encrypted frames are skipped. Grouping adds a byte.
+            if (frameFlags & 0x00C0) {
+                wanted = false;
+            }
+            if (frameFlags & 0x0020) {
+                dataPos++;
+                dataLen--;
+            }
+        } else if (version == 4) {
+            if (frameFlags & 0x000C) {
+                wanted = false;
+            }
+            if (frameFlags & 0x0040) {
+                dataPos++;
+                dataLen--;
+            }
+            if (frameFlags & 0x0001) {
+                // data length indicator
+                dataPos += 4;
+                dataLen -= 4;
+            }
+        }
+
+        if (wanted && dataLen > 0 && dataLen <= MAX_TAG_PAYLOAD) {
+            std::vector<unsigned char> data(dataLen);
+            if (!readAt(dataPos, &data[0], dataLen)) {
+                return false;
+            }
+            if (version == 4 && ((frameFlags & 0x0002) || (flags & 0x80))) {
+                removeUnsynchronisation(data);
+            }
+            handleId3v2Frame(id, data);
+        }
+
+        pos += frameSize;
+    }
+
+    return true;
+}
+
+void NativeTagReader::handleId3v2Frame(const char* id, const std::vector<unsigned char>& data) {
+    if (data.empty()) {
+        return;
+    }
+
+    unsigned char encoding = data[0];
+
+    if (strcmp(id, "COMM") == 0 || strcmp(id, "COM") == 0) {
+        // encoding, 3 bytes language, description, and finally the text.
+        if (data.size() < 4) {
+            return;
+        }
+        size_t descLen = skipId3Text(encoding, &data[4], data.size() - 4);
+        // iTunes stores things like `iTunNORM' as described comments. Those are
+        // not meant for humans.
+        wxString desc = decodeId3Text(encoding, &data[4], descLen);
+        if (desc.StartsWith(wxT("iTun")) || 4 + descLen >= data.size()) {
+            return;
+        }
+        setTag(TrackInfo::COMMENT, decodeId3Text(encoding, &data[4 + descLen], data.size() - 4 - descLen), false);
+        return;
+    }
+
+    const char* type = NULL;
+    if (strcmp(id, "TIT2") == 0 || strcmp(id, "TT2") == 0) {
+        type = TrackInfo::TITLE;
+    } else if (strcmp(id, "TPE1") == 0 || strcmp(id, "TP1") == 0) {
+        type = TrackInfo::ARTIST;
+    } else if (strcmp(id, "TALB") == 0 || strcmp(id, "TAL") == 0) {
+        type = TrackInfo::ALBUM;
+    } else if (strcmp(id, "TCON") == 0 || strcmp(id, "TCO") == 0) {
+        type = TrackInfo::GENRE;
+    } else if (strcmp(id, "TCOM") == 0 || strcmp(id, "TCM") == 0) {
+        type = TrackInfo::COMPOSER;
+    } else if (strcmp(id, "TRCK") == 0 || strcmp(id, "TRK") == 0) {
+        type = TrackInfo::TRACK_NUMBER;
+    } else if (strcmp(id, "TPOS") == 0 || strcmp(id, "TPA") == 0) {
+        type = TrackInfo::DISC_NUMBER;
+    } else if (strcmp(id, "TYER") == 0 || strcmp(id, "TDRC") == 0 || strcmp(id, "TYE") == 0) {
+        type = TrackInfo::DATE;
+    }
+
+    if (type == NULL) {
+        return;
+    }
+
+    wxString value = decodeId3Text(encoding, &data[1], data.size() - 1);
+    if (type == TrackInfo::GENRE) {
+        value = translateGenre(value);
+    }
+    setTag(type, value);
+}
+
+bool NativeTagReader::readMpeg(long long offset, long long audioEnd) {
+    long long searchLen = MPEG_SYNC_SEARCH;
+    if (offset + searchLen > audioEnd) {
+        searchLen = audioEnd - offset;
+    }
+    if (searchLen < 4) {
+        return false;
+    }
+
+    std::vector<unsigned char> buf(searchLen);
+    if (!readAt(offset, &buf[0], searchLen)) {
+        return false;
+    }
+
+    // Find the first frame header. To avoid being fooled by a random 0xFFE
+    // sync pattern, the next frame must be found right after it as well.
+    for (long long i = 0; i + 4 <= searchLen; i++) {
+        MpegHeader header;
+        if (!parseMpegHeader(&buf[i], header)) {
+            continue;
+        }
+
+        long long nextPos = offset + i + header.frameLength;
+        unsigned char next[4];
+        MpegHeader nextHeader;
+        if (nextPos + 4 <= audioEnd) {
+            if (!readAt(nextPos, next, sizeof(next)) || !parseMpegHeader(next, nextHeader)) {
+                continue;
+            }
+        }
+
+        // A Xing (VBR) or Info (CBR) header from LAME and friends, or a VBRI
+        // header from Fraunhofer's encoder, holds the frame count. That gives
+        // the exact duration.
+        long long frames = readMpegFrameCount(offset + i, header);
+        if (frames > 0) {
+            long long samples = frames * header.samplesPerFrame - m_encoderGap;
+            if (samples < 0) {
+                samples = 0;
+            }
+            m_trackInfo->setDurationSeconds(samples / header.sampleRate, true);
+            return true;
+        }
+
+        // Without a Xing or VBRI header, assume the first frame's bitrate is
+        // the bitrate of the whole file (which is true for CBR files, and a
+        // guess for VBR files).
+        long long audioBytes = audioEnd - (offset + i);
+        m_trackInfo->setDurationSeconds(audioBytes * 8 / (header.bitrate * 1000), false);
+        return true;
+    }
+
+    return false;
+}
+
+long long NativeTagReader::readMpegFrameCount(long long framePos, const MpegHeader& header) {
+    m_encoderGap = 0;
+
+    // The Xing header lives right after the side information of the first
+    // frame, the VBRI header always 32 bytes after the frame header.
+    unsigned char frame[4 + 32 + 156];
+    size_t len = sizeof(frame);
+    if (framePos + (long long) len > m_fileSize) {
+        return -1;
+    }
+    if (!readAt(framePos, frame, len)) {
+        return -1;
+    }
+
+    size_t xing = 4 + header.sideInfoLength;
+    if (header.layer == 3 && xing + 8 <= len
+            && (memcmp(&frame[xing], "Xing", 4) == 0 || memcmp(&frame[xing], "Info", 4) == 0)) {
+        unsigned long flags = readBE32(&frame[xing + 4]);
+        if (!(flags & 0x01)) {
+            return -1; // no frame count, so no use.
+        }
+        long long frames = readBE32(&frame[xing + 8]);
+
+        // The LAME extension follows the optional fields, and holds the
+        // encoder delay and padding (12 bits each), in samples.
+        size_t lame = xing + 8 + 4
+            + ((flags & 0x02) ? 4 : 0)
+            + ((flags & 0x04) ? 100 : 0)
+            + ((flags & 0x08) ? 4 : 0);
+        if (lame + 24 <= len && memcmp(&frame[lame], "LAME", 4) == 0) {
+            unsigned long gap = readBE24(&frame[lame + 21]);
+            m_encoderGap = (gap >> 12) + (gap & 0xFFF);
+        }
+        return frames;
+    }
+
+    size_t vbri = 4 + 32;
+    if (vbri + 18 <= len && memcmp(&frame[vbri], "VBRI", 4) == 0) {
+        return readBE32(&frame[vbri + 14]);
+    }
+
+    return -1;
+}
+
+bool NativeTagReader::readFlac(long long offset) {
+    long long pos = offset + 4; // skip the `fLaC' marker
+    bool gotStreamInfo = false;
+    bool last = false;
+
+    while (!last) {
+        unsigned char bh[4];
+        if (!readAt(pos, bh, sizeof(bh))) {
+            return false;
+        }
+
+        last = (bh[0] & 0x80) != 0;
+        int type = bh[0] & 0x7F;
+        long long len = readBE24(bh + 1);
+        pos += 4;
+
+        if (pos + len > m_fileSize || type == 127) {
+            return false;
+        }
+
+        if (type == 0) {
+            // STREAMINFO. The sample rate is 20 bits, the total amount of
+            // samples 36 bits (sigh).
+            unsigned char si[34];
+            if (len < 34 || !readAt(pos, si, sizeof(si))) {
+                return false;
+            }
+            unsigned long sampleRate = (si[10] << 12) | (si[11] << 4) | (si[12] >> 4);
+            unsigned long long totalSamples = ((unsigned long long) (si[13] & 0x0F) << 32) | readBE32(si + 14);
+            if (sampleRate > 0 && totalSamples > 0) {
+                m_trackInfo->setDurationSeconds(totalSamples / sampleRate, true);
+            }
+            gotStreamInfo = true;
+        } else if (type == 4 && len > 0 && len <= MAX_TAG_PAYLOAD) {
+            // VORBIS_COMMENT
+            std::vector<unsigned char> comments(len);
+            if (!readAt(pos, &comments[0], len)) {
+                return false;
+            }
+            parseVorbisComments(&comments[0], len);
+        }
+
+        pos += len;
+    }
+
+    return gotStreamInfo;
+}
+
+void NativeTagReader::parseVorbisComments(const unsigned char* data, size_t len) {
+    if (len < 8) {
+        return;
+    }
+
+    size_t pos = 0;
+    unsigned long vendorLen = readLE32(data);
+    pos += 4;
+    if (vendorLen > len - pos || len - pos - vendorLen < 4) {
+        return;
+    }
+    pos += vendorLen;
+
+    unsigned long count = readLE32(data + pos);
+    pos += 4;
+
+    for (unsigned long i = 0; i < count && len - pos >= 4; i++) {
+        unsigned long commentLen = readLE32(data + pos);
+        pos += 4;
+        if (commentLen > len - pos) {
+            return;
+        }
+
+        const char* comment = reinterpret_cast<const char*>(data + pos);
+        const char* eq = static_cast<const char*>(memchr(comment, '=', commentLen));
+        if (eq != NULL) {
+            // field names are case insensitive ASCII.
+            std::string key(comment, eq - comment);
+            for (size_t k = 0; k < key.size(); k++) {
+                if (key[k] >= 'a' && key[k] <= 'z') {
+                    key[k] = key[k] - 'a' + 'A';
+                }
+            }
+
+            const char* type = NULL;
+            if (key == "TITLE") {
+                type = TrackInfo::TITLE;
+            } else if (key == "ARTIST") {
+                type = TrackInfo::ARTIST;
+            } else if (key == "ALBUM") {
+                type = TrackInfo::ALBUM;
+            } else if (key == "GENRE") {
+                type = TrackInfo::GENRE;
+            } else if (key == "COMMENT" || key == "DESCRIPTION") {
+                type = TrackInfo::COMMENT;
+            } else if (key == "COMPOSER") {
+                type = TrackInfo::COMPOSER;
+            } else if (key == "TRACKNUMBER") {
+                type = TrackInfo::TRACK_NUMBER;
+            } else if (key == "DISCNUMBER") {
+                type = TrackInfo::DISC_NUMBER;
+            } else if (key == "DATE" || key == "YEAR") {
+                type = TrackInfo::DATE;
+            }
+
+            if (type != NULL) {
+                size_t valueLen = commentLen - (eq - comment) - 1;
+                // multiple values of the same field are allowed, the first wins.
+                setTag(type, wxString(eq + 1, wxConvUTF8, valueLen), false);
+            }
+        }
+
+        pos += commentLen;
+    }
+}
+
+bool NativeTagReader::readOgg() {
+    // Reassemble the first two packets of the first logical stream: the
+    // identification header and the comment header.
+    std::vector<unsigned char> packets[2];
+    int packetNo = 0;
+    unsigned long serial = 0;
+    bool haveSerial = false;
+    long long pos = 0;
+
+    while (packetNo < 2) {
+        unsigned char ph[27];
+        if (!readAt(pos, ph, sizeof(ph)) || memcmp(ph, "OggS", 4) != 0) {
+            return false;
+        }
+
+        unsigned long pageSerial = readLE32(ph + 14);
+        int segmentCount = ph[26];
+        unsigned char segments[255];
+        if (!readAt(pos + 27, segments, segmentCount)) {
+            return false;
+        }
+
+        long long bodyPos = pos + 27 + segmentCount;
+        long long bodyLen = 0;
+        for (int s = 0; s < segmentCount; s++) {
+            bodyLen += segments[s];
+        }
+
+        if (!haveSerial) {
+            serial = pageSerial;
+            haveSerial = true;
+        }
+
+        if (pageSerial == serial && bodyLen > 0) {
+            std::vector<unsigned char> body(bodyLen);
+            if (!readAt(bodyPos, &body[0], bodyLen)) {
+                return false;
+            }
+
+            size_t off = 0;
+            for (int s = 0; s < segmentCount && packetNo < 2; s++) {
+                packets[packetNo].insert(packets[packetNo].end(), body.begin() + off, body.begin() + off + segments[s]);
+                off += segments[s];
+                if (static_cast<long long>(packets[packetNo].size()) > MAX_TAG_PAYLOAD) {
+                    return false;
+                }
+                // a segment shorter than 255 bytes terminates a packet.
+                if (segments[s] < 255) {
+                    packetNo++;
+                }
+            }
+        }
+
+        pos = bodyPos + bodyLen;
+    }
+
+    const std::vector<unsigned char>& ident = packets[0];
+    const std::vector<unsigned char>& comments = packets[1];
+    unsigned long sampleRate = 0;
+    long long preSkip = 0;
+    size_t commentOffset = 0;
+
+    if (ident.size() >= 16 && memcmp(&ident[0], "\x01vorbis", 7) == 0) {
+        sampleRate = readLE32(&ident[12]);
+        if (comments.size() < 7 || memcmp(&comments[0], "\x03vorbis", 7) != 0) {
+            return false;
+        }
+        commentOffset = 7;
+    } else if (ident.size() >= 19 && memcmp(&ident[0], "OpusHead", 8) == 0) {
+        // Opus granule positions are always at 48 kHz.
+        sampleRate = 48000;
+        preSkip = readLE16(&ident[10]);
+        if (comments.size() < 8 || memcmp(&comments[0], "OpusTags", 8) != 0) {
+            return false;
+        }
+        commentOffset = 8;
+    } else {
+        // Ogg FLAC, Speex, Theora... let gstreamer handle those.
+        return false;
+    }
+
+    parseVorbisComments(&comments[commentOffset], comments.size() - commentOffset);
+
+    long long granule = readLastOggGranule(serial);
+    if (sampleRate > 0 && granule > preSkip) {
+        m_trackInfo->setDurationSeconds((granule - preSkip) / sampleRate, true);
+    }
+
+    return true;
+}
+
+long long NativeTagReader::readLastOggGranule(unsigned int serial) {
+    long long tailLen = OGG_TAIL_SEARCH;
+    if (tailLen > m_fileSize) {
+        tailLen = m_fileSize;
+    }
+    if (tailLen < 27) {
+        return -1;
+    }
+
+    std::vector<unsigned char> tail(tailLen);
+    if (!readAt(m_fileSize - tailLen, &tail[0], tailLen)) {
+        return -1;
+    }
+
+    for (long long i = tailLen - 27; i >= 0; i--) {
+        const unsigned char* p = &tail[i];
+        if (memcmp(p, "OggS", 4) != 0 || p[4] != 0) {
+            continue;
+        }
+        long long granule = readLE64(p + 6);
+        if (readLE32(p + 14) == serial && granule != -1) {
+            return granule;
+        }
+    }
+
+    return -1;
+}
+
+bool NativeTagReader::readRiff() {
+    long long pos = 12; // skip `RIFF', the size and `WAVE'
+    unsigned long byteRate = 0;
+    long long dataSize = -1;
+    bool gotFormat = false;
+
+    while (pos + 8 <= m_fileSize) {
+        unsigned char ch[8];
+        if (!readAt(pos, ch, sizeof(ch))) {
+            break;
+        }
+        long long len = readLE32(ch + 4);
+        pos += 8;
+
+        if (memcmp(ch, "fmt ", 4) == 0) {
+            unsigned char fmt[16];
+            if (len < 16 || !readAt(pos, fmt, sizeof(fmt))) {
+                return false;
+            }
+            byteRate = readLE32(fmt + 8);
+            gotFormat = true;
+        } else if (memcmp(ch, "data", 4) == 0) {
+            // streaming writers leave the size at 0 or 0xFFFFFFFF.
+            dataSize = (len == 0 || pos + len > m_fileSize) ? m_fileSize - pos : len;
+        } else if (memcmp(ch, "LIST", 4) == 0 && len >= 4 && len <= MAX_TAG_PAYLOAD) {
+            std::vector<unsigned char> list(len);
+            if (readAt(pos, &list[0], len) && memcmp(&list[0], "INFO", 4) == 0) {
+                size_t off = 4;
+                while (off + 8 <= list.size()) {
+                    const unsigned char* sub = &list[off];
+                    size_t subLen = readLE32(sub + 4);
+                    if (subLen > list.size() - off - 8) {
+                        break;
+                    }
+
+                    const char* type = NULL;
+                    if (memcmp(sub, "INAM", 4) == 0) {
+                        type = TrackInfo::TITLE;
+                    } else if (memcmp(sub, "IART", 4) == 0) {
+                        type = TrackInfo::ARTIST;
+                    } else if (memcmp(sub, "IPRD", 4) == 0) {
+                        type = TrackInfo::ALBUM;
+                    } else if (memcmp(sub, "IGNR", 4) == 0) {
+                        type = TrackInfo::GENRE;
+                    } else if (memcmp(sub, "ICMT", 4) == 0) {
+                        type = TrackInfo::COMMENT;
+                    } else if (memcmp(sub, "ICRD", 4) == 0) {
+                        type = TrackInfo::DATE;
+                    } else if (memcmp(sub, "ITRK", 4) == 0 || memcmp(sub, "IPRT", 4) == 0) {
+                        type = TrackInfo::TRACK_NUMBER;
+                    }
+
+                    if (type != NULL) {
+                        setTag(type, decodeUtf8(sub + 8, subLen), false);
+                    }
+
+                    // chunks are word aligned.
+                    off += 8 + subLen + (subLen & 1);
+                }
+            }
+        } else if (memcmp(ch, "id3 ", 4) == 0 || memcmp(ch, "ID3 ", 4) == 0) {
+            long long tagSize;
+            readId3v2(pos, tagSize);
+        }
+
+        pos += len + (len & 1);
+    }
+
+    if (!gotFormat) {
+        return false;
+    }
+
+    if (byteRate > 0 && dataSize >= 0) {
+        // exact for PCM, which is what WAV files contain.
+        m_trackInfo->setDurationSeconds(dataSize / byteRate, true);
+    }
+
+    return true;
+}
+
+} // namespace navi
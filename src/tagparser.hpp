@@ -0,0 +1,173 @@
+//      tagparser.hpp
+//
+//      Copyright 2012 Kevin Pors <krpors@users.sf.net>
+//
+//      This program is free software; you can redistribute it and/or modify
+//      it under the terms of the GNU General Public License as published by
+//      the Free Software Foundation; either version 2 of the License, or
+//      (at your option) any later version.
+//
+//      This program is distributed in the hope that it will be useful,
+//      but WITHOUT ANY WARRANTY; without even the implied warranty of
+//      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//      GNU General Public License for more details.
+//
+//      You should have received a copy of the GNU General Public License
+//      along with this program; if not, write to the Free Software
+//      Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+//      MA 02110-1301, USA.
+
+#ifndef TAGPARSER_HPP
+#define TAGPARSER_HPP
+
+#include "audio.hpp"
+
+#include <vector>
+#include <cstdio>
+
+#include <wx/wx.h>
+#include <wx/strconv.h>
+
+namespace navi {
+
+struct MpegHeader;
+
+//================================================================================
+
+/**
+ * The NativeTagReader reads tags and the duration of a local file directly from
+ * its headers, without building a GStreamer pipeline. Constructing a TagReader
+ * means creating a uridecodebin, prerolling it and pumping the bus until it's
+ * done, which is way too slow when a directory with 400 files is activated.
+ * This class understands the following formats:
+ *
+ * - ID3v2.2, ID3v2.3, ID3v2.4 and ID3v1 tags (MP3 files);
+ * - Vorbis comments in Ogg Vorbis, Ogg Opus and FLAC files;
+ * - FLAC STREAMINFO blocks;
+ * - Xing, Info (LAME) and VBRI headers in MP3 files;
+ * - RIFF INFO lists in WAV files (and `id3 ' chunks, when available).
+ *
+ * Anything else (or anything which looks corrupt) is refused by read(), in which
+ * case the caller should fall back to the TagReader.
+ */
+class NativeTagReader {
+private:
+    /// The path to the file on disk (not an URI!).
+    wxString m_path;
+
+    /// The file handle, only valid during read().
+    FILE* m_file;
+
+    /// The size of the file in bytes.
+    long long m_fileSize;
+
+    /// The TrackInfo being filled during read().
+    TrackInfo* m_trackInfo;
+
+    /// Encoder delay plus padding in samples, from the LAME header (if any).
+    long long m_encoderGap;
+
+    /// Reads exactly `len' bytes at `offset'. Returns false on a short read.
+    bool readAt(long long offset, void* buffer, size_t len);
+
+    /// Reads an ID3v1 tag at the end of the file, filling in empty tags only.
+    /// Returns true when the tag was there.
+    bool readId3v1();
+
+    /**
+     * Reads an ID3v2 tag at the given offset of the file.
+     *
+     * @param offset The offset of the `ID3' marker.
+     * @param tagSize Set to the full size of the tag (header and footer included).
+     * @return false if this doesn't look like a valid ID3v2 tag.
+     */
+    bool readId3v2(long long offset, long long& tagSize);
+
+    /**
+     * Handles the payload of one ID3v2 frame.
+     *
+     * @param id The frame identifier (three or four characters).
+     * @param data The frame payload (not unsynchronised anymore).
+     */
+    void handleId3v2Frame(const char* id, const std::vector<unsigned char>& data);
+
+    /// Reads the MPEG audio stream starting at `offset'. The duration is exact
+    /// when there's a Xing or VBRI header, and estimated otherwise.
+    bool readMpeg(long long offset, long long audioEnd);
+
+    /**
+     * Reads the frame count from a Xing, Info or VBRI header in the first
+     * frame. Sets m_encoderGap when a LAME extension is found.
+     *
+     * @param framePos The offset of the first frame.
+     * @param header The parsed header of the first frame.
+     * @return The amount of frames, or -1 when there's no such header.
+     */
+    long long readMpegFrameCount(long long framePos, const MpegHeader& header);
+
+    /// Reads a native FLAC stream (`fLaC' marker at the given offset).
+    bool readFlac(long long offset);
+
+    /// Reads an Ogg Vorbis or Ogg Opus stream.
+    bool readOgg();
+
+    /**
+     * Finds the granule position of the last Ogg page of a logical stream, by
+     * scanning backwards from the end of the file.
+     *
+     * @param serial The serial number of the logical stream.
+     * @return The granule position, or -1 when it could not be found.
+     */
+    long long readLastOggGranule(unsigned int serial);
+
+    /// Reads a RIFF WAVE file.
+    bool readRiff();
+
+    /**
+     * Parses a Vorbis comment block (as found in Ogg Vorbis, Opus and FLAC)
+     * and sets the found tags on the track info.
+     *
+     * @param data The comment data, starting at the vendor string length.
+     * @param len The length of the data.
+     */
+    void parseVorbisComments(const unsigned char* data, size_t len);
+
+    /**
+     * Sets a tag on the track info, but only when the value is not empty.
+     * Track numbers, disc numbers and dates are normalized to the same form
+     * as the TagReader produces them (`3/12' becomes `3', `2010-05-01' becomes
+     * `2010').
+     *
+     * @param type One of the TrackInfo static consts.
+     * @param value The value to set.
+     * @param overwrite When false, existing values are left alone.
+     */
+    void setTag(const char* type, const wxString& value, bool overwrite = true);
+
+public:
+    /**
+     * Creates a native tag reader for a file on disk.
+     *
+     * @param path The full path to the file (so no file:// URI).
+     */
+    NativeTagReader(const wxString& path);
+
+    /**
+     * Destructor, closes the file if it's still open.
+     */
+    ~NativeTagReader();
+
+    /**
+     * Reads the tags and duration into the given TrackInfo. The location of the
+     * info is set to the file:// URI of the path, just like TagReader does.
+     *
+     * @param info The TrackInfo to fill.
+     * @return true when the file was understood. When false is returned, the
+     *  contents of `info' are undefined and the TagReader should be used instead.
+     */
+    bool read(TrackInfo& info);
+};
+
+} // namespace navi
+
+#endif // TAGPARSER_HPP
@@ -13,19 +13,42 @@ namespace navi {
 
 // Declared in misc.cpp
 extern const wxEventType naviDirTraversedEvent;
+extern const wxEventType naviDirChangedEvent;
+
+//================================================================================
+
+TrackInfoBatch::TrackInfoBatch() :
+        stored(false) {
+}
+
+void TrackInfoBatch::prepare() {
+    keys.clear();
+    texts.clear();
+    keys.reserve(tracks.size());
+    texts.reserve(tracks.size());
+    for (size_t i = 0; i < tracks.size(); i++) {
+        keys.push_back(TrackSortKey(tracks[i]));
+        texts.push_back(SearchIndex::makeText(tracks[i]));
+    }
+}
 
 //================================================================================
 
 TrackTable::TrackTable(wxWindow* parent) :
         wxListCtrl(parent, TrackTable::ID_TRACKTABLE, wxDefaultPosition, 
-        wxDefaultSize, wxLC_REPORT | wxLC_SINGLE_SEL | wxLC_VRULES | wxVSCROLL),
-        m_currTrackItemIndex(0) {
+        wxDefaultSize, wxLC_REPORT | wxLC_VIRTUAL | wxLC_SINGLE_SEL | wxLC_VRULES | wxVSCROLL),
+        m_removedCount(0),
+        m_rowOfValid(false),
+        m_currTrackItemIndex(0),
+        m_playingMarked(false),
+        m_sortColumn(-1),
+        m_sortAscending(true),
+        m_generation(0),
+        m_modified(false) {
 
-    m_sortDirection[0] = false;
-    m_sortDirection[1] = false;
-    m_sortDirection[2] = false;
-    m_sortDirection[3] = false;
-    m_sortDirection[4] = false;
+    wxFont fontMark = wxSystemSettings::GetFont(wxSYS_SYSTEM_FONT);
+    fontMark.SetWeight(wxFONTWEIGHT_BOLD);
+    m_playingAttr.SetFont(fontMark);
 
     wxListItem item;
 
@@ -51,130 +74,427 @@ TrackTable::TrackTable(wxWindow* parent) :
     SetColumnWidth(4, 150);
 }
 
-// compare functions:
-int wxCALLBACK TrackTable::compareTrackNumber(long item1, long item2, long sortData) {
-    // reinterpret the sortData to a TrackTable pointar. Wtf.
-    TrackTable* roflol = reinterpret_cast<TrackTable*>(sortData);
-    // make sure we have a point0r.
-    if (roflol) {
-        TrackInfo& one = roflol->getTrackInfo(item1);
-        TrackInfo& two = roflol->getTrackInfo(item2);
-
-        long tn1 = strToInt(one[TrackInfo::TRACK_NUMBER], 0);
-        long tn2 = strToInt(two[TrackInfo::TRACK_NUMBER], 0);
-        if (roflol->m_sortDirection[0]) {
-            //return one[TrackInfo::TRACK_NUMBER].Cmp(two[TrackInfo::TRACK_NUMBER]);
-            return tn2 - tn1;
-        } else {
-            //return two[TrackInfo::TRACK_NUMBER].Cmp(one[TrackInfo::TRACK_NUMBER]);
-            return tn1 - tn2;
+int TrackTable::compareTracks(long one, long two) const {
+    int result = TrackSortKey::compare(m_sortKeys[one], m_sortKeys[two],
+        static_cast<TrackSortKey::Column>(m_sortColumn));
+    return m_sortAscending ? result : -result;
+}
+
+bool TrackTable::RowComparator::operator()(long one, long two) const {
+    return m_table->compareTracks(one, two) < 0;
+}
+
+wxString TrackTable::OnGetItemText(long item, long column) const {
+    const TrackInfo& info = m_trackInfos[m_rows[item]];
+
+    switch (column) {
+        case 0: return info.get(TrackInfo::TAG_TRACK_NUMBER);
+        case 1:
+            if (info.get(TrackInfo::TAG_ARTIST).IsEmpty()) {
+                return info.getSimpleName();
+            }
+            return info.get(TrackInfo::TAG_ARTIST);
+        case 2: return info.get(TrackInfo::TAG_TITLE);
+        case 3: return info.get(TrackInfo::TAG_ALBUM);
+        case 4:
+            // estimated durations (VBR files without a Xing header, mostly)
+            // get a tilde in front of them.
+            if (info.getDurationSeconds() < 0) {
+                return wxEmptyString;
+            } else if (!info.isDurationExact()) {
+                return wxT("~") + formatSeconds(info.getDurationSeconds());
+            }
+            return formatSeconds(info.getDurationSeconds());
+        default: return wxEmptyString;
+    }
+}
+
+wxListItemAttr* TrackTable::OnGetItemAttr(long item) const {
+    // the playing track is displayed in bold.
+    if (m_playingMarked && m_rows[item] == m_currTrackItemIndex) {
+        return const_cast<wxListItemAttr*>(&m_playingAttr);
+    }
+
+    return NULL;
+}
+
+long TrackTable::findRow(long index) const {
+    if (!m_rowOfValid) {
+        m_rowOf.assign(m_trackInfos.size(), -1);
+        for (size_t row = 0; row < m_rows.size(); row++) {
+            m_rowOf[m_rows[row]] = row;
         }
+        m_rowOfValid = true;
     }
 
-    return 0;
+    if (index < 0 || static_cast<size_t>(index) >= m_rowOf.size()) {
+        return -1;
+    }
+    return m_rowOf[index];
 }
 
-int wxCALLBACK TrackTable::compareArtistName(long item1, long item2, long sortData) {
-    // reinterpret the sortData to a TrackTable pointar. Wtf.
-    TrackTable* roflol = reinterpret_cast<TrackTable*>(sortData);
-    // make sure we have a point0r.
-    if (roflol) {
-        TrackInfo& one = roflol->getTrackInfo(item1);
-        TrackInfo& two = roflol->getTrackInfo(item2);
+long TrackTable::getSelectedIndex() const {
+    long row = GetNextItem(-1, wxLIST_NEXT_ALL, wxLIST_STATE_SELECTED);
+    return row == -1 ? -1 : m_rows[row];
+}
 
-        if (roflol->m_sortDirection[1]) {
-            return one[TrackInfo::ARTIST].Cmp(two[TrackInfo::ARTIST]);
-        } else {
-            return two[TrackInfo::ARTIST].Cmp(one[TrackInfo::ARTIST]);
+void TrackTable::rowsChanged(long selectedIndex) {
+    SetItemCount(m_rows.size());
+
+    // The list control remembers the selection by row, but the rows have moved.
+    // Move the selection along with the track which was selected.
+    if (selectedIndex != -1) {
+        long oldRow = GetNextItem(-1, wxLIST_NEXT_ALL, wxLIST_STATE_SELECTED);
+        long newRow = findRow(selectedIndex);
+        if (oldRow != newRow) {
+            if (oldRow != -1) {
+                SetItemState(oldRow, 0, wxLIST_STATE_SELECTED | wxLIST_STATE_FOCUSED);
+            }
+            if (newRow != -1) {
+                SetItemState(newRow, wxLIST_STATE_SELECTED | wxLIST_STATE_FOCUSED,
+                    wxLIST_STATE_SELECTED | wxLIST_STATE_FOCUSED);
+            }
         }
     }
 
-    return 0;
+    if (!m_rows.empty()) {
+        RefreshItems(0, m_rows.size() - 1);
+    }
 }
 
-int wxCALLBACK TrackTable::compareTitle(long item1, long item2, long sortData) {
-    // reinterpret the sortData to a TrackTable pointar. Wtf.
-    TrackTable* roflol = reinterpret_cast<TrackTable*>(sortData);
-    // make sure we have a point0r.
-    if (roflol) {
-        TrackInfo& one = roflol->getTrackInfo(item1);
-        TrackInfo& two = roflol->getTrackInfo(item2);
+bool TrackTable::isShown(long index) const {
+    return m_filter.IsEmpty() || m_index.matches(index, m_filterWords);
+}
 
-        if (roflol->m_sortDirection[2]) {
-            return one[TrackInfo::TITLE].Cmp(two[TrackInfo::TITLE]);
-        } else {
-            return two[TrackInfo::TITLE].Cmp(one[TrackInfo::TITLE]);
+void TrackTable::filterRows(const std::vector<bool>& shown) {
+    m_rowOfValid = false;
+    m_rows.clear();
+    for (size_t i = 0; i < m_allRows.size(); i++) {
+        if (shown[m_allRows[i]]) {
+            m_rows.push_back(m_allRows[i]);
         }
     }
-    
-    return 0;
 }
 
-int wxCALLBACK TrackTable::compareAlbum(long item1, long item2, long sortData) {
-    // reinterpret the sortData to a TrackTable pointar. Wtf.
-    TrackTable* roflol = reinterpret_cast<TrackTable*>(sortData);
-    // make sure we have a point0r.
-    if (roflol) {
-        TrackInfo& one = roflol->getTrackInfo(item1);
-        TrackInfo& two = roflol->getTrackInfo(item2);
+void TrackTable::refilterRows() {
+    if (m_filter.IsEmpty()) {
+        m_rows = m_allRows;
+        m_rowOfValid = false;
+        return;
+    }
+
+    std::vector<bool> shown(m_trackInfos.size(), false);
+    for (size_t row = 0; row < m_rows.size(); row++) {
+        shown[m_rows[row]] = true;
+    }
+    filterRows(shown);
+}
 
-        if (roflol->m_sortDirection[3]) {
-            return one[TrackInfo::ALBUM].Cmp(two[TrackInfo::ALBUM]);
-        } else {
-            return two[TrackInfo::ALBUM].Cmp(one[TrackInfo::ALBUM]);
+void TrackTable::insertRow(long index) {
+    bool shown = isShown(index);
+    m_rowOfValid = false;
+    if (m_sortColumn >= 0) {
+        // binary search over the rows, which are sorted on the active column.
+        // Equal tracks go after the existing ones, so the order in which
+        // tracks arrive is kept for them.
+        m_allRows.insert(
+            std::upper_bound(m_allRows.begin(), m_allRows.end(), index, RowComparator(this)),
+            index);
+        if (shown) {
+            m_rows.insert(
+                std::upper_bound(m_rows.begin(), m_rows.end(), index, RowComparator(this)),
+                index);
+        }
+    } else {
+        m_allRows.push_back(index);
+        if (shown) {
+            m_rows.push_back(index);
         }
     }
+}
 
-    return 0;
+long TrackTable::appendTrack(const TrackInfo& info) {
+    return appendTrack(info, TrackSortKey(info), SearchIndex::makeText(info));
 }
 
-int wxCALLBACK TrackTable::compareDuration(long item1, long item2, long sortData) {
-    // reinterpret the sortData to a TrackTable pointar. Wtf.
-    TrackTable* roflol = reinterpret_cast<TrackTable*>(sortData);
-    // make sure we have a point0r.
-    if (roflol) {
-        TrackInfo& one = roflol->getTrackInfo(item1);
-        TrackInfo& two = roflol->getTrackInfo(item2);
+long TrackTable::appendTrack(const TrackInfo& info, const TrackSortKey& key, const std::string& text) {
+    long index = m_trackInfos.size();
+    m_trackInfos.push_back(info);
+    m_sortKeys.push_back(key);
+    m_index.add(index, text);
+    m_byLocation[info.getLocation()] = index;
+    return index;
+}
+
+void TrackTable::updateTracks(const std::vector<std::pair<long, const TrackInfo*> >& updates) {
+    if (updates.empty()) {
+        return;
+    }
+
+    std::vector<bool> changed(m_trackInfos.size(), false);
+    for (size_t i = 0; i < updates.size(); i++) {
+        long index = updates[i].first;
+        const TrackInfo& info = *updates[i].second;
+        m_trackInfos[index] = info;
+        m_sortKeys[index] = TrackSortKey(info);
+        m_index.add(index, info);
+        changed[index] = true;
+    }
+
+    // with other tags, they may (not) match the filter anymore.
+    std::vector<bool> shown(m_trackInfos.size(), false);
+    for (size_t row = 0; row < m_rows.size(); row++) {
+        shown[m_rows[row]] = true;
+    }
+    for (size_t i = 0; i < updates.size(); i++) {
+        shown[updates[i].first] = isShown(updates[i].first);
+    }
 
-        if (roflol->m_sortDirection[4]) {
-            return one.getDurationSeconds() - two.getDurationSeconds();
-        } else {
-            return two.getDurationSeconds() - one.getDurationSeconds();
+    if (m_sortColumn >= 0) {
+        // They're sorted somewhere else now. Take them out in one go, and
+        // merge them back in, like addTrackInfos() does.
+        size_t kept = 0;
+        for (size_t i = 0; i < m_allRows.size(); i++) {
+            if (!changed[m_allRows[i]]) {
+                m_allRows[kept++] = m_allRows[i];
+            }
+        }
+        m_allRows.resize(kept);
+        for (size_t i = 0; i < updates.size(); i++) {
+            if (changed[updates[i].first]) {
+                m_allRows.push_back(updates[i].first);
+                changed[updates[i].first] = false;
+            }
         }
+        std::vector<long>::iterator middle = m_allRows.begin() + kept;
+        std::stable_sort(middle, m_allRows.end(), RowComparator(this));
+        std::inplace_merge(m_allRows.begin(), middle, m_allRows.end(), RowComparator(this));
     }
 
-    return 0;
+    // otherwise they keep their place.
+    filterRows(shown);
 }
 
-void TrackTable::addTrackInfo(TrackInfo& info, bool updateInternally = true) {
-    wxListItem item;
-    item.SetId(GetItemCount());
-    long index = InsertItem(item);
-    SetItem(index, 0, info[TrackInfo::TRACK_NUMBER]); 
-    if (info[TrackInfo::ARTIST].IsEmpty()) {
-        SetItem(index, 1, info.getSimpleName());
+void TrackTable::addTrackInfo(TrackInfo& info) {
+    long selected = getSelectedIndex();
+
+    std::map<wxString, long>::iterator it = m_byLocation.find(info.getLocation());
+    if (it != m_byLocation.end()) {
+        std::vector<std::pair<long, const TrackInfo*> > updates;
+        updates.push_back(std::make_pair(it->second, &info));
+        updateTracks(updates);
     } else {
-        SetItem(index, 1, info[TrackInfo::ARTIST]); 
-    }
-    SetItem(index, 2, info[TrackInfo::TITLE]); 
-    SetItem(index, 3, info[TrackInfo::ALBUM]); 
-    SetItem(index, 4, formatSeconds(info.getDurationSeconds()));
-    // SetItemData using the index variable is vital for getting the correct
-    // selected item of this wxListCtrl (due to sorting and whatnot).
-    SetItemData(index, index);
-
-    if (updateInternally) {
-        // add the info to our backing vector.
-        m_trackInfos.push_back(info);
-
-        // after each track, re-sort the whole list, if that option is given in 
-        // the preferences. XXX: check if this performs well on large directories.
-        bool autosort;
-        wxConfigBase::Get()->Read(Preferences::AUTO_SORT, &autosort, true);
-        if (autosort) {
-            SortItems(TrackTable::compareTrackNumber, reinterpret_cast<long>(this));
+        insertRow(appendTrack(info));
+    }
+    m_modified = true;
+
+    rowsChanged(selected);
+}
+
+void TrackTable::addTrackInfos(const TrackInfoBatch& batch) {
+    if (batch.tracks.empty()) {
+        return;
+    }
+
+    long selected = getSelectedIndex();
+    if (!batch.stored) {
+        m_modified = true;
+    }
+    mergeTracks(batch);
+    rowsChanged(selected);
+}
+
+void TrackTable::mergeTracks(const TrackInfoBatch& batch) {
+    const std::vector<TrackInfo>& infos = batch.tracks;
+    bool prepared = batch.keys.size() == infos.size() && batch.texts.size() == infos.size();
+
+    // tracks which are in the list already, by the DirWatcher.
+    std::vector<std::pair<long, const TrackInfo*> > known;
+
+    size_t oldCount = m_rows.size();
+    size_t oldAllCount = m_allRows.size();
+    for (size_t i = 0; i < infos.size(); i++) {
+        std::map<wxString, long>::iterator it = m_byLocation.find(infos[i].getLocation());
+        if (it != m_byLocation.end()) {
+            // what the DirWatcher reported is newer than the database.
+            if (!batch.stored) {
+                known.push_back(std::make_pair(it->second, &infos[i]));
+            }
+            continue;
+        }
+        long index = prepared ? appendTrack(infos[i], batch.keys[i], batch.texts[i])
+                              : appendTrack(infos[i]);
+        m_allRows.push_back(index);
+        if (isShown(index)) {
+            m_rows.push_back(index);
+        }
+    }
+    m_rowOfValid = false;
+
+    if (m_sortColumn >= 0) {
+        // Only sort the new rows, then merge them with the already sorted
+        // ones. Both are stable, so equal tracks keep their order of arrival.
+        std::vector<long>::iterator middle = m_rows.begin() + oldCount;
+        std::stable_sort(middle, m_rows.end(), RowComparator(this));
+        std::inplace_merge(m_rows.begin(), middle, m_rows.end(), RowComparator(this));
+
+        middle = m_allRows.begin() + oldAllCount;
+        std::stable_sort(middle, m_allRows.end(), RowComparator(this));
+        std::inplace_merge(m_allRows.begin(), middle, m_allRows.end(), RowComparator(this));
+    }
+
+    // now the rows are sorted again, these can be moved to their place.
+    updateTracks(known);
+}
+
+void TrackTable::applyChanges(const DirChangeSet& changes) {
+    long selected = getSelectedIndex();
+    m_modified = true;
+
+    std::vector<long> gone;
+    for (size_t i = 0; i < changes.removed.GetCount(); i++) {
+        std::map<wxString, long>::iterator it = m_byLocation.find(wxT("file://") + changes.removed[i]);
+        if (it != m_byLocation.end()) {
+            gone.push_back(it->second);
+        }
+    }
+    for (size_t i = 0; i < changes.removedDirs.GetCount(); i++) {
+        // the map is sorted, so everything below the directory is one range.
+        wxString prefix = wxT("file://") + changes.removedDirs[i] + wxT("/");
+        std::map<wxString, long>::iterator it = m_byLocation.lower_bound(prefix);
+        while (it != m_byLocation.end() && it->first.StartsWith(prefix)) {
+            gone.push_back(it->second);
+            ++it;
+        }
+    }
+
+    if (!gone.empty()) {
+        removeTracks(gone, selected);
+    }
+
+    // New files are merged in, modified ones take the new tags and move to
+    // where they belong now. Both in one go, however many there are.
+    if (!changes.updated.empty()) {
+        TrackInfoBatch batch;
+        batch.tracks = changes.updated;
+        mergeTracks(batch);
+    }
+
+    if (selected != -1) {
+        m_selectedItem = m_trackInfos[selected];
+    }
+
+    rowsChanged(selected);
+}
+
+void TrackTable::removeTracks(const std::vector<long>& gone, long& selectedIndex) {
+    std::vector<long> sorted(gone);
+    std::sort(sorted.begin(), sorted.end());
+    sorted.erase(std::unique(sorted.begin(), sorted.end()), sorted.end());
+
+    for (size_t i = 0; i < sorted.size(); i++) {
+        long index = sorted[i];
+        m_index.remove(index);
+        m_byLocation.erase(m_trackInfos[index].getLocation());
+        // the tombstone.
+        m_trackInfos[index] = TrackInfo();
+        m_sortKeys[index] = TrackSortKey();
+        m_removedCount++;
+    }
+
+    // Drop the rows in one pass, and find out where the playing track was.
+    bool playingGone = std::binary_search(sorted.begin(), sorted.end(), m_currTrackItemIndex);
+    long playingRow = -1;
+    size_t kept = 0;
+    for (size_t row = 0; row < m_rows.size(); row++) {
+        if (m_rows[row] == m_currTrackItemIndex) {
+            playingRow = kept;
+        }
+        if (!std::binary_search(sorted.begin(), sorted.end(), m_rows[row])) {
+            m_rows[kept++] = m_rows[row];
+        }
+    }
+    m_rows.resize(kept);
+    m_rowOfValid = false;
+
+    kept = 0;
+    for (size_t i = 0; i < m_allRows.size(); i++) {
+        if (!std::binary_search(sorted.begin(), sorted.end(), m_allRows[i])) {
+            m_allRows[kept++] = m_allRows[i];
+        }
+    }
+    m_allRows.resize(kept);
+
+    if (selectedIndex != -1 && std::binary_search(sorted.begin(), sorted.end(), selectedIndex)) {
+        selectedIndex = -1;
+    }
+
+    if (playingGone) {
+        m_playingMarked = false;
+        if (playingRow > 0) {
+            // Pretend the track before it was played, so getNext() continues
+            // with the track which followed it.
+            m_currTrackItemIndex = m_rows[playingRow - 1];
+        } else if (playingRow == 0 && !m_rows.empty()) {
+            m_currTrackItemIndex = m_rows.back();
+        }
+        // Otherwise it wasn't displayed (filtered out). The index still points
+        // at its tombstone, and getNext() goes on from the nearest track.
+    }
+
+    if (m_removedCount >= MIN_COMPACT && m_removedCount > m_trackInfos.size() / 2) {
+        compact(selectedIndex);
+    }
+}
+
+void TrackTable::compact(long& selectedIndex) {
+    std::vector<long> remap(m_trackInfos.size(), -1);
+    size_t kept = 0;
+    for (size_t i = 0; i < m_trackInfos.size(); i++) {
+        if (m_trackInfos[i].isValid()) {
+            remap[i] = kept;
+            if (kept != i) {
+                m_trackInfos[kept] = m_trackInfos[i];
+                m_sortKeys[kept] = m_sortKeys[i];
+            }
+            kept++;
         }
     }
+    m_trackInfos.resize(kept);
+    m_sortKeys.resize(kept);
+    m_removedCount = 0;
+
+    m_index.compact(remap);
+    std::map<wxString, long>::iterator it;
+    for (it = m_byLocation.begin(); it != m_byLocation.end(); it++) {
+        it->second = remap[it->second];
+    }
+    for (size_t row = 0; row < m_rows.size(); row++) {
+        m_rows[row] = remap[m_rows[row]];
+    }
+    m_rowOfValid = false;
+    for (size_t i = 0; i < m_allRows.size(); i++) {
+        m_allRows[i] = remap[m_allRows[i]];
+    }
+
+    if (selectedIndex != -1) {
+        selectedIndex = remap[selectedIndex];
+    }
+
+    // The playing track may be a tombstone itself: continue from the nearest
+    // track before it.
+    long playing = std::min(m_currTrackItemIndex, (long) remap.size() - 1);
+    while (playing > 0 && remap[playing] == -1) {
+        playing--;
+    }
+    m_currTrackItemIndex = playing < 0 || remap[playing] == -1 ? 0 : remap[playing];
+}
+
+void TrackTable::sortRows() {
+    long selected = getSelectedIndex();
+    std::stable_sort(m_allRows.begin(), m_allRows.end(), RowComparator(this));
+    refilterRows();
+    rowsChanged(selected);
 }
 
 TrackInfo TrackTable::getSelectedItem() throw() {
@@ -183,42 +503,53 @@ TrackInfo TrackTable::getSelectedItem() throw() {
 }
 
 TrackInfo TrackTable::getTrackBeforeOrAfterCurrent(int pos, bool markAsPlaying) throw() {
-    // Magic happens here. Iterate over the current displayed items (sorted).
-    // Then figure out which one is playing right now (by checking the current
-    // track item index with the GetItemData() result). Once we find it, get the
-    // next track in sequence. 
-
-    for (int i = 0; i < GetItemCount(); i++) {
-        wxColour colour = GetItemBackgroundColour(i);
-        long d = GetItemData(i);
-        if (d == m_currTrackItemIndex) {
-            TrackInfo currentlyPlaying = m_trackInfos[d];
-
-            long next = i + pos;
-            if (next >= GetItemCount()) {
-                next = 0; // 'rotate' to the first track
-            } else if (next <= 0) {
-                next = GetItemCount() - 1; // 'rotate' to the last track
-            }
+    // Magic happens here. Figure out at which row the current track is being
+    // displayed (the rows may be sorted). Once we find it, get the next track
+    // in sequence. 
+    if (m_rows.empty()) {
+        TrackInfo emptyone;
+        return emptyone;
+    }
 
+    long next;
+    long row = findRow(m_currTrackItemIndex);
+    if (row != -1) {
+        next = row + pos;
+        if (next >= (long) m_rows.size()) {
+            next = 0; // 'rotate' to the first track
+        } else if (next < 0) {
+            next = m_rows.size() - 1; // 'rotate' to the last track
+        }
+    } else {
+        next = findNearestRow(m_currTrackItemIndex, pos > 0);
+    }
 
-            long nextData = GetItemData(next);
-            if (markAsPlaying) {
-                // this marks the current playing track, based on the
-                // zero index, sorted rows..
-                markPlayedTrack(next);
-                // and this sets the track item index based on the 
-                // *item data* (GetItemData()).
-                m_currTrackItemIndex = nextData;
+    if (markAsPlaying) {
+        // this marks the current playing track, based on the
+        // zero index, sorted rows..
+        markPlayedTrack(next);
+    }
+
+    return m_trackInfos[m_rows[next]];
+}
+
+long TrackTable::findNearestRow(long index, bool after) const {
+    // The rows may be sorted on anything, so look at all of them. Without a
+    // track on the wanted side, 'rotate' to the other end.
+    long nearest = -1;
+    long wrapped = 0;
+    for (size_t row = 0; row < m_rows.size(); row++) {
+        long candidate = m_rows[row];
+        if (after ? candidate > index : candidate < index) {
+            if (nearest == -1 || (after ? candidate < m_rows[nearest] : candidate > m_rows[nearest])) {
+                nearest = row;
             }
-            TrackInfo nextx = m_trackInfos[nextData];
-            return m_trackInfos[nextData];
+        }
+        if (after ? candidate < m_rows[wrapped] : candidate > m_rows[wrapped]) {
+            wrapped = row;
         }
     }
-
-    // XXX: return none??
-    TrackInfo emptyone;
-    return emptyone;
+    return nearest != -1 ? nearest : wrapped;
 }
 
 TrackInfo TrackTable::getPrev(bool markAsPlaying) throw() {
@@ -229,95 +560,162 @@ TrackInfo TrackTable::getNext(bool markAsPlaying) throw() {
     return getTrackBeforeOrAfterCurrent(1, markAsPlaying);
 }
 
-void TrackTable::markPlayedTrack(long newItemId) throw() {
-    wxFont fontDef  = wxSystemSettings::GetFont(wxSYS_SYSTEM_FONT);
-    wxFont fontMark = wxSystemSettings::GetFont(wxSYS_SYSTEM_FONT);
-    fontMark.SetWeight(wxFONTWEIGHT_BOLD);
+void TrackTable::markPlayedTrack(long row) throw() {
+    // Only the old and the new row need to be repainted. OnGetItemAttr()
+    // takes care of the boldness.
+    long oldRow = m_playingMarked ? findRow(m_currTrackItemIndex) : -1;
 
-    // XXX: unmark all items... Looks like a bit of a brute force, so
-    // test this thorougly with LOTS of items in the list to check if
-    // this performs well enough.
-    long item = -1;
-    while(true) {
-        item = GetNextItem(item);
-        if (item == -1) {
-            break;
-        }
+    m_currTrackItemIndex = m_rows[row];
+    m_playingMarked = true;
+
+    if (oldRow != -1) {
+        RefreshItem(oldRow);
+    }
+    RefreshItem(row);
+}
 
-        SetItemFont(item, fontDef);
+TrackInfo TrackTable::markPlayedLocation(const wxString& location) throw() {
+    std::map<wxString, long>::iterator it = m_byLocation.find(location);
+    if (it == m_byLocation.end()) {
+        TrackInfo emptyone;
+        return emptyone;
     }
 
-    // last but not least, mark the selected item as playing.
-    SetItemFont(newItemId, fontMark);
+    long row = findRow(it->second);
+    if (row != -1) {
+        markPlayedTrack(row);
+    } else {
+        // no row to paint, but the old one must lose its boldness.
+        long oldRow = m_playingMarked ? findRow(m_currTrackItemIndex) : -1;
+        m_currTrackItemIndex = it->second;
+        m_playingMarked = true;
+        if (oldRow != -1) {
+            RefreshItem(oldRow);
+        }
+    }
+
+    return m_trackInfos[it->second];
 }
 
 TrackInfo& TrackTable::getTrackInfo(int index) {
     return m_trackInfos[index];
 }
 
+const std::vector<TrackInfo>& TrackTable::getTrackInfos() const {
+    return m_trackInfos;
+}
+
+bool TrackTable::isModified() const {
+    return m_modified;
+}
+
+void TrackTable::setModified(bool modified) {
+    m_modified = modified;
+}
+
+long TrackTable::getTrackIndex(long row) const {
+    return m_rows[row];
+}
+
 void TrackTable::DeleteAllItems() {
     wxListCtrl::DeleteAllItems();
     m_trackInfos.clear();
+    m_sortKeys.clear();
+    m_byLocation.clear();
+    m_removedCount = 0;
+    m_rows.clear();
+    m_allRows.clear();
+    m_rowOfValid = false;
+    m_index.clear();
+    m_currTrackItemIndex = 0;
+    m_playingMarked = false;
+    m_modified = false;
+
+    // A fresh list: when auto sorting is enabled, keep it sorted on track
+    // number while it's being filled. Otherwise, keep the order of arrival.
+    bool autosort;
+    wxConfigBase::Get()->Read(Preferences::AUTO_SORT, &autosort, true);
+    m_sortColumn = autosort ? 0 : -1;
+    m_sortAscending = true;
+}
+
+void TrackTable::setFilter(const wxString& filter) {
+    wxString trimmed(filter);
+    trimmed.Trim(true).Trim(false);
+    if (trimmed == m_filter) {
+        return;
+    }
+
+    long selected = getSelectedIndex();
+    m_filter = trimmed;
+    SearchIndex::splitWords(m_filter, m_filterWords);
+
+    // m_allRows is in the displayed order already, so nothing is sorted here.
+    if (m_filter.IsEmpty()) {
+        m_rows = m_allRows;
+        m_rowOfValid = false;
+    } else {
+        std::vector<long> ids;
+        m_index.find(m_filterWords, ids);
+        std::vector<bool> shown(m_trackInfos.size(), false);
+        for (size_t i = 0; i < ids.size(); i++) {
+            shown[ids[i]] = true;
+        }
+        filterRows(shown);
+    }
+
+    rowsChanged(selected);
+}
+
+const wxString& TrackTable::getFilter() const {
+    return m_filter;
 }
 
 void TrackTable::onActivate(wxListEvent& event) {
     // when an item is activated by double clicking, mark it as currently playing.
     markPlayedTrack(event.GetIndex());
-    m_currTrackItemIndex = event.GetData();
     // skip this when a listitem is activated (propagate it up the chain!)
     // In this case, main.cpp (NaviMainFrame) handles this event.
     event.Skip();
 }
 
 void TrackTable::onColumnClick(wxListEvent& event) {
-    // XXX: This is fucking ridiculous. Using long as callback data?! wx, what
-    // the fuck are you doing to me? Anyway, from PlasmaHH from #wxwidgets on freenode:
-    //
-    //      "it might be that sizeof(long) < sizeof(ObjectInstance) and 
-    //       then you are screwed" 
-    // 
-    // So in this case, I'm just gonna blurt out some error message, until
-    // I find a way to fix this.
-    if (sizeof(long) != sizeof(this)) {
-        std::cerr << "Major malfunction. sizeof(long) != sizeof(this)" << std::endl;
+    // Clicking the sorted column again swaps the sorting direction yay!
+    // Another column starts out ascending. The chosen column stays the
+    // active sort order, so tracks added later end up in the right place.
+    int column = event.GetColumn();
+    if (column < 0 || column > 4) {
+        return;
+    }
+    if (column == m_sortColumn) {
+        m_sortAscending = !m_sortAscending;
     } else {
-        // commence sorting. We can somewhat 'guarantee' that casting a this 
-        // to a long succeeds. Check which column has been clicked, then sort
-        // appropriately.
-        switch (event.GetColumn()) {
-            case 0: SortItems(TrackTable::compareTrackNumber, (long) this); break;
-            case 1: SortItems(TrackTable::compareArtistName, (long) this); break;
-            case 2: SortItems(TrackTable::compareTitle, (long) this); break;
-            case 3: SortItems(TrackTable::compareAlbum, (long) this); break;
-            case 4: SortItems(TrackTable::compareDuration, (long) this); break;
-            default: break;
-        }
-
-        // swap sorting direction yay!:
-        m_sortDirection[event.GetColumn()] = !m_sortDirection[event.GetColumn()]; 
+        m_sortColumn = column;
+        m_sortAscending = true;
     }
+
+    sortRows();
 }
 
 void TrackTable::onSelected(wxListEvent& event) {
     // after a select event, we can safely determine the CORRECT selected
-    // item, even after it has been sorted by artist, title, or whatever.
-    // even.getData() returns the correct index, because of the SetItemData()
-    // call we've done in addTrackInfo(TrackInfo&).
-    long data = event.GetData();
-    TrackInfo& info = getTrackInfo(data);
-    // assign the address of this thing as the selected item.
+    // item, even after it has been sorted by artist, title, or whatever,
+    // by looking up the row in the permutation.
+    TrackInfo& info = getTrackInfo(m_rows[event.GetIndex()]);
     m_selectedItem = info;
 }
 
 void TrackTable::onAddTrackInfo(wxCommandEvent& event) {
-    TrackInfo* d = static_cast<TrackInfo*>(event.GetClientObject());
-    if (d) {
-        addTrackInfo(*d);
+    TrackInfoBatch* d = static_cast<TrackInfoBatch*>(event.GetClientObject());
+    if (event.GetExtraLong() != m_generation) {
+        // left over from a directory which is not displayed anymore.
+    } else if (d) {
+        addTrackInfos(*d);
     } else {
-        std::cerr << "TrackInfo should exist here, huh!" << std::endl;
+        std::cerr << "TrackInfoBatch should exist here, huh!" << std::endl;
     }
 
-    // since the UCD instance was created on the heap in a thread and
+    // since the batch instance was created on the heap in a thread and
     // added to the wxCommandEvent, we must also delete it manually, because
     // the event itself won't delete it in its destructor. This is conforming
     // the documentation from wxCommandEvent.
@@ -326,6 +724,16 @@ void TrackTable::onAddTrackInfo(wxCommandEvent& event) {
     event.Skip();
 }
 
+void TrackTable::onDirChanged(wxCommandEvent& event) {
+    DirChangeSet* changes = static_cast<DirChangeSet*>(event.GetClientObject());
+    if (changes && event.GetExtraLong() == m_generation) {
+        applyChanges(*changes);
+    }
+
+    // created on the heap by the DirWatcher, just like the batches.
+    delete changes;
+}
+
 void TrackTable::onResize(wxSizeEvent& event) {
     int width, height;
     GetSize(&width, &height);
@@ -346,18 +754,22 @@ void TrackTable::onResize(wxSizeEvent& event) {
 }
 
 void TrackTable::shuffle() {
-    // don't call our DeleteAllItems(), since it also clears the vector.
-    wxListCtrl::DeleteAllItems();
-    // randomize vector
-    std::random_shuffle(m_trackInfos.begin(), m_trackInfos.end());
-    // re-add them all.
-    std::vector<TrackInfo>::iterator it = m_trackInfos.begin();
-    while (it < m_trackInfos.end()) {
-        TrackInfo info = *it;
-        addTrackInfo(info, false);
-        it++;
-    }
+    // randomize the rows. The tracks themselves stay where they are, so the
+    // index of the playing track stays valid. The list is not sorted on any
+    // column anymore.
+    long selected = getSelectedIndex();
+    std::random_shuffle(m_allRows.begin(), m_allRows.end());
+    refilterRows();
+    m_sortColumn = -1;
+    rowsChanged(selected);
+}
 
+void TrackTable::setGeneration(long generation) {
+    m_generation = generation;
+}
+
+long TrackTable::getGeneration() const {
+    return m_generation;
 }
 
 BEGIN_EVENT_TABLE(TrackTable, wxListCtrl)
@@ -365,10 +777,46 @@ BEGIN_EVENT_TABLE(TrackTable, wxListCtrl)
     EVT_LIST_ITEM_SELECTED(TrackTable::ID_TRACKTABLE, TrackTable::onSelected)
     EVT_LIST_COL_CLICK(TrackTable::ID_TRACKTABLE, TrackTable::onColumnClick)
     EVT_COMMAND(wxID_ANY, naviDirTraversedEvent, TrackTable::onAddTrackInfo)
+    EVT_COMMAND(wxID_ANY, naviDirChangedEvent, TrackTable::onDirChanged)
     EVT_SIZE(TrackTable::onResize)
 END_EVENT_TABLE()
 
 //================================================================================
 
+TrackTableContainer::TrackTableContainer(wxWindow* parent) :
+        wxPanel(parent, wxID_ANY) {
+    m_search = new wxSearchCtrl(this, ID_FILTER);
+    m_search->ShowCancelButton(true);
+    m_search->SetDescriptiveText(wxT("Filter on artist, title, album or file name"));
+
+    m_trackTable = new TrackTable(this);
+
+    wxBoxSizer* sizer = new wxBoxSizer(wxVERTICAL);
+    SetSizer(sizer);
+    sizer->Add(m_search, wxSizerFlags().Expand().Border(wxBOTTOM, 3));
+    sizer->Add(m_trackTable, wxSizerFlags(1).Expand());
+}
+
+TrackTable* TrackTableContainer::getTrackTable() const {
+    return m_trackTable;
+}
+
+void TrackTableContainer::onFilter(wxCommandEvent& event) {
+    // The index answers fast enough to do this on every key stroke.
+    m_trackTable->setFilter(m_search->GetValue());
+}
+
+void TrackTableContainer::onFilterCancel(wxCommandEvent& event) {
+    // results in an EVT_TEXT, which clears the filter.
+    m_search->Clear();
+}
+
+BEGIN_EVENT_TABLE(TrackTableContainer, wxPanel)
+    EVT_TEXT(TrackTableContainer::ID_FILTER, TrackTableContainer::onFilter)
+    EVT_SEARCHCTRL_CANCEL_BTN(TrackTableContainer::ID_FILTER, TrackTableContainer::onFilterCancel)
+END_EVENT_TABLE()
+
+//================================================================================
+
 } // namespace navi
 
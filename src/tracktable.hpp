@@ -22,6 +22,8 @@
 
 #include "audio.hpp"
 #include "misc.hpp"
+#include "search.hpp"
+#include "watcher.hpp"
 
 #include <wx/listctrl.h>
 #include <wx/filename.h>
@@ -30,7 +32,9 @@
 #include <wx/colour.h>
 #include <wx/dataview.h>
 #include <wx/settings.h>
+#include <wx/srchctrl.h>
 
+#include <map>
 #include <vector>
 #include <algorithm> // for random_shuffle
 #include <iostream>
@@ -44,11 +48,129 @@ namespace navi {
 
 //================================================================================
 
+/**
+ * A batch of read track infos, used as the client object of the events posted
+ * by the DirTraversalThread and the LibraryLoadThread. Adding tracks one event
+ * at a time makes the list control repaint (and re-sort) for every single
+ * file, so they're bundled.
+ */
+class TrackInfoBatch : public wxClientData {
+public:
+    /// The tracks, in the order in which they should be added.
+    std::vector<TrackInfo> tracks;
+
+    /// The sort keys of the tracks, filled by prepare().
+    std::vector<TrackSortKey> keys;
+
+    /// The searchable texts of the tracks, filled by prepare().
+    std::vector<std::string> texts;
+
+    /// Whether the tracks come from the LibraryDb, so adding them doesn't
+    /// modify the library.
+    bool stored;
+
+    TrackInfoBatch();
+
+    /**
+     * Computes the sort keys and the searchable texts of the tracks. Called by
+     * the thread which posts the batch, so the UI thread only has to store
+     * them.
+     */
+    void prepare();
+};
+
+//================================================================================
+
+/**
+ * The TrackTable displays the tracks of the activated directory. It's a virtual
+ * list control: the rows are not stored in the control itself, but are rendered
+ * on demand by OnGetItemText() from the backing vector of TrackInfo objects.
+ * The order in which the tracks are displayed is a permutation of indices in
+ * that vector, so sorting and shuffling never touch the tracks themselves.
+ *
+ * When a filter is set, only the tracks matching it (see SearchIndex) get a
+ * row. Tracks which arrive later are filtered as they come in.
+ *
+ * Tracks are identified by their location. Removing a track leaves an invalid
+ * TrackInfo behind in the vector (a tombstone), so the indices of the other
+ * tracks stay the same. The tombstones are compacted once they outnumber the
+ * tracks, which keeps a removal cheap, also in a large library.
+ */
 class TrackTable : public wxListCtrl {
 private:
-    /// Vector holding the trackinfo objects.
+    /**
+     * Functor to sort the row permutation on the active sort column.
+     */
+    class RowComparator {
+    private:
+        const TrackTable* m_table;
+    public:
+        RowComparator(const TrackTable* table) : m_table(table) {}
+        bool operator()(long one, long two) const;
+    };
+
+    /// Vector holding the trackinfo objects, in the order they were added.
+    /// Removed tracks are invalid TrackInfos.
     std::vector<TrackInfo> m_trackInfos;
 
+    /// The index in m_trackInfos of every track, by location.
+    std::map<wxString, long> m_byLocation;
+
+    /// Amount of removed tracks in m_trackInfos.
+    size_t m_removedCount;
+
+    /// Compacting starts at this amount of removed tracks, at the least.
+    static const size_t MIN_COMPACT = 1024;
+
+    /// The displayed rows. Each row holds an index in m_trackInfos.
+    std::vector<long> m_rows;
+
+    /// Every track, in the displayed order (sorted or shuffled) as if there
+    /// was no filter. m_rows is the part of it which matches the filter, in
+    /// the same order, so filtering never has to sort.
+    std::vector<long> m_allRows;
+
+    /// The row of every track in m_rows, -1 for tracks without one. Only
+    /// valid when m_rowOfValid is set: it's filled by findRow() when needed.
+    mutable std::vector<long> m_rowOf;
+
+    /// Whether m_rowOf is up to date. Reset whenever m_rows changes.
+    mutable bool m_rowOfValid;
+
+    /// The sort keys of the tracks, at the same indices as m_trackInfos.
+    std::vector<TrackSortKey> m_sortKeys;
+
+    /// Search index over all tracks in m_trackInfos, by index.
+    SearchIndex m_index;
+
+    /// The current filter, empty to show every track.
+    wxString m_filter;
+
+    /// m_filter, split in normalized words (see SearchIndex::splitWords()).
+    std::vector<std::string> m_filterWords;
+
+    /**
+     * Whether a track gets a row with the current filter.
+     *
+     * @param index The index of the track in the backing vector.
+     */
+    bool isShown(long index) const;
+
+    /**
+     * Fills m_rows with the tracks in m_allRows which are marked, keeping
+     * their order.
+     *
+     * @param shown For every index in the backing vector, whether it gets a
+     *  row.
+     */
+    void filterRows(const std::vector<bool>& shown);
+
+    /**
+     * Fills m_rows again after m_allRows was reordered. The tracks which had
+     * a row keep one.
+     */
+    void refilterRows();
+
     /// Executed when an item is activated (i.e. dbl clicked, entere'ed)
     void onActivate(wxListEvent& event);
 
@@ -61,17 +183,132 @@ private:
     /// Executed when track info is about to be added (from another thread).
     void onAddTrackInfo(wxCommandEvent& event);
 
+    /// Executed when the DirWatcher noticed changes on disk.
+    void onDirChanged(wxCommandEvent& event);
+
+    /**
+     * Appends a track to the backing vector, and adds it to the search index
+     * and the locations. It doesn't get a row.
+     *
+     * @return The index of the track.
+     */
+    long appendTrack(const TrackInfo& info);
+
+    /**
+     * Appends a track of which the sort key and the searchable text are known
+     * already (see TrackInfoBatch::prepare()).
+     *
+     * @return The index of the track.
+     */
+    long appendTrack(const TrackInfo& info, const TrackSortKey& key, const std::string& text);
+
+    /**
+     * Replaces the tags of tracks, and moves their rows to where they belong
+     * now (they may (not) match the filter anymore, too). The rows are moved
+     * all at once, so this takes one pass over the list however many tracks
+     * change.
+     *
+     * @param updates The index of each track, with the track (at the same
+     *  location) to replace it with.
+     */
+    void updateTracks(const std::vector<std::pair<long, const TrackInfo*> >& updates);
+
+    /**
+     * Adds a batch of tracks, and gives them their rows, without updating the
+     * control (see addTrackInfos()).
+     *
+     * @param batch The tracks.
+     */
+    void mergeTracks(const TrackInfoBatch& batch);
+
+    /**
+     * Removes tracks: their rows are removed, and they're replaced by
+     * tombstones. When the playing track is removed, the track displayed
+     * before it counts as the played one, so getNext() continues with the
+     * track which followed it.
+     *
+     * @param gone The indices of the tracks to remove.
+     * @param selectedIndex The selected index, set to -1 when the selected
+     *  track is removed (or renumbered, when compacting).
+     */
+    void removeTracks(const std::vector<long>& gone, long& selectedIndex);
+
+    /**
+     * Drops the tombstones from the backing vector. The other tracks move
+     * down, so the rows, the locations, the search index, the playing track
+     * and the selection are renumbered.
+     *
+     * @param selectedIndex The selected index, which is renumbered.
+     */
+    void compact(long& selectedIndex);
+
+    /**
+     * Inserts a track in m_allRows at its sorted position, or at the bottom
+     * when the list is not sorted. It gets a row in m_rows the same way, when
+     * it matches the filter.
+     *
+     * @param index The index of the track in the backing vector.
+     */
+    void insertRow(long index);
+
     TrackInfo getTrackBeforeOrAfterCurrent(int pos, bool markAsPlaying) throw();
 
-    void markPlayedTrack(long newItemId) throw();
+    /**
+     * Finds the row of the displayed track nearest to a track which has no
+     * row, like the playing track when the filter hides it. Nearest is in
+     * the order the tracks were added, which is the directory order.
+     *
+     * @param index The index of the track in the backing vector.
+     * @param after Whether to look for the track after it, or before it.
+     * @return The row, or 0 when there are no rows.
+     */
+    long findNearestRow(long index, bool after) const;
+
+    /**
+     * Marks the track displayed at the given row as the playing one.
+     *
+     * @param row The row (not the index in the vector!).
+     */
+    void markPlayedTrack(long row) throw();
 
-    // static callback methods, for sorting. sortData is always the `this' instance
-    // of TrackTable.
-    static int wxCALLBACK compareTrackNumber(long item1, long item2, long sortData);
-    static int wxCALLBACK compareArtistName(long item1, long item2, long sortData);
-    static int wxCALLBACK compareTitle(long item1, long item2, long sortData);
-    static int wxCALLBACK compareAlbum(long item1, long item2, long sortData);
-    static int wxCALLBACK compareDuration(long item1, long item2, long sortData);
+    /**
+     * Compares two tracks on the active sort column, in the active direction,
+     * using their sort keys (see TrackSortKey::compare()).
+     *
+     * @param one The index of the first track in the backing vector.
+     * @param two The index of the second track.
+     * @return A negative, zero or positive value if the first track should be
+     *  displayed before, at the same spot, or after the second one.
+     */
+    int compareTracks(long one, long two) const;
+
+    /**
+     * Finds the row at which a track is displayed. The rows of all tracks are
+     * looked up in one pass after the rows have changed, later calls don't
+     * search.
+     *
+     * @param index The index of the track in the backing vector.
+     * @return The row, or -1 if there's no such track.
+     */
+    long findRow(long index) const;
+
+    /**
+     * Returns the index (in the backing vector) of the selected track, or -1
+     * when nothing is selected.
+     */
+    long getSelectedIndex() const;
+
+    /**
+     * Must be called after m_rows has changed. Updates the item count of the
+     * control, moves the selection to the row where the selected track went,
+     * and repaints.
+     *
+     * @param selectedIndex The result of getSelectedIndex(), before the change.
+     */
+    void rowsChanged(long selectedIndex);
+
+    /// Sorts all rows on the active sort column.
+    void sortRows();
 
     /// The current selected item. May be NULL. Don't destroy this thing.
     TrackInfo m_selectedItem;
@@ -79,9 +316,42 @@ private:
     /// The current track item index (in the vector)
     long m_currTrackItemIndex;
 
-    // array of bools for sort direction. 4 length, for each of the
-    // four columns. true = ascending, false = descending.
-    bool m_sortDirection[5];
+    /// Whether the track at m_currTrackItemIndex must be displayed as playing.
+    bool m_playingMarked;
+
+    /// The looks of the row of the playing track.
+    wxListItemAttr m_playingAttr;
+
+    /// The column the list is currently sorted on, or -1 when it's not sorted.
+    /// The rows are kept in this order when new tracks are added.
+    int m_sortColumn;
+
+    /// Sort direction of m_sortColumn. true = ascending, false = descending.
+    bool m_sortAscending;
+
+    /// The generation of the displayed directory. Events with another
+    /// generation come from an abandoned traversal, and are dropped.
+    long m_generation;
+
+    /// Whether tracks were added or changed since the last setModified(false).
+    bool m_modified;
+
+protected:
+    /**
+     * Override from wxListCtrl. Returns the text of a cell, for rendering.
+     *
+     * @param item The row.
+     * @param column The column.
+     */
+    virtual wxString OnGetItemText(long item, long column) const;
+
+    /**
+     * Override from wxListCtrl. Returns the attributes of a row, which makes
+     * the playing track bold.
+     *
+     * @param item The row.
+     */
+    virtual wxListItemAttr* OnGetItemAttr(long item) const;
 
 public:
     /// The window ID for this track table.
@@ -97,11 +367,33 @@ public:
     TrackTable(wxWindow* parent);
 
     /**
-     * Adds tracking info to the list control.
+     * Adds tracking info to the list control. When the list is sorted on a
+     * column, the row is inserted at its sorted position (binary search).
      *
      * @param info The trackinfo to add.
      */
-    void addTrackInfo(TrackInfo& info, bool updateInternally);
+    void addTrackInfo(TrackInfo& info);
+
+    /**
+     * Adds a bunch of track infos at once. When the list is sorted on a column,
+     * the new rows are sorted among themselves and then merged with the
+     * existing rows, which keeps the whole list sorted. A track with the
+     * location of one in the list replaces it: the DirWatcher may have
+     * reported a new file before the DirTraversalThread got to it.
+     *
+     * @param batch The tracks to add. When the batch is prepared, its sort
+     *  keys and searchable texts are used.
+     */
+    void addTrackInfos(const TrackInfoBatch& batch);
+
+    /**
+     * Applies changes on disk to the list. Deleted files are removed, modified
+     * files get their new tags (and move to their new sorted position), and
+     * new files are added. Only the affected rows are touched.
+     *
+     * @param changes The changes, as collected by the DirWatcher.
+     */
+    void applyChanges(const DirChangeSet& changes);
 
     /**
      * Gets the current (possibly) selected track. It may return a null
@@ -119,9 +411,20 @@ public:
      */
     TrackInfo getNext(bool markAsPlaying = false) throw();
 
+    /**
+     * Marks the track with the given location as the playing one, whether it
+     * has a row or not (filtered out). getNext() and getPrev() continue from
+     * it.
+     *
+     * @param location The URI of the track.
+     * @return The track, or an invalid TrackInfo when it's not in the list.
+     */
+    TrackInfo markPlayedLocation(const wxString& location) throw();
+
     /**
      * Override from wxListCtrl. In addition to deleting the items from the list
-     * control itself, it also clears the backing std::vector.
+     * control itself, it also clears the backing std::vector, and resets the
+     * sort order (track number, when auto sorting is enabled).
      */
     void DeleteAllItems();
 
@@ -134,6 +437,32 @@ public:
      */
     TrackInfo& getTrackInfo(int index);
 
+    /**
+     * Returns all tracks, in the order they were added (not the displayed
+     * order). Removed tracks may still be in there as invalid TrackInfos.
+     */
+    const std::vector<TrackInfo>& getTrackInfos() const;
+
+    /**
+     * Whether tracks were added, changed or removed since the list was cleared,
+     * or since setModified(false).
+     */
+    bool isModified() const;
+
+    /**
+     * Sets the modified flag, see isModified().
+     */
+    void setModified(bool modified);
+
+    /**
+     * Returns the index in the backing vector of the track displayed at the
+     * given row. Use it to translate row numbers from list events.
+     *
+     * @param row The displayed row.
+     * @return The index, to be used with getTrackInfo().
+     */
+    long getTrackIndex(long row) const;
+
     /**
      * Resizes the headers automatically based on the current size of the widget.
      * This function is called by the EVT_SIZE event handling mapping.
@@ -147,12 +476,63 @@ public:
      */
     void shuffle();
 
+    /**
+     * Only shows the tracks which match a filter: every word of it must occur
+     * in the artist, title, album or file name, ignoring case. The filter
+     * stays in effect when another directory is read.
+     *
+     * @param filter The filter, empty to show all tracks again.
+     */
+    void setFilter(const wxString& filter);
+
+    /**
+     * Returns the current filter.
+     */
+    const wxString& getFilter() const;
+
+    /**
+     * Sets the generation of the displayed directory. From now on, only
+     * events carrying this generation (as their extra long) are used.
+     *
+     * @param generation The generation, see DirBrowser::startTraversal().
+     */
+    void setGeneration(long generation);
+
+    /**
+     * Returns the generation of the displayed directory.
+     */
+    long getGeneration() const;
+
     // Plx respond to events.
     DECLARE_EVENT_TABLE()
 };
 
+//================================================================================
+
+/**
+ * Container of the TrackTable, with a search box above it to filter the
+ * tracks while typing.
+ */
+class TrackTableContainer : public wxPanel {
+private:
+    TrackTable* m_trackTable;
+
+    wxSearchCtrl* m_search;
 
+    /// Filters the TrackTable on the text typed so far.
+    void onFilter(wxCommandEvent& event);
+
+    /// Clears the filter.
+    void onFilterCancel(wxCommandEvent& event);
+public:
+    static const short ID_FILTER = 1050;
 
+    TrackTableContainer(wxWindow* parent);
+
+    TrackTable* getTrackTable() const;
+
+    DECLARE_EVENT_TABLE()
+};
 
 //================================================================================
 
@@ -0,0 +1,297 @@
+//      watcher.cpp
+//
+//      Copyright 2012 Kevin Pors <krpors@users.sf.net>
+//
+//      This program is free software; you can redistribute it and/or modify
+//      it under the terms of the GNU General Public License as published by
+//      the Free Software Foundation; either version 2 of the License, or
+//      (at your option) any later version.
+//
+//      This program is distributed in the hope that it will be useful,
+//      but WITHOUT ANY WARRANTY; without even the implied warranty of
+//      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//      GNU General Public License for more details.
+//
+//      You should have received a copy of the GNU General Public License
+//      along with this program; if not, write to the Free Software
+//      Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+//      MA 02110-1301, USA.
+
+#include "watcher.hpp"
+
+#include <iostream>
+#include <cerrno>
+#include <cstring>
+
+#include <poll.h>
+#include <unistd.h>
+#include <sys/inotify.h>
+
+namespace navi {
+
+// Declared in misc.cpp
+extern const wxEventType naviDirChangedEvent;
+
+/// The events we're interested in. Files are only picked up after they have
+/// been written completely (IN_CLOSE_WRITE), or when they're renamed into
+/// place, which is what rsync and most file managers do.
+static const uint32_t WATCH_MASK =
+    IN_CLOSE_WRITE | IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_ONLYDIR;
+
+//================================================================================
+
+DirWatcher::DirWatcher(wxEvtHandler* parent, const wxString& path, long generation, bool recursive) :
+        wxThread(wxTHREAD_JOINABLE),
+        m_parent(parent),
+        m_path(path),
+        m_generation(generation),
+        m_recursive(recursive),
+        m_active(true) {
+    m_fd = inotify_init();
+    if (m_fd == -1) {
+        std::cerr << "DirWatcher: inotify_init failed: " << strerror(errno) << std::endl;
+    }
+
+    // strip the trailing slash of wxFileName::DirName() paths, since we glue
+    // the names of the events to it.
+    if (m_path.Len() > 1 && m_path.EndsWith(wxT("/"))) {
+        m_path.RemoveLast();
+    }
+}
+
+DirWatcher::~DirWatcher() {
+    if (m_fd != -1) {
+        // closing the descriptor removes all watches too.
+        close(m_fd);
+    }
+}
+
+void DirWatcher::setActive(bool active) {
+    m_active = active;
+}
+
+wxThread::ExitCode DirWatcher::Entry() {
+    if (m_fd == -1) {
+        return 0;
+    }
+
+    addWatch(m_path, false);
+
+    // inotify_event structures are read straight from this buffer.
+    char buf[8192] __attribute__ ((aligned(__alignof__(struct inotify_event))));
+
+    while (m_active) {
+        struct pollfd pfd;
+        pfd.fd = m_fd;
+        pfd.events = POLLIN;
+
+        int ret = poll(&pfd, 1, POLL_TIMEOUT);
+        if (ret > 0 && (pfd.revents & POLLIN)) {
+            ssize_t len = read(m_fd, buf, sizeof(buf));
+            if (len > 0) {
+                handleEvents(buf, len);
+            }
+        } else if (ret < 0 && errno != EINTR) {
+            std::cerr << "DirWatcher: poll failed: " << strerror(errno) << std::endl;
+            break;
+        }
+
+        if (hasPending()
+                && (m_sinceLast.Time() >= QUIET_PERIOD || m_sinceFirst.Time() >= MAX_DELAY)) {
+            flush();
+        }
+    }
+
+    return 0;
+}
+
+void DirWatcher::addWatch(const wxString& dir, bool created) {
+    int wd = inotify_add_watch(m_fd, dir.fn_str(), WATCH_MASK);
+    if (wd == -1) {
+        // most likely ENOSPC: fs.inotify.max_user_watches is too low for the
+        // library. Changes in this directory will go unnoticed.
+        std::cerr << "DirWatcher: can't watch " << dir.mb_str() << ": "
+                  << strerror(errno) << std::endl;
+    } else {
+        m_watches[wd] = dir;
+    }
+
+    if (!created && !m_recursive) {
+        return;
+    }
+
+    wxDir d(dir);
+    if (!d.IsOpened()) {
+        return;
+    }
+
+    wxString name;
+    // A directory which was just created (or moved in) may already contain
+    // files before our watch was in place, so those are changes too.
+    if (created) {
+        bool more = d.GetFirst(&name, wxEmptyString, wxDIR_FILES);
+        while (more) {
+            fileChanged(dir + wxT("/") + name);
+            more = d.GetNext(&name);
+        }
+    }
+
+    if (m_recursive) {
+        bool more = d.GetFirst(&name, wxEmptyString, wxDIR_DIRS);
+        while (more) {
+            addWatch(dir + wxT("/") + name, created);
+            more = d.GetNext(&name);
+        }
+    }
+}
+
+void DirWatcher::handleEvents(const char* buf, size_t len) {
+    size_t pos = 0;
+    while (pos < len) {
+        const struct inotify_event* ev = reinterpret_cast<const struct inotify_event*>(buf + pos);
+        pos += sizeof(struct inotify_event) + ev->len;
+
+        if (ev->mask & IN_Q_OVERFLOW) {
+            std::cerr << "DirWatcher: event queue overflowed, changes were lost." << std::endl;
+            continue;
+        }
+        if (ev->mask & IN_IGNORED) {
+            // the watch is gone (directory deleted, or we removed it).
+            m_watches.erase(ev->wd);
+            continue;
+        }
+
+        std::map<int, wxString>::iterator it = m_watches.find(ev->wd);
+        if (it == m_watches.end() || ev->len == 0) {
+            continue;
+        }
+
+        wxString path = it->second + wxT("/") + wxString(ev->name, *wxConvFileName);
+
+        if (ev->mask & IN_ISDIR) {
+            // subdirectories only matter in library mode.
+            if (!m_recursive) {
+                continue;
+            }
+            if (ev->mask & (IN_CREATE | IN_MOVED_TO)) {
+                addWatch(path, true);
+            } else if (ev->mask & (IN_DELETE | IN_MOVED_FROM)) {
+                dirRemoved(path);
+            }
+        } else if (ev->mask & (IN_CLOSE_WRITE | IN_MOVED_TO)) {
+            fileChanged(path);
+        } else if (ev->mask & (IN_DELETE | IN_MOVED_FROM)) {
+            fileRemoved(path);
+        }
+    }
+}
+
+bool DirWatcher::hasPending() const {
+    return !m_changed.empty() || !m_removed.empty() || !m_removedDirs.empty();
+}
+
+void DirWatcher::fileChanged(const wxString& path) {
+    if (!isPlayableFile(path)) {
+        return;
+    }
+
+    if (!hasPending()) {
+        m_sinceFirst.Start();
+    }
+    m_sinceLast.Start();
+
+    m_removed.erase(path);
+    m_changed.insert(path);
+}
+
+void DirWatcher::fileRemoved(const wxString& path) {
+    if (!isPlayableFile(path)) {
+        return;
+    }
+
+    if (!hasPending()) {
+        m_sinceFirst.Start();
+    }
+    m_sinceLast.Start();
+
+    m_changed.erase(path);
+    m_removed.insert(path);
+}
+
+void DirWatcher::dirRemoved(const wxString& path) {
+    if (!hasPending()) {
+        m_sinceFirst.Start();
+    }
+    m_sinceLast.Start();
+
+    wxString prefix = path + wxT("/");
+
+    // pending changes below the directory are moot now.
+    std::set<wxString>::iterator it = m_changed.lower_bound(prefix);
+    while (it != m_changed.end() && it->StartsWith(prefix)) {
+        m_changed.erase(it++);
+    }
+    m_removedDirs.insert(path);
+
+    // A directory which is moved away keeps its watches, but they'd report
+    // the old paths. Forget about them.
+    std::map<int, wxString>::iterator w = m_watches.begin();
+    while (w != m_watches.end()) {
+        if (w->second == path || w->second.StartsWith(prefix)) {
+            inotify_rm_watch(m_fd, w->first);
+            m_watches.erase(w++);
+        } else {
+            ++w;
+        }
+    }
+}
+
+void DirWatcher::flush() {
+    DirChangeSet* changes = new DirChangeSet;
+    TagCache& cache = TagCache::get();
+
+    std::set<wxString>::iterator it;
+    for (it = m_removedDirs.begin(); it != m_removedDirs.end(); ++it) {
+        changes->removedDirs.Add(*it);
+    }
+    for (it = m_removed.begin(); it != m_removed.end(); ++it) {
+        cache.remove(*it);
+        changes->removed.Add(*it);
+    }
+    for (it = m_changed.begin(); it != m_changed.end() && m_active; ++it) {
+        TrackInfo info;
+        try {
+            // the modification time changed, so the cache won't be used.
+            TrackScanner::readTrackInfo(*it, info);
+            changes->updated.push_back(info);
+        } catch (const AudioException& ex) {
+            // not readable (anymore), so it can't stay in the list either.
+            std::cerr << "DirWatcher: " << ex.what() << std::endl;
+            cache.remove(*it);
+            changes->removed.Add(*it);
+        }
+    }
+
+    m_changed.clear();
+    m_removed.clear();
+    m_removedDirs.clear();
+
+    if (!m_active) {
+        delete changes;
+        return;
+    }
+
+    std::cout << "DirWatcher: " << changes->updated.size() << " updated, "
+              << changes->removed.GetCount() + changes->removedDirs.GetCount()
+              << " removed." << std::endl;
+
+    // The TrackTable deletes the change set.
+    wxCommandEvent event(naviDirChangedEvent);
+    event.SetClientObject(changes);
+    event.SetExtraLong(m_generation);
+    m_parent->AddPendingEvent(event);
+
+    cache.save();
+}
+
+} // namespace navi
@@ -0,0 +1,185 @@
+//      watcher.hpp
+//
+//      Copyright 2012 Kevin Pors <krpors@users.sf.net>
+//
+//      This program is free software; you can redistribute it and/or modify
+//      it under the terms of the GNU General Public License as published by
+//      the Free Software Foundation; either version 2 of the License, or
+//      (at your option) any later version.
+//
+//      This program is distributed in the hope that it will be useful,
+//      but WITHOUT ANY WARRANTY; without even the implied warranty of
+//      MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//      GNU General Public License for more details.
+//
+//      You should have received a copy of the GNU General Public License
+//      along with this program; if not, write to the Free Software
+//      Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+//      MA 02110-1301, USA.
+
+#ifndef WATCHER_HPP
+#define WATCHER_HPP
+
+#include "audio.hpp"
+#include "misc.hpp"
+#include "scanner.hpp"
+#include "tagcache.hpp"
+
+#include <map>
+#include <set>
+#include <vector>
+
+#include <wx/wx.h>
+#include <wx/dir.h>
+#include <wx/thread.h>
+#include <wx/stopwatch.h>
+
+namespace navi {
+
+//================================================================================
+
+/**
+ * A set of changes on disk, used as the client object of the naviDirChangedEvent
+ * posted by the DirWatcher to the TrackTable.
+ */
+class DirChangeSet : public wxClientData {
+public:
+    /// Tracks which were created or modified, with freshly read tags.
+    std::vector<TrackInfo> updated;
+
+    /// Full paths of files which were deleted or moved away.
+    wxArrayString removed;
+
+    /// Full paths of directories which were deleted or moved away. All
+    /// tracks below them are gone (library mode only).
+    wxArrayString removedDirs;
+};
+
+//================================================================================
+
+/**
+ * The DirWatcher uses inotify to keep an eye on the directory (or in library
+ * mode, the whole tree) which is displayed in the TrackTable. Instead of
+ * re-reading the whole directory, only the files which were created, modified,
+ * renamed or deleted are handed to the TrackTable.
+ *
+ * Copying a whole album results in a burst of events, so changes are collected
+ * until nothing happened for QUIET_PERIOD milliseconds (or MAX_DELAY has passed
+ * since the first change), and are then posted as one DirChangeSet. The tags of
+ * the changed files are read on this thread, through the TagCache.
+ *
+ * Like the DirTraversalThread, it's a joinable thread: stop it with
+ * setActive(false) and Wait() for it.
+ */
+class DirWatcher : public wxThread {
+private:
+    /// The TrackTable to post the change sets to.
+    wxEvtHandler* m_parent;
+
+    /// The watched directory.
+    wxString m_path;
+
+    /// The generation of the traversal this watcher belongs to.
+    long m_generation;
+
+    /// Whether subdirectories are watched too.
+    bool m_recursive;
+
+    /// Polled by the thread, false to stop.
+    bool m_active;
+
+    /// The inotify file descriptor, -1 when inotify is not available.
+    int m_fd;
+
+    /// Watched directories by watch descriptor.
+    std::map<int, wxString> m_watches;
+
+    /// Paths of created or modified files since the last flush.
+    std::set<wxString> m_changed;
+
+    /// Paths of deleted files since the last flush.
+    std::set<wxString> m_removed;
+
+    /// Paths of deleted directories since the last flush.
+    std::set<wxString> m_removedDirs;
+
+    /// Time since the first change of the pending set.
+    wxStopWatch m_sinceFirst;
+
+    /// Time since the latest change of the pending set.
+    wxStopWatch m_sinceLast;
+
+    /**
+     * Adds a watch for a directory, and in recursive mode for all of its
+     * subdirectories.
+     *
+     * @param dir The full path of the directory.
+     * @param created true when the directory was just created. Files which
+     *  were put in it before the watch existed are then marked as changed.
+     */
+    void addWatch(const wxString& dir, bool created);
+
+    /**
+     * Handles all inotify events in the buffer.
+     *
+     * @param buf The data read from the inotify descriptor.
+     * @param len The amount of bytes in buf.
+     */
+    void handleEvents(const char* buf, size_t len);
+
+    /// Marks a file as created or modified.
+    void fileChanged(const wxString& path);
+
+    /// Marks a file as deleted.
+    void fileRemoved(const wxString& path);
+
+    /// Marks a directory (and everything below it) as deleted.
+    void dirRemoved(const wxString& path);
+
+    /// Whether there are changes which have not been posted yet.
+    bool hasPending() const;
+
+    /// Reads the changed files, and posts the pending changes as one set.
+    void flush();
+
+public:
+    /// Milliseconds without changes before the pending changes are posted.
+    static const long QUIET_PERIOD = 500;
+
+    /// Maximum amount of milliseconds changes are held back during a burst.
+    static const long MAX_DELAY = 3000;
+
+    /// Milliseconds to wait for events at a time, so setActive(false) is
+    /// noticed quickly.
+    static const int POLL_TIMEOUT = 100;
+
+    /**
+     * Creates the watcher. Nothing is watched until the thread runs.
+     *
+     * @param parent The handler (the TrackTable) to post the change sets to.
+     * @param path The directory to watch.
+     * @param generation The generation, set on every posted event (see
+     *  TrackTable::setGeneration()).
+     * @param recursive true to watch all subdirectories too (library mode).
+     */
+    DirWatcher(wxEvtHandler* parent, const wxString& path, long generation, bool recursive);
+
+    /**
+     * Closes the inotify descriptor.
+     */
+    ~DirWatcher();
+
+    /**
+     * Sets the activity state. Set it to false to stop the thread.
+     */
+    void setActive(bool active);
+
+    /**
+     * Override from wxThread. Waits for events until deactivated.
+     */
+    virtual wxThread::ExitCode Entry();
+};
+
+} // namespace navi
+
+#endif // WATCHER_HPP